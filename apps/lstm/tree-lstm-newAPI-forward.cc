@@ -206,7 +206,7 @@ int main(int argc, char* argv[]) {
   Sym loss = graph_output.FullyConnected(weight, bias).SoftmaxEntropyLoss(label_reshape);
   //Sym train      = loss.Optimizer({}, FLAGS_lr);
   Sym perplexity = loss.Reduce_mean();
-  Session sess;
+  Session sess(OPT_BATCHING+OPT_INFERENCE);
   int iterations = NUM_SAMPLES / FLAGS_batch_size; 
   //vector<float> input_data(FLAGS_batch_size*MAX_LEN, -1);
   vector<float> input_data(FLAGS_batch_size*MAX_DEPENDENCY, -1);
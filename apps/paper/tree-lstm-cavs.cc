@@ -1,11 +1,14 @@
 #include "cavs/frontend/cxx/sym.h"
 #include "cavs/frontend/cxx/graphsupport.h"
+#include "cavs/frontend/cxx/graph_sampler.h"
+#include "cavs/frontend/cxx/graph_server.h"
 #include "cavs/frontend/cxx/session.h"
 #include "cavs/proto/opt.pb.h"
 
 #include <iostream>
 #include <fstream>
 #include <vector>
+#include <algorithm>
 
 using namespace std;
 
@@ -18,6 +21,16 @@ DEFINE_int32 (epoch,       1,        "epochs");
 DEFINE_int32 (iters,       99999,    "iterations");
 DEFINE_double(init_scale,  0.1f,     "init random scale of variables");
 DEFINE_double(lr,          1.f,      "learning rate");
+DEFINE_bool  (pipelining,  false,    "prepare the next batch while the current one runs");
+DEFINE_bool  (bucketing,   false,    "batch the trees of similar depth together");
+DEFINE_bool  (shuffle,     false,    "shuffle the samples every epoch");
+DEFINE_bool  (ragged,      false,    "feed the graphs and the words packed instead of padded");
+DEFINE_string(policy,      "level",  "batching policy: level, agenda or hybrid");
+DEFINE_bool  (hoisting,    true,     "embed and project the words of all the vertices at once, out of the rounds");
+DEFINE_bool  (checkpointing, false,  "recompute the activations of each round in the backward pass instead of keeping them");
+DEFINE_string(serve,       "",       "serve the trees sent to this unix socket instead of training");
+DEFINE_int32 (serve_timeout_us, 1000, "the longest a request waits for its batch to fill");
+DEFINE_int32 (serve_seconds,    60,   "how long to serve");
 
 int MAX_LEN = 56;
 int MAX_DEPENDENCY = 111;
@@ -27,80 +40,69 @@ DEFINE_string(input_file, "/users/shizhenx/projects/Cavs/apps/lstm/data/sst/trai
 DEFINE_string(label_file, "/users/shizhenx/projects/Cavs/apps/lstm/data/sst/train/labels.txt",    "label sentences");
 DEFINE_string(graph_file, "/users/shizhenx/projects/Cavs/apps/lstm/data/sst/train/parents.txt",   "graph dependency");
 
+//the samples are loaded once and batched by the sampler
 class Reader {
  public:
   Reader(const string input, const string label, const string graph) :
-      input_path(input), label_path(label), graph_path(graph),
-      input_file(input), label_file(label), graph_file(graph) {
+      sampler_(FLAGS_batch_size, MAX_DEPENDENCY, FLAGS_bucketing, FLAGS_shuffle) {
+    ifstream input_file(input), label_file(label), graph_file(graph);
+    string input_str, label_str, graph_str;
+    while (getline(input_file, input_str)) {
+      if (input_str.length() == 0)
+        continue;
+      getline(label_file, label_str);
+      getline(graph_file, graph_str);
+      vector<int> parents = process_data<int>(graph_str, -1);
+      CHECK(MAX_DEPENDENCY >= parents.size());
+      inputs_.push_back(process_data<float>(input_str, 0));
+      CHECK(MAX_LEN >= inputs_.back().size());
+      labels_.push_back(process_data<float>(label_str, 0));
+      CHECK(MAX_DEPENDENCY >= labels_.back().size());
+      sampler_.AddSample(parents);
+      vertices_.push_back(parents.size());
+    }
   }
 
+  //in the ragged form the words of a sample follow the ones before it,
+  //as the vertices are numbered by the scheduler
   void next_batch( vector<int>* batch_graph, vector<float>* batch_input, vector<float>* batch_label) {
     std::fill(batch_input->begin(), batch_input->end(), 0);
     std::fill(batch_label->begin(), batch_label->end(), -1);
-    std::fill(batch_graph->begin(), batch_graph->end(), -1);
-    int i = 0; 
+    const vector<int>& batch = sampler_.NextBatch();
+    if (FLAGS_ragged)
+      sampler_.FillRaggedGraph(batch, batch_graph->data());
+    else
+      sampler_.FillGraph(batch, batch_graph->data());
     int label_length = 0;
-    while (i < FLAGS_batch_size) {
-      if (input_file.eof()) { // which mean it reaches the end of the file
-        input_file.clear();
-        input_file.seekg(0, ios::beg);
-        label_file.clear();
-        label_file.seekg(0, ios::beg);
-        graph_file.clear();
-        graph_file.seekg(0, ios::beg);
-      }
-
-      string input_str, label_str, graph_str;
-      getline(input_file, input_str);
-      if (input_str.length() > 0) {
-        getline(label_file, label_str);
-        getline(graph_file, graph_str);
-        int length;
-        process_graph<int>(batch_graph->data() + i*MAX_DEPENDENCY, &length, graph_str);
-        CHECK(MAX_DEPENDENCY >= length);
-
-        process_data<float>(batch_input->data() + i*MAX_DEPENDENCY, &length, input_str);
-        CHECK(MAX_LEN >= length);
-
-        process_data<float>(batch_label->data() + label_length, &length, label_str);
-        CHECK(MAX_DEPENDENCY >= length);
-        label_length += length;
-        i++;
-      }
+    int vertex_offset = 0;
+    for (int i = 0; i < batch.size(); i++) {
+      const vector<float>& input = inputs_[batch[i]];
+      const vector<float>& label = labels_[batch[i]];
+      int input_offset = FLAGS_ragged ? vertex_offset : i*MAX_DEPENDENCY;
+      std::copy(input.begin(), input.end(), batch_input->data() + input_offset);
+      std::copy(label.begin(), label.end(), batch_label->data() + label_length);
+      label_length += label.size();
+      vertex_offset += vertices_[batch[i]];
     }
   }
 
- private:
-  template<typename T>
-  void process_data(T* data, int* len, const string& str) {
-    stringstream input_stream(str);
-    int val, idx = 0;
-    while (input_stream >> val) {
-      data[idx] = val; 
-      idx++;
-    }
-    *len = idx;
-  }
+  const GraphBatchSampler& sampler() const { return sampler_; }
 
+ private:
   template<typename T>
-  void process_graph(T* data, int* len, const string& str) {
+  vector<T> process_data(const string& str, int shift) {
     stringstream input_stream(str);
-    int val, idx = 0;
-    while (input_stream >> val) {
-      data[idx] = val-1;
-      idx++;
-    }
-    *len = idx;
-    CHECK(data[idx-1] == -1);
+    vector<T> data;
+    int val;
+    while (input_stream >> val)
+      data.push_back(val + shift);
+    return data;
   }
 
-  string input_path;
-  string label_path;
-  string graph_path;
-
-  ifstream input_file;
-  ifstream label_file;
-  ifstream graph_file;
+  GraphBatchSampler sampler_;
+  vector<vector<float>> inputs_;
+  vector<vector<float>> labels_;
+  vector<int> vertices_;
 };
 
 class TreeModel : public GraphSupport {
@@ -171,6 +173,27 @@ class TreeModel : public GraphSupport {
     Push(h.Mirror());
   }
 
+  // the children of a leaf are all zeros,
+  // so it needs neither the Gathers nor the U matmuls
+  void Leaf() override {
+    Sym x = Pull(0, {1});
+    x = x.EmbeddingLookup(embedding.Mirror());
+
+    Sym xW = Sym::MatMul(x, W.Reshape({FLAGS_embedding, 4 * FLAGS_hidden}).Mirror()).Reshape({FLAGS_hidden * 4});
+    Sym xW_i, xW_o, xW_u, xW_f;
+    tie(xW_i, xW_o, xW_u, xW_f) = xW.Split4();
+
+    Sym i = (xW_i + b_i.Mirror()).Sigmoid();
+    Sym o = (xW_o + b_o.Mirror()).Sigmoid();
+    Sym u = (xW_u + b_u.Mirror()).Tanh();
+
+    Sym c = i * u;
+    Sym h = o * Sym::Tanh(c.Mirror());
+
+    Scatter(Sym::Concat({h.Mirror(), c.Mirror()}));
+    Push(h.Mirror());
+  }
+
  private:
   Sym W, U, B;
   Sym embedding;
@@ -188,7 +211,10 @@ int main(int argc, char* argv[]) {
   
   Reader sst_reader(FLAGS_input_file, FLAGS_label_file, FLAGS_graph_file);
 
-  Sym graph    = Sym::Placeholder(DT_FLOAT, {FLAGS_batch_size, MAX_DEPENDENCY}, "CPU");
+  const int ragged_capacity = sst_reader.sampler().ragged_capacity();
+  Sym graph    = FLAGS_ragged ?
+                 Sym::Placeholder(DT_FLOAT, {ragged_capacity}, "CPU") :
+                 Sym::Placeholder(DT_FLOAT, {FLAGS_batch_size, MAX_DEPENDENCY}, "CPU");
   //Sym word_idx = Sym::Placeholder(DT_FLOAT, {FLAGS_batch_size, MAX_LEN});
   Sym word_idx = Sym::Placeholder(DT_FLOAT, {FLAGS_batch_size, MAX_DEPENDENCY});
   Sym label    = Sym::Placeholder(DT_FLOAT, {FLAGS_batch_size, MAX_DEPENDENCY});
@@ -203,23 +229,82 @@ int main(int argc, char* argv[]) {
   Sym loss = graph_output.FullyConnected(weight, bias).SoftmaxEntropyLoss(label_reshape);
   Sym train      = loss.Optimizer({}, FLAGS_lr);
   Sym perplexity = loss.Reduce_mean();
-  Session sess(OPT_BATCHING);
+  int opt = OPT_BATCHING | (FLAGS_pipelining ? OPT_PIPELINING : 0);
+  if (FLAGS_policy == "agenda")
+    opt |= OPT_BATCHING_AGENDA;
+  else if (FLAGS_policy == "hybrid")
+    opt |= OPT_BATCHING_HYBRID;
+  else
+    CHECK(FLAGS_policy == "level") << FLAGS_policy;
+  if (FLAGS_hoisting)
+    opt |= OPT_HOISTING;
+  if (FLAGS_checkpointing)
+    opt |= OPT_CHECKPOINTING;
+  if (!FLAGS_serve.empty()) {
+    //one batched forward pass for the requests of a batch,
+    //the hidden state of every vertex goes back to its caller
+    CHECK(FLAGS_ragged) << "the requests are batched in the ragged form";
+    Session infer(opt | OPT_INFERENCE);
+    vector<int>   graph_data(ragged_capacity);
+    vector<float> input_data(FLAGS_batch_size*MAX_DEPENDENCY);
+    GraphBatchServer server(
+        [&](const int* g, const float* inputs, float* outputs) {
+          const int vertices = g[1 + g[0]];
+          std::copy(g, g + ragged_capacity, graph_data.begin());
+          std::copy(inputs, inputs + vertices, input_data.begin());
+          infer.Run({graph_output}, {{graph,    graph_data.data()},
+                                     {word_idx, input_data.data()}});
+          const float* h = (const float*)graph_output.eval();
+          std::copy(h, h + vertices*FLAGS_hidden, outputs);
+        },
+        FLAGS_batch_size, FLAGS_batch_size*MAX_DEPENDENCY, 1, FLAGS_hidden,
+        FLAGS_serve_timeout_us);
+    server.Listen(FLAGS_serve);
+    std::this_thread::sleep_for(std::chrono::seconds(FLAGS_serve_seconds));
+    server.Stop();
+    server.LogStats();
+    return 0;
+  }
+  Session sess(opt);
   //int iterations = NUM_SAMPLES / FLAGS_batch_size; 
   int iterations = FLAGS_iters;
   //vector<float> input_data(FLAGS_batch_size*MAX_LEN, -1);
   vector<float> input_data(FLAGS_batch_size*MAX_DEPENDENCY, -1);
   vector<float> label_data(FLAGS_batch_size*MAX_DEPENDENCY, -1);
-  vector<int>   graph_data(FLAGS_batch_size*MAX_DEPENDENCY, -1);
+  vector<int>   graph_data(FLAGS_ragged ? ragged_capacity : FLAGS_batch_size*MAX_DEPENDENCY, -1);
   //for (int i = 0; i < 33; i++)
     //sst_reader.next_batch(&graph_data, &input_data, &label_data);
   for (int i = 0; i < FLAGS_epoch; i++) {
     for (int j = 0; j < iterations; j++) {
-      sst_reader.next_batch(&graph_data, &input_data, &label_data);
-      sess.Run({train}, {{graph,    graph_data.data()},
+      if (FLAGS_pipelining) {
+        //batch j+1 is parsed and scheduled while batch j runs
+        for (int k = (j == 0) ? 0 : 1; k < 2 && j+k < iterations; k++) {
+          sst_reader.next_batch(&graph_data, &input_data, &label_data);
+          sess.Prefetch({{graph,    graph_data.data()},
                          {label,    label_data.data()},
                          {word_idx, input_data.data()}});
+        }
+        sess.Run({train});
+      }else {
+        sst_reader.next_batch(&graph_data, &input_data, &label_data);
+        sess.Run({train}, {{graph,    graph_data.data()},
+                           {label,    label_data.data()},
+                           {word_idx, input_data.data()}});
+      }
       LOG(INFO) << "Traing Epoch:\t" << i << "\tIteration:\t" << j;
     }
+    if (i == 0) {
+      sst_reader.sampler().LogStats();
+      for (int backward = 0; backward < 2; backward++) {
+        C_GraphStats stats = sess.GraphStats(backward);
+        LOG(INFO) << (backward ? "Backward" : "Forward") << " graph batching:\t"
+                  << stats.rounds << " rounds of "
+                  << (float)stats.vertices/std::max(stats.rounds, 1LL) << " vertices, "
+                  << (float)stats.statements/std::max(stats.vertices, 1LL)
+                  << " statements per vertex, scheduling "
+                  << stats.schedule_ms << "ms, computing " << stats.compute_ms << "ms";
+      }
+    }
     //float sum = 0.f;
     //for (int j = 0; j < iterations; j++) {
       //sst_reader.next_batch(&graph_data, &input_data, &label_data);
@@ -0,0 +1,24 @@
+#ifndef CAVS_BACKEND_CPU_COMMON_H_
+#define CAVS_BACKEND_CPU_COMMON_H_
+
+#include "cavs/backend/cpu_thread_pool.h"
+
+namespace backend {
+
+//rows of one batching round are usually few,
+//so small loops stay on the calling thread
+const int CPU_MIN_PARALLEL_WORK = 1 << 15;
+
+inline int CPU_MAX_THREADS() {
+  return IntraOpThreadPool::Global()->active_threads();
+}
+
+//splits [0, n) over the intra-op thread pool, see IntraOpThreadPool::ParallelFor
+template <typename FUNC>
+void ParallelFor(int n, int grain, FUNC func) {
+  IntraOpThreadPool::Global()->ParallelFor(n, grain, func);
+}
+
+} //namespace backend
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef CAVS_BACKEND_CPU_SIMD_H_
+#define CAVS_BACKEND_CPU_SIMD_H_
+
+#include "cavs/util/macros.h"
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+//the float vector primitives shared by the host kernels.
+//CAVS_CPU_SIMD is left undefined when neither AVX2 nor AVX-512
+//is enabled, the kernels then take their scalar paths.
+namespace backend {
+
+namespace simd {
+
+#if defined(__AVX512F__)
+#define CAVS_CPU_SIMD
+typedef __m512 vfloat;
+const int WIDTH = 16;
+FORCE_INLINE vfloat Load(const float* p) { return _mm512_loadu_ps(p); }
+FORCE_INLINE void Store(float* p, vfloat v) { _mm512_storeu_ps(p, v); }
+FORCE_INLINE vfloat Set1(float v) { return _mm512_set1_ps(v); }
+FORCE_INLINE vfloat Zero() { return _mm512_setzero_ps(); }
+FORCE_INLINE vfloat VAdd(vfloat a, vfloat b) { return _mm512_add_ps(a, b); }
+FORCE_INLINE vfloat VSub(vfloat a, vfloat b) { return _mm512_sub_ps(a, b); }
+FORCE_INLINE vfloat VMul(vfloat a, vfloat b) { return _mm512_mul_ps(a, b); }
+FORCE_INLINE vfloat VDiv(vfloat a, vfloat b) { return _mm512_div_ps(a, b); }
+FORCE_INLINE vfloat VMax(vfloat a, vfloat b) { return _mm512_max_ps(a, b); }
+FORCE_INLINE vfloat VMin(vfloat a, vfloat b) { return _mm512_min_ps(a, b); }
+FORCE_INLINE vfloat VAbs(vfloat a) { return _mm512_abs_ps(a); }
+//a*b+c
+FORCE_INLINE vfloat VFma(vfloat a, vfloat b, vfloat c) { return _mm512_fmadd_ps(a, b, c); }
+FORCE_INLINE float VSum(vfloat a) { return _mm512_reduce_add_ps(a); }
+#elif defined(__AVX2__)
+#define CAVS_CPU_SIMD
+typedef __m256 vfloat;
+const int WIDTH = 8;
+FORCE_INLINE vfloat Load(const float* p) { return _mm256_loadu_ps(p); }
+FORCE_INLINE void Store(float* p, vfloat v) { _mm256_storeu_ps(p, v); }
+FORCE_INLINE vfloat Set1(float v) { return _mm256_set1_ps(v); }
+FORCE_INLINE vfloat Zero() { return _mm256_setzero_ps(); }
+FORCE_INLINE vfloat VAdd(vfloat a, vfloat b) { return _mm256_add_ps(a, b); }
+FORCE_INLINE vfloat VSub(vfloat a, vfloat b) { return _mm256_sub_ps(a, b); }
+FORCE_INLINE vfloat VMul(vfloat a, vfloat b) { return _mm256_mul_ps(a, b); }
+FORCE_INLINE vfloat VDiv(vfloat a, vfloat b) { return _mm256_div_ps(a, b); }
+FORCE_INLINE vfloat VMax(vfloat a, vfloat b) { return _mm256_max_ps(a, b); }
+FORCE_INLINE vfloat VMin(vfloat a, vfloat b) { return _mm256_min_ps(a, b); }
+FORCE_INLINE vfloat VAbs(vfloat a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.f), a); }
+#ifdef __FMA__
+FORCE_INLINE vfloat VFma(vfloat a, vfloat b, vfloat c) { return _mm256_fmadd_ps(a, b, c); }
+#else
+FORCE_INLINE vfloat VFma(vfloat a, vfloat b, vfloat c) { return _mm256_add_ps(_mm256_mul_ps(a, b), c); }
+#endif
+FORCE_INLINE float VSum(vfloat a) {
+  __m128 s = _mm_add_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+  s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+  s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+  return _mm_cvtss_f32(s);
+}
+#endif
+
+} //namespace simd
+
+} //namespace backend
+
+#endif
@@ -0,0 +1,215 @@
+#include "cavs/backend/cpu_thread_pool.h"
+#include "cavs/util/logging.h"
+
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <fstream>
+#include <sstream>
+#include <map>
+
+DEFINE_int32(intra_op_threads, 0,
+    "threads splitting the loops of the CPU kernels, 0 uses every core the process may run on");
+DEFINE_bool(intra_op_pin_threads, false,
+    "pins each intra-op worker to one core");
+DEFINE_bool(intra_op_numa, true,
+    "orders the intra-op workers by NUMA node, so the chunks of a loop on one node are contiguous");
+
+using std::string;
+using std::vector;
+using std::map;
+
+namespace backend {
+
+namespace {
+
+//"0-3,8,10-11"
+vector<int> ParseCpuList(const string& list) {
+  vector<int> cpus;
+  std::stringstream ss(list);
+  string range;
+  while (std::getline(ss, range, ',')) {
+    if (range.empty() || range == "\n")
+      continue;
+    size_t dash = range.find('-');
+    int first = atoi(range.c_str());
+    int last = (dash == string::npos) ? first : atoi(range.c_str() + dash + 1);
+    for (int c = first; c <= last; c++)
+      cpus.push_back(c);
+  }
+  return cpus;
+}
+
+//the NUMA node of each core, empty without the sysfs entries
+map<int, int> CpuNodes() {
+  map<int, int> nodes;
+  const string root = "/sys/devices/system/node/";
+  DIR* dir = opendir(root.c_str());
+  if (!dir)
+    return nodes;
+  while (struct dirent* entry = readdir(dir)) {
+    const string name = entry->d_name;
+    if (name.compare(0, 4, "node") != 0 || name.size() == 4 ||
+        name.find_first_not_of("0123456789", 4) != string::npos)
+      continue;
+    std::ifstream in(root + name + "/cpulist");
+    string list;
+    std::getline(in, list);
+    for (int c : ParseCpuList(list))
+      nodes[c] = atoi(name.c_str() + 4);
+  }
+  closedir(dir);
+  return nodes;
+}
+
+//the cores the process may run on, ordered by NUMA node if asked
+vector<int> OrderedCpus(bool numa, int* num_nodes) {
+  vector<int> cpus;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+    for (int c = 0; c < CPU_SETSIZE; c++) {
+      if (CPU_ISSET(c, &set))
+        cpus.push_back(c);
+    }
+  }
+  *num_nodes = 1;
+  if (numa) {
+    map<int, int> nodes = CpuNodes();
+    auto node = [&nodes](int c) { return nodes.count(c) ? nodes.at(c) : 0; };
+    std::stable_sort(cpus.begin(), cpus.end(),
+        [&node](int a, int b) { return node(a) < node(b); });
+    vector<int> distinct;
+    for (int c : cpus)
+      distinct.push_back(node(c));
+    *num_nodes = std::max<int>(1,
+        std::unique(distinct.begin(), distinct.end()) - distinct.begin());
+  }
+  return cpus;
+}
+
+} //namespace
+
+thread_local int IntraOpThreadPool::depth_ = 0;
+
+IntraOpThreadPool::IntraOpThreadPool(int threads, const vector<int>& cpus)
+    : active_(std::max(threads, 1)) {
+  for (int i = 1; i < threads; i++) {
+    Worker* w = new Worker();
+    const int cpu = cpus.empty() ? -1 : cpus[i % cpus.size()];
+    w->thread = std::thread(&IntraOpThreadPool::WorkerLoop, this, w, cpu);
+    workers_.push_back(w);
+  }
+}
+
+IntraOpThreadPool::~IntraOpThreadPool() {
+  for (auto* w : workers_) {
+    {
+      std::lock_guard<std::mutex> lock(w->mu);
+      w->stopping = true;
+    }
+    w->cv.notify_all();
+  }
+  for (auto* w : workers_) {
+    w->thread.join();
+    delete w;
+  }
+}
+
+IntraOpThreadPool* IntraOpThreadPool::Global() {
+  static IntraOpThreadPool* pool = []() {
+    int num_nodes;
+    vector<int> cpus = OrderedCpus(FLAGS_intra_op_numa, &num_nodes);
+    int threads = FLAGS_intra_op_threads;
+    if (threads <= 0)
+      threads = std::max<int>(1, cpus.size());
+    LOG(INFO) << "Intra-op thread pool:\t" << threads << " threads over "
+              << cpus.size() << " cores on " << num_nodes << " NUMA nodes"
+              << (FLAGS_intra_op_pin_threads ? ", pinned" : "");
+    return new IntraOpThreadPool(threads,
+        FLAGS_intra_op_pin_threads ? cpus : vector<int>());
+  }();
+  return pool;
+}
+
+void IntraOpThreadPool::SetActiveThreads(int active) {
+  CHECK(active > 0) << active;
+  active_.store(std::min(active, threads()), std::memory_order_relaxed);
+}
+
+//a thread splits one loop at a time, the loops started
+//by its chunks run inline, so its chunks can be reused
+void IntraOpThreadPool::Split(Loop* loop, int n, int chunk) {
+  static thread_local vector<Chunk> chunks;
+  const int nthreads = (n + chunk - 1) / chunk;
+  CHECK(nthreads <= threads());
+  chunks.resize(nthreads-1);
+  loop->remaining = nthreads-1;
+  for (int t = 1; t < nthreads; t++) {
+    Chunk& c = chunks[t-1];
+    c.loop = loop;
+    c.start = t*chunk;
+    c.end = std::min(n, c.start+chunk);
+    Worker* w = workers_[t-1];
+    {
+      std::lock_guard<std::mutex> lock(w->mu);
+      w->queue.push_back(&c);
+    }
+    w->cv.notify_one();
+  }
+  depth_++;
+  loop->invoke(loop->func, 0, std::min(n, chunk));
+  //a worker busy with the chunk of another loop is not waited for
+  for (int t = nthreads-1; t > 0; t--) {
+    Worker* w = workers_[t-1];
+    bool taken = false;
+    {
+      std::lock_guard<std::mutex> lock(w->mu);
+      auto it = std::find(w->queue.begin(), w->queue.end(), &chunks[t-1]);
+      if (it != w->queue.end()) {
+        w->queue.erase(it);
+        taken = true;
+      }
+    }
+    if (taken)
+      RunChunk(chunks[t-1]);
+  }
+  depth_--;
+  std::unique_lock<std::mutex> lock(loop->mu);
+  loop->done.wait(lock, [loop] { return loop->remaining == 0; });
+}
+
+//the loop is released by the last chunk under its lock,
+//so it outlives the notification
+void IntraOpThreadPool::RunChunk(const Chunk& c) {
+  Loop* loop = c.loop;
+  loop->invoke(loop->func, c.start, c.end);
+  std::lock_guard<std::mutex> lock(loop->mu);
+  if (--loop->remaining == 0)
+    loop->done.notify_all();
+}
+
+void IntraOpThreadPool::WorkerLoop(Worker* w, int cpu) {
+  if (cpu >= 0) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+      LOG(WARNING) << "Failed to pin an intra-op worker to core " << cpu;
+  }
+  depth_ = 1;
+  std::unique_lock<std::mutex> lock(w->mu);
+  while (true) {
+    w->cv.wait(lock, [w] { return w->stopping || !w->queue.empty(); });
+    if (w->stopping)
+      return;
+    Chunk* c = w->queue.front();
+    w->queue.pop_front();
+    lock.unlock();
+    RunChunk(*c);
+    lock.lock();
+  }
+}
+
+} //namespace backend
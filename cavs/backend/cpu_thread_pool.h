@@ -0,0 +1,97 @@
+#ifndef CAVS_BACKEND_CPU_THREAD_POOL_H_
+#define CAVS_BACKEND_CPU_THREAD_POOL_H_
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <condition_variable>
+
+namespace backend {
+
+//The threads every CPU kernel of the process splits its loops over,
+//so that kernels running at the same time(see OPT_INTER_OP) queue
+//their chunks instead of oversubscribing the cores.
+//Chunk t of a loop always goes to worker t, and the workers are ordered
+//by NUMA node(--intra_op_numa) and may be pinned to their cores
+//(--intra_op_pin_threads). Two loops split alike then touch each
+//chunk from the same core, and the pages a chunk first touched
+//stay on the node that reads them.
+class IntraOpThreadPool {
+ public:
+  //threads counts the calling thread,
+  //the workers are pinned to cpus[1...] unless cpus is empty
+  IntraOpThreadPool(int threads, const std::vector<int>& cpus);
+  ~IntraOpThreadPool();
+  //the pool of the process, configured by the gflags on first use
+  static IntraOpThreadPool* Global();
+
+  //splits [0, n) into contiguous chunks of at least grain items,
+  //the calling thread takes the first chunk.
+  //func is invoked as func(start, end).
+  //A loop started from within a chunk runs on its thread
+  template <typename FUNC>
+  void ParallelFor(int n, int grain, FUNC func);
+
+  inline int threads() const { return workers_.size()+1; }
+  //at most active threads split a loop, the first ones in the order of the cores
+  inline int active_threads() const {
+    return active_.load(std::memory_order_relaxed);
+  }
+  void SetActiveThreads(int active);
+
+ private:
+  struct Loop {
+    void (*invoke)(const void* func, int start, int end);
+    const void* func;
+    int remaining;
+    std::mutex mu;
+    std::condition_variable done;
+  };
+  struct Chunk {
+    Loop* loop;
+    int start;
+    int end;
+  };
+  struct Worker {
+    Worker() : stopping(false) {}
+    std::mutex mu;
+    std::condition_variable cv;
+    std::deque<Chunk*> queue;
+    bool stopping;
+    std::thread thread;
+  };
+  template <typename FUNC>
+  static void Invoke(const void* func, int start, int end) {
+    (*static_cast<const FUNC*>(func))(start, end);
+  }
+  void Split(Loop* loop, int n, int chunk);
+  void WorkerLoop(Worker* w, int cpu);
+  static void RunChunk(const Chunk& c);
+
+  //the loops running on this thread, the workers are always in one
+  static thread_local int depth_;
+  std::vector<Worker*> workers_;
+  std::atomic<int> active_;
+};
+
+template <typename FUNC>
+void IntraOpThreadPool::ParallelFor(int n, int grain, FUNC func) {
+  if (n <= 0) return;
+  grain = std::max(grain, 1);
+  int nthreads = std::min(active_threads(), n / grain);
+  if (nthreads <= 1 || depth_ > 0) {
+    func(0, n);
+    return;
+  }
+  Loop loop;
+  loop.invoke = &Invoke<FUNC>;
+  loop.func = &func;
+  Split(&loop, n, (n + nthreads - 1) / nthreads);
+}
+
+} //namespace backend
+
+#endif
@@ -0,0 +1,120 @@
+#include "cavs/backend/cpu_thread_pool.h"
+#include "cavs/backend/op_impl_elementwise_cpu.h"
+#include "cavs/backend/functor_batched_memcpy.h"
+#include "cavs/util/logging.h"
+
+#include <stdlib.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+using namespace backend;
+using std::vector;
+
+template <typename FUNC>
+double TimeIt(int iters, FUNC func) {
+  func();
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < iters; i++) func();
+  std::chrono::duration<double, std::milli> d = std::chrono::steady_clock::now() - start;
+  return d.count() / iters;
+}
+
+//every item is visited once, in chunks of at least grain items
+void TestCoverage() {
+  IntraOpThreadPool pool(4, {});
+  for (int n : {1, 7, 100, 1001}) {
+    for (int grain : {1, 10, 300}) {
+      vector<int> visits(n, 0);
+      std::atomic<int> chunks(0);
+      pool.ParallelFor(n, grain, [&](int s, int e) {
+        CHECK(s < e && (e - s >= grain || e == n)) << s << "\t" << e;
+        for (int i = s; i < e; i++) visits[i]++;
+        chunks++;
+      });
+      for (int i = 0; i < n; i++)
+        CHECK(visits[i] == 1) << n << "\t" << grain << "\t" << i;
+      const int threads = std::max(1, std::min(4, n / grain));
+      const int chunk = (n + threads - 1) / threads;
+      CHECK(chunks == (n + chunk - 1) / chunk) << chunks;
+    }
+  }
+  pool.SetActiveThreads(2);
+  std::atomic<int> chunks(0);
+  pool.ParallelFor(1000, 1, [&](int s, int e) { chunks++; });
+  CHECK(chunks == 2) << chunks;
+}
+
+//a loop started from a chunk runs inline,
+//and the loops of several threads share the workers
+void TestNestedAndConcurrent() {
+  IntraOpThreadPool pool(4, {});
+  vector<std::thread> callers;
+  std::atomic<int64_t> sum(0);
+  for (int c = 0; c < 4; c++) {
+    callers.emplace_back([&pool, &sum]() {
+      for (int iter = 0; iter < 200; iter++) {
+        pool.ParallelFor(64, 1, [&pool, &sum](int s, int e) {
+          for (int i = s; i < e; i++) {
+            const std::thread::id outer = std::this_thread::get_id();
+            pool.ParallelFor(16, 1, [&sum, outer](int s2, int e2) {
+              CHECK(std::this_thread::get_id() == outer);
+              for (int j = s2; j < e2; j++) sum += j;
+            });
+          }
+        });
+      }
+    });
+  }
+  for (auto& t : callers) t.join();
+  CHECK(sum == 4*200*64*120) << sum;
+}
+
+//the speedup of the shared pool from one to all the threads
+//on a streaming elementwise kernel and a row gather
+void BenchmarkScaling() {
+  IntraOpThreadPool* pool = IntraOpThreadPool::Global();
+  const int n = 1 << 24;
+  vector<float> a(n, 1.f), b(n, 2.f), c(n);
+  const int rows = 1 << 16, width = 256, table_rows = 1 << 17;
+  vector<float> table((size_t)table_rows*width, 1.f), gathered((size_t)rows*width);
+  vector<int> ids(rows);
+  for (auto& id : ids) id = rand() % table_rows;
+
+  double base_add = 0, base_gather = 0;
+  vector<int> counts;
+  for (int k = 1; k < pool->threads(); k *= 2)
+    counts.push_back(k);
+  counts.push_back(pool->threads());
+  for (int k : counts) {
+    pool->SetActiveThreads(k);
+    double add = TimeIt(10, [&]() {
+      CPUBinaryFunctor<math::Add<float>, float>::Compute(
+          c.data(), n, a.data(), n, b.data(), n, NULL);
+    });
+    double gather = TimeIt(10, [&]() {
+      BatchedDynamicSelectedInputSliceCopy<float>(gathered.data(), width,
+          table.data(), width, ids.data(), rows, width);
+    });
+    if (k == 1) {
+      base_add = add;
+      base_gather = gather;
+    }
+    LOG(INFO) << k << " threads"
+              << "\tAdd: " << add << "ms\t" << 3e-6*n*sizeof(float)/add << "GB/s"
+              << "\tspeedup: " << base_add/add
+              << "\tGather: " << gather << "ms\t"
+              << 2e-6*rows*width*sizeof(float)/gather << "GB/s"
+              << "\tspeedup: " << base_gather/gather;
+  }
+  pool->SetActiveThreads(pool->threads());
+}
+
+int main() {
+  TestCoverage();
+  TestNestedAndConcurrent();
+  LOG(INFO) << "IntraOpThreadPool passed";
+  BenchmarkScaling();
+  return 0;
+}
@@ -38,8 +38,15 @@ __global__ void BatchedDynamicSelectedInputSliceCopyKernel(
   /*if (threadIdx.x < copy_length) {*/
     /*out[out_offset] = inp[inp_offset];*/
   /*}*/
-  int inp_offset = ids[blockIdx.x]*inp_stride;
+  //a negative id gathers a zero row
   int out_offset = blockIdx.x*out_stride;
+  if (ids[blockIdx.x] < 0) {
+    for (int tid = threadIdx.x; tid < copy_length; tid += blockDim.x) {
+      out[out_offset + tid] = 0;
+    }
+    return;
+  }
+  int inp_offset = ids[blockIdx.x]*inp_stride;
   for (int tid = threadIdx.x; tid < copy_length; tid += blockDim.x) {
     out[out_offset + tid] = inp[inp_offset + tid];
   }
@@ -53,6 +60,8 @@ __global__ void BatchedDynamicSelectedOutputSliceCopyKernel(
   /*if (threadIdx.x < copy_length) {*/
     /*out[out_offset] = inp[inp_offset];*/
   /*}*/
+  //a negative id skips the row
+  if (ids[blockIdx.x] < 0) return;
   int inp_offset = blockIdx.x*inp_stride;
   int out_offset = ids[blockIdx.x]*out_stride;
   for (int tid = threadIdx.x; tid < copy_length; tid += blockDim.x) {
@@ -60,6 +69,54 @@ __global__ void BatchedDynamicSelectedOutputSliceCopyKernel(
   }
 }
 
+//several blocks may target the same row,
+//the multi-parent gradients of a dag vertex
+template <typename T>
+__global__ void BatchedDynamicSelectedOutputSliceAccumulateKernel(
+    T *out, int out_stride, const int* ids, const T* inp, int inp_stride, int copy_length) {
+  if (ids[blockIdx.x] < 0) return;
+  int inp_offset = blockIdx.x*inp_stride;
+  int out_offset = ids[blockIdx.x]*out_stride;
+  for (int tid = threadIdx.x; tid < copy_length; tid += blockDim.x) {
+    atomicAdd(out + out_offset + tid, inp[inp_offset + tid]);
+  }
+}
+
+//one block per job, the children of the job are
+//ids[offsets[blockIdx.x]:offsets[blockIdx.x+1]]
+template <typename T>
+__global__ void BatchedSegmentReduceInputSliceKernel(
+    T *out, int out_stride, const T* inp, int inp_stride,
+    const int* offsets, const int* ids, int copy_length, bool mean) {
+  int start = offsets[blockIdx.x];
+  int end = offsets[blockIdx.x+1];
+  T scale = (mean && end - start > 1) ? T(1)/(end - start) : T(1);
+  int out_offset = blockIdx.x*out_stride;
+  for (int tid = threadIdx.x; tid < copy_length; tid += blockDim.x) {
+    T sum = 0;
+    for (int k = start; k < end; k++) {
+      sum += inp[ids[k]*inp_stride + tid];
+    }
+    out[out_offset + tid] = scale*sum;
+  }
+}
+
+template <typename T>
+__global__ void BatchedSegmentReduceOutputSliceAccumulateKernel(
+    T *out, int out_stride, const int* offsets, const int* ids,
+    const T* inp, int inp_stride, int copy_length, bool mean) {
+  int start = offsets[blockIdx.x];
+  int end = offsets[blockIdx.x+1];
+  T scale = (mean && end - start > 1) ? T(1)/(end - start) : T(1);
+  int inp_offset = blockIdx.x*inp_stride;
+  for (int tid = threadIdx.x; tid < copy_length; tid += blockDim.x) {
+    T val = scale*inp[inp_offset + tid];
+    for (int k = start; k < end; k++) {
+      atomicAdd(out + ids[k]*out_stride + tid, val);
+    }
+  }
+}
+
 template <typename T>
 __global__ void BatchedDynamicSelectedAssignZeroKernel(
     T *out, int out_stride, const int* ids, int copy_length) {
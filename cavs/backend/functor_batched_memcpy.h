@@ -0,0 +1,162 @@
+#ifndef CAVS_BACKEND_FUNCTOR_BATCHED_MEMCPY_H_
+#define CAVS_BACKEND_FUNCTOR_BATCHED_MEMCPY_H_
+
+#include "cavs/backend/cpu_common.h"
+
+#include <string.h>
+#include <algorithm>
+
+//host counterparts of functor_batched_memcpy.cuh,
+//one row per index instead of one block per index
+namespace backend {
+
+//rows are gathered from scattered addresses,
+//so we prefetch a few rows ahead of the copy
+const int ROW_PREFETCH_DISTANCE = 4;
+
+inline int RowGrain(int copy_length) {
+  return std::max(1, CPU_MIN_PARALLEL_WORK / std::max(copy_length, 1));
+}
+
+//the number of ids from i on that follow each other,
+//such rows are adjacent on both sides when the rows are dense
+inline int ContiguousRun(const int* ids, int i, int end) {
+  int j = i+1;
+  while (j < end && ids[j] == ids[j-1]+1)
+    j++;
+  return j - i;
+}
+
+//a negative id gathers a zero row,
+//a run of consecutive ids is copied as one block
+template <typename T>
+void BatchedDynamicSelectedInputSliceCopy(
+    T *out, int out_stride, const T* inp, int inp_stride, const int* ids, int n, int copy_length) {
+  const bool dense = (out_stride == copy_length && inp_stride == copy_length);
+  ParallelFor(n, RowGrain(copy_length), [=](int start, int end) {
+    for (int i = start; i < end; ) {
+      int run = (dense && ids[i] >= 0) ? ContiguousRun(ids, i, end) : 1;
+      if (run > 1) {
+        memcpy(out + i*out_stride, inp + ids[i]*inp_stride, run*copy_length*sizeof(T));
+        i += run;
+        continue;
+      }
+      if (i + ROW_PREFETCH_DISTANCE < end && ids[i+ROW_PREFETCH_DISTANCE] >= 0)
+        __builtin_prefetch(inp + ids[i+ROW_PREFETCH_DISTANCE]*inp_stride, 0, 0);
+      if (ids[i] >= 0)
+        memcpy(out + i*out_stride, inp + ids[i]*inp_stride, copy_length*sizeof(T));
+      else
+        std::fill(out + i*out_stride, out + i*out_stride + copy_length, T(0));
+      i++;
+    }
+  });
+}
+
+//a negative id skips the row,
+//a run of consecutive ids is copied as one block
+template <typename T>
+void BatchedDynamicSelectedOutputSliceCopy(
+    T *out, int out_stride, const int* ids, const T* inp, int inp_stride, int n, int copy_length) {
+  const bool dense = (out_stride == copy_length && inp_stride == copy_length);
+  ParallelFor(n, RowGrain(copy_length), [=](int start, int end) {
+    for (int i = start; i < end; ) {
+      int run = (dense && ids[i] >= 0) ? ContiguousRun(ids, i, end) : 1;
+      if (run > 1) {
+        memcpy(out + ids[i]*out_stride, inp + i*inp_stride, run*copy_length*sizeof(T));
+        i += run;
+        continue;
+      }
+      if (i + ROW_PREFETCH_DISTANCE < end && ids[i+ROW_PREFETCH_DISTANCE] >= 0)
+        __builtin_prefetch(out + ids[i+ROW_PREFETCH_DISTANCE]*out_stride, 1, 0);
+      if (ids[i] >= 0)
+        memcpy(out + ids[i]*out_stride, inp + i*inp_stride, copy_length*sizeof(T));
+      i++;
+    }
+  });
+}
+
+//out[ids[i]] += inp[i], several rows may target the same id.
+//the columns are split among the threads instead of the rows,
+//so that no two threads ever update the same element
+template <typename T>
+void BatchedDynamicSelectedOutputSliceAccumulate(
+    T *out, int out_stride, const int* ids, const T* inp, int inp_stride, int n, int copy_length) {
+  const int COLUMN_ALIGNMENT = 16;
+  int grain = std::max(COLUMN_ALIGNMENT, CPU_MIN_PARALLEL_WORK / std::max(n, 1));
+  grain = (grain + COLUMN_ALIGNMENT - 1) / COLUMN_ALIGNMENT * COLUMN_ALIGNMENT;
+  ParallelFor(copy_length, grain, [=](int start, int end) {
+    for (int i = 0; i < n; i++) {
+      if (ids[i] < 0) continue;
+      T* o = out + ids[i]*out_stride;
+      const T* in = inp + i*inp_stride;
+      for (int j = start; j < end; j++)
+        o[j] += in[j];
+    }
+  });
+}
+
+//out[i] = scale_i * sum(inp[ids[offsets[i]:offsets[i+1]]]),
+//scale_i is 1 or 1/count when mean is set, a row without ids is zero
+template <typename T>
+void BatchedSegmentReduceInputSlice(
+    T *out, int out_stride, const T* inp, int inp_stride,
+    const int* offsets, const int* ids, int n, int copy_length, bool mean) {
+  ParallelFor(n, RowGrain(copy_length), [=](int start, int end) {
+    for (int i = start; i < end; i++) {
+      T* o = out + i*out_stride;
+      std::fill(o, o + copy_length, T(0));
+      for (int k = offsets[i]; k < offsets[i+1]; k++) {
+        if (k + 1 < offsets[i+1])
+          __builtin_prefetch(inp + ids[k+1]*inp_stride, 0, 0);
+        const T* in = inp + ids[k]*inp_stride;
+        for (int j = 0; j < copy_length; j++)
+          o[j] += in[j];
+      }
+      int count = offsets[i+1] - offsets[i];
+      if (mean && count > 1) {
+        T scale = T(1)/count;
+        for (int j = 0; j < copy_length; j++)
+          o[j] *= scale;
+      }
+    }
+  });
+}
+
+//the gradient of BatchedSegmentReduceInputSlice:
+//out[ids[k]] += scale_i * inp[i] for every k of the i-th segment.
+//the columns are split among the threads as in the accumulation above
+template <typename T>
+void BatchedSegmentReduceOutputSliceAccumulate(
+    T *out, int out_stride, const int* offsets, const int* ids,
+    const T* inp, int inp_stride, int n, int copy_length, bool mean) {
+  const int COLUMN_ALIGNMENT = 16;
+  int grain = std::max(COLUMN_ALIGNMENT, CPU_MIN_PARALLEL_WORK / std::max(offsets[n], 1));
+  grain = (grain + COLUMN_ALIGNMENT - 1) / COLUMN_ALIGNMENT * COLUMN_ALIGNMENT;
+  ParallelFor(copy_length, grain, [=](int start, int end) {
+    for (int i = 0; i < n; i++) {
+      int count = offsets[i+1] - offsets[i];
+      T scale = (mean && count > 1) ? T(1)/count : T(1);
+      const T* in = inp + i*inp_stride;
+      for (int k = offsets[i]; k < offsets[i+1]; k++) {
+        T* o = out + ids[k]*out_stride;
+        for (int j = start; j < end; j++)
+          o[j] += scale*in[j];
+      }
+    }
+  });
+}
+
+//same as the cuda version, the first n rows are cleared
+template <typename T>
+void BatchedDynamicSelectedAssignZero(
+    T *out, int out_stride, int n, int copy_length) {
+  ParallelFor(n, RowGrain(copy_length), [=](int start, int end) {
+    for (int i = start; i < end; i++) {
+      std::fill(out + i*out_stride, out + i*out_stride + copy_length, T(0));
+    }
+  });
+}
+
+} //namespace backend
+
+#endif
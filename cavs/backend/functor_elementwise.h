@@ -3,6 +3,8 @@
 
 #include "cavs/util/macros.h"
 
+#include <math.h>
+
 namespace backend {
 
 namespace math {
@@ -0,0 +1,60 @@
+#ifndef CAVS_BACKEND_FUNCTOR_ROW_SPARSE_CUH_
+#define CAVS_BACKEND_FUNCTOR_ROW_SPARSE_CUH_
+
+#include "cavs/backend/cuda_common.h"
+#include "cavs/midend/row_sparse_index.h"
+#include "cavs/util/macros_gpu.h"
+
+//the kernels over the rows of a RowSparseIndex run one block per listed row,
+//the grid is sized by the bound of the index and the blocks beyond the count exit
+
+namespace backend {
+
+//lists the row unless it is listed, called by one thread per write
+__device__ inline void ListRow(int row, int* ids, int* count, int* listed) {
+  if (atomicExch(&listed[row], 1) == 0)
+    ids[atomicAdd(count, 1)] = row;
+}
+
+inline int RowSparseThreads(int width) {
+  return (width < THREADS_PER_BLOCK) ? width : THREADS_PER_BLOCK;
+}
+
+//out[row] += inp[row] for the rows listed by inp, which out then lists
+template <typename T>
+__global__ void RowSparseAccumulateKernel(T* out, const T* inp, int width,
+    const int* inp_ids, const int* inp_count,
+    int* out_ids, int* out_count, int* out_listed) {
+  if (blockIdx.x >= *inp_count) return;
+  const int row = inp_ids[blockIdx.x];
+  if (threadIdx.x == 0)
+    ListRow(row, out_ids, out_count, out_listed);
+  for (int i = threadIdx.x; i < width; i += blockDim.x)
+    out[row*width + i] += inp[row*width + i];
+}
+
+//*sum += the squares of the listed rows
+template <typename T>
+__global__ void RowSparseSquaredSumKernel(T* sum, const T* inp, int width,
+    const int* ids, const int* count) {
+  if (blockIdx.x >= *count) return;
+  const int row = ids[blockIdx.x];
+  T partial = 0;
+  for (int i = threadIdx.x; i < width; i += blockDim.x)
+    partial += inp[row*width + i]*inp[row*width + i];
+  atomicAdd(sum, partial);
+}
+
+//out[row] = inp[row]*scale for the listed rows
+template <typename T>
+__global__ void RowSparseScaleKernel(T* out, const T* inp, T scale, int width,
+    const int* ids, const int* count) {
+  if (blockIdx.x >= *count) return;
+  const int row = ids[blockIdx.x];
+  for (int i = threadIdx.x; i < width; i += blockDim.x)
+    out[row*width + i] = inp[row*width + i]*scale;
+}
+
+} //namespace backend
+
+#endif
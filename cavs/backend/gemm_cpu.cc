@@ -0,0 +1,257 @@
+#include "cavs/backend/gemm_cpu.h"
+#include "cavs/backend/cpu_common.h"
+#include "cavs/backend/cpu_simd.h"
+#include "cavs/util/logging.h"
+
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+using std::vector;
+
+namespace backend {
+
+//the blocking follows the usual goto/blis scheme:
+//a KC*NC panel of op(B) and an MC*KC block of op(A) are packed
+//into MR/NR wide slivers, and an MR*NR register tile of C
+//is accumulated by the micro kernel.
+namespace {
+
+#ifdef CAVS_CPU_SIMD
+const int NR = 2*simd::WIDTH;
+#else
+const int NR = 8;
+#endif
+const int MR = 6;
+const int KC = 256;
+const int MC = 16*MR;
+const int NC = 64*NR;
+//below this many rows of C, packing costs more than it saves
+const int SMALL_M = 4;
+
+struct MatView {
+  const float* p;
+  int ld;
+  bool trans;
+  //element (r, c) of op(X)
+  FORCE_INLINE float operator()(int r, int c) const {
+    return trans ? p[c*ld + r] : p[r*ld + c];
+  }
+};
+
+//op(A)[ic:ic+mc, pc:pc+kc] -> slivers of MR rows, k-major inside a sliver
+void PackA(const MatView& A, int ic, int pc, int mc, int kc, float* dst) {
+  for (int s = 0; s < mc; s += MR) {
+    int rows = std::min(MR, mc - s);
+    for (int k = 0; k < kc; k++) {
+      int i = 0;
+      for (; i < rows; i++) dst[i] = A(ic+s+i, pc+k);
+      for (; i < MR; i++)   dst[i] = 0.f;
+      dst += MR;
+    }
+  }
+}
+
+//op(B)[pc:pc+kc, jc+s*NR : jc+(s+1)*NR] -> one sliver
+void PackBSliver(const MatView& B, int pc, int jc, int kc, int cols, float* dst) {
+  if (!B.trans && cols == NR) {
+    for (int k = 0; k < kc; k++) {
+      memcpy(dst, B.p + (pc+k)*B.ld + jc, NR*sizeof(float));
+      dst += NR;
+    }
+  }else {
+    for (int k = 0; k < kc; k++) {
+      int j = 0;
+      for (; j < cols; j++) dst[j] = B(pc+k, jc+j);
+      for (; j < NR; j++)   dst[j] = 0.f;
+      dst += NR;
+    }
+  }
+}
+
+//C[0:MR, 0:NR] = alpha*a*b + beta*C, only rows*cols of C are touched
+void MicroKernel(int kc, const float* a, const float* b,
+    float* C, int ldc, int rows, int cols, float alpha, float beta) {
+  float tile[MR*NR];
+#ifdef CAVS_CPU_SIMD
+  using namespace simd;
+  vfloat c0[MR], c1[MR];
+  for (int i = 0; i < MR; i++) { c0[i] = Zero(); c1[i] = Zero(); }
+  for (int k = 0; k < kc; k++) {
+    vfloat b0 = Load(b);
+    vfloat b1 = Load(b+WIDTH);
+    for (int i = 0; i < MR; i++) {
+      vfloat ai = Set1(a[i]);
+      c0[i] = VFma(ai, b0, c0[i]);
+      c1[i] = VFma(ai, b1, c1[i]);
+    }
+    a += MR;
+    b += NR;
+  }
+  if (rows == MR && cols == NR) {
+    vfloat valpha = Set1(alpha);
+    vfloat vbeta = Set1(beta);
+    for (int i = 0; i < MR; i++) {
+      float* c = C + i*ldc;
+      if (beta == 0.f) {
+        Store(c,       VMul(valpha, c0[i]));
+        Store(c+WIDTH, VMul(valpha, c1[i]));
+      }else {
+        Store(c,       VFma(valpha, c0[i], VMul(vbeta, Load(c))));
+        Store(c+WIDTH, VFma(valpha, c1[i], VMul(vbeta, Load(c+WIDTH))));
+      }
+    }
+    return;
+  }
+  for (int i = 0; i < MR; i++) {
+    Store(tile + i*NR,       c0[i]);
+    Store(tile + i*NR+WIDTH, c1[i]);
+  }
+#else
+  std::fill(tile, tile+MR*NR, 0.f);
+  for (int k = 0; k < kc; k++) {
+    for (int i = 0; i < MR; i++) {
+      for (int j = 0; j < NR; j++)
+        tile[i*NR+j] += a[i]*b[j];
+    }
+    a += MR;
+    b += NR;
+  }
+#endif
+  for (int i = 0; i < rows; i++) {
+    for (int j = 0; j < cols; j++) {
+      float& c = C[i*ldc+j];
+      c = (beta == 0.f) ? alpha*tile[i*NR+j] : alpha*tile[i*NR+j] + beta*c;
+    }
+  }
+}
+
+//one or two rows of C (the 1*H . H*4H recurrences) are bandwidth bound,
+//we stream op(B) once instead of packing it
+void SmallMGemm(const MatView& A, const MatView& B,
+    int M, int N, int K, float alpha, float beta, float* C) {
+  vector<float> arow(K);
+  for (int m = 0; m < M; m++) {
+    for (int k = 0; k < K; k++) arow[k] = alpha*A(m, k);
+    const float* a = arow.data();
+    float* c = C + m*N;
+    int grain = std::max(NR, CPU_MIN_PARALLEL_WORK/std::max(K, 1));
+    if (!B.trans) {
+      ParallelFor(N, grain, [=](int s, int e) {
+        for (int j = s; j < e; j++) c[j] = (beta == 0.f) ? 0.f : beta*c[j];
+        for (int k = 0; k < K; k++) {
+          const float* b = B.p + k*B.ld;
+          int j = s;
+#ifdef CAVS_CPU_SIMD
+          simd::vfloat ak = simd::Set1(a[k]);
+          for (; j + simd::WIDTH <= e; j += simd::WIDTH)
+            simd::Store(c+j, simd::VFma(ak, simd::Load(b+j), simd::Load(c+j)));
+#endif
+          for (; j < e; j++) c[j] += a[k]*b[j];
+        }
+      });
+    }else {
+      ParallelFor(N, grain, [=](int s, int e) {
+        for (int j = s; j < e; j++) {
+          const float* b = B.p + j*B.ld;
+          float sum = 0.f;
+          int k = 0;
+#ifdef CAVS_CPU_SIMD
+          simd::vfloat acc = simd::Zero();
+          for (; k + simd::WIDTH <= K; k += simd::WIDTH)
+            acc = simd::VFma(simd::Load(a+k), simd::Load(b+k), acc);
+          sum = simd::VSum(acc);
+#endif
+          for (; k < K; k++) sum += a[k]*b[k];
+          c[j] = (beta == 0.f) ? sum : sum + beta*c[j];
+        }
+      });
+    }
+  }
+}
+
+} //namespace
+
+template <>
+void MatMulMatCpu<float>(
+    const bool TransA, const bool TransB,
+    const int M, const int N, const int K,
+    const float alpha, const float* A, const float* B,
+    const float beta, float* C) {
+  CHECK(M > 0 && N > 0 && K > 0) << M << "\t" << N << "\t" << K;
+  MatView vA = {A, TransA ? M : K, TransA};
+  MatView vB = {B, TransB ? K : N, TransB};
+  if (M < SMALL_M) {
+    SmallMGemm(vA, vB, M, N, K, alpha, beta, C);
+    return;
+  }
+
+  static thread_local vector<float> packed_B;
+  packed_B.resize(KC*NC);
+  const int m_blocks = (M + MC - 1) / MC;
+  for (int jc = 0; jc < N; jc += NC) {
+    const int nc = std::min(NC, N - jc);
+    const int slivers = (nc + NR - 1) / NR;
+    //split the N slivers so that every thread gets a task
+    //even if M fits into one block
+    const int n_chunks = std::min(slivers,
+        std::max(1, (2*CPU_MAX_THREADS() + m_blocks - 1) / m_blocks));
+    const int slivers_per_chunk = (slivers + n_chunks - 1) / n_chunks;
+    for (int pc = 0; pc < K; pc += KC) {
+      const int kc = std::min(KC, K - pc);
+      //beta only applies to the first panel of K
+      const float beta_pc = (pc == 0) ? beta : 1.f;
+      float* pB = packed_B.data();
+      ParallelFor(slivers, std::max(1, CPU_MIN_PARALLEL_WORK/(kc*NR)), [=](int s, int e) {
+        for (int js = s; js < e; js++) {
+          PackBSliver(vB, pc, jc + js*NR, kc, std::min(NR, nc - js*NR), pB + js*kc*NR);
+        }
+      });
+      ParallelFor(m_blocks*n_chunks, 1, [=](int s, int e) {
+        static thread_local vector<float> packed_A;
+        packed_A.resize(MC*KC);
+        int packed_ib = -1;
+        for (int task = s; task < e; task++) {
+          const int ib = task / n_chunks;
+          const int chunk = task % n_chunks;
+          const int ic = ib*MC;
+          const int mc = std::min(MC, M - ic);
+          if (ib != packed_ib) {
+            PackA(vA, ic, pc, mc, kc, packed_A.data());
+            packed_ib = ib;
+          }
+          const int js_end = std::min(slivers, (chunk+1)*slivers_per_chunk);
+          for (int js = chunk*slivers_per_chunk; js < js_end; js++) {
+            const int jr = js*NR;
+            const int cols = std::min(NR, nc - jr);
+            for (int ir = 0; ir < mc; ir += MR) {
+              MicroKernel(kc, packed_A.data() + ir*kc, pB + js*kc*NR,
+                  C + (ic+ir)*N + jc + jr, N,
+                  std::min(MR, mc - ir), cols, alpha, beta_pc);
+            }
+          }
+        }
+      });
+    }
+  }
+}
+
+template <>
+void MatMulMatCpuNaive<float>(
+    const bool TransA, const bool TransB,
+    const int M, const int N, const int K,
+    const float alpha, const float* A, const float* B,
+    const float beta, float* C) {
+  MatView vA = {A, TransA ? M : K, TransA};
+  MatView vB = {B, TransB ? K : N, TransB};
+  for (int i = 0; i < M; i++) {
+    for (int j = 0; j < N; j++) {
+      float sum = 0.f;
+      for (int k = 0; k < K; k++)
+        sum += vA(i, k) * vB(k, j);
+      C[i*N+j] = (beta == 0.f) ? alpha*sum : alpha*sum + beta*C[i*N+j];
+    }
+  }
+}
+
+} //namespace backend
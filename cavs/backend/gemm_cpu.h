@@ -0,0 +1,27 @@
+#ifndef CAVS_BACKEND_GEMM_CPU_H_
+#define CAVS_BACKEND_GEMM_CPU_H_
+
+namespace backend {
+
+//row-major C = alpha*op(A)*op(B) + beta*C,
+//the same interface as MatMulMatCublasWrapper without the handle.
+//op(A) is M*K and op(B) is K*N
+template <typename T>
+void MatMulMatCpu(
+    const bool TransA, const bool TransB,
+    const int M, const int N, const int K,
+    const T alpha, const T* A, const T* B,
+    const T beta, T* C);
+
+//the textbook triple loop, only kept as a reference
+//for the tests and the benchmark
+template <typename T>
+void MatMulMatCpuNaive(
+    const bool TransA, const bool TransB,
+    const int M, const int N, const int K,
+    const T alpha, const T* A, const T* B,
+    const T beta, T* C);
+
+} //namespace backend
+
+#endif
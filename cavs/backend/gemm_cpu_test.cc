@@ -0,0 +1,76 @@
+#include "cavs/backend/gemm_cpu.h"
+#include "cavs/util/logging.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <chrono>
+#include <vector>
+
+using namespace backend;
+using std::vector;
+
+template <typename FUNC>
+double TimeIt(int iters, FUNC func) {
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < iters; i++) func();
+  std::chrono::duration<double, std::milli> d = std::chrono::steady_clock::now() - start;
+  return d.count() / iters;
+}
+
+void Fill(vector<float>* v) {
+  for (auto& f : *v) f = (rand() % 2001 - 1000) / 1000.f;
+}
+
+void Verify(bool TransA, bool TransB, int M, int N, int K, float beta) {
+  vector<float> A(M*K), B(K*N), C(M*N), C_ref(M*N);
+  Fill(&A); Fill(&B); Fill(&C);
+  C_ref = C;
+  MatMulMatCpu<float>(TransA, TransB, M, N, K, 1.5f, A.data(), B.data(), beta, C.data());
+  MatMulMatCpuNaive<float>(TransA, TransB, M, N, K, 1.5f, A.data(), B.data(), beta, C_ref.data());
+  for (int i = 0; i < M*N; i++) {
+    CHECK(fabs(C[i] - C_ref[i]) <= 1e-3f*(1.f + fabs(C_ref[i])))
+      << "TransA: " << TransA << "\tTransB: " << TransB
+      << "\tM: " << M << "\tN: " << N << "\tK: " << K
+      << "\tC[" << i << "]: " << C[i] << "\tC_ref: " << C_ref[i];
+  }
+}
+
+//the shapes of the tree-lstm/topic-model jobs:
+//the recurrent 1*H . H*4H and the output layer B*H . H*V
+void Benchmark(int M, int N, int K) {
+  vector<float> A(M*K), B(K*N), C(M*N);
+  Fill(&A); Fill(&B);
+  int iters = std::max(1, (int)(2e8 / ((double)M*N*K)));
+  double naive = TimeIt(std::max(1, iters/10), [&]() {
+    MatMulMatCpuNaive<float>(false, false, M, N, K, 1.f, A.data(), B.data(), 0.f, C.data());
+  });
+  double packed = TimeIt(iters, [&]() {
+    MatMulMatCpu<float>(false, false, M, N, K, 1.f, A.data(), B.data(), 0.f, C.data());
+  });
+  LOG(INFO) << M << "x" << K << " . " << K << "x" << N
+            << "\tnaive: " << naive << "ms"
+            << "\tpacked: " << packed << "ms"
+            << "\t" << 2e-6*M*N*K/packed << "GFlops"
+            << "\tspeedup: " << naive/packed;
+}
+
+int main() {
+  for (int TransA = 0; TransA < 2; TransA++) {
+    for (int TransB = 0; TransB < 2; TransB++) {
+      Verify(TransA, TransB, 1, 37, 19, 0.f);
+      Verify(TransA, TransB, 3, 64, 300, 1.f);
+      Verify(TransA, TransB, 7, 5, 3, 0.f);
+      Verify(TransA, TransB, 65, 129, 257, 0.f);
+      Verify(TransA, TransB, 100, 1200, 300, 0.5f);
+    }
+  }
+  LOG(INFO) << "Correctness verified";
+
+  for (int H : {150, 300, 512}) {
+    Benchmark(1, 4*H, H);
+    Benchmark(64, 4*H, H);
+  }
+  Benchmark(64, 21701, 300);
+  Benchmark(256, 21701, 300);
+  return 0;
+}
@@ -30,12 +30,15 @@ class GatherOpDecl : public ExtractOpDecl {
     //for the scatter output, the name is arbitary
     //because the output tensor will be reference by(share memory with)
     //the message passer tensor during runtime.
+    //a vertex of a dag is gathered by several parents,
+    //so their gradients are accumulated instead of overwritten
     OpDef scatter;
     OpDefBuilder("Scatter")
       .Input(GetGradientName(op_def_.output(0)))
       .Output("Scatter_Backward_"+std::to_string(GetHash(op_def_)))
       .Device(op_def_)
       .Attr(op_def_)
+      .AttrSingle("Accumulate", true)
       .Finalize(&scatter);
     grad->push_back(scatter);
   }
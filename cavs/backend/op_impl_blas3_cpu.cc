@@ -0,0 +1,58 @@
+#include "cavs/backend/op_impl.h"
+#include "cavs/backend/gemm_cpu.h"
+#include "cavs/proto/tensor_shape.pb.h"
+#include "cavs/util/op_util.h"
+
+namespace backend {
+
+using ::midend::Tensor;
+
+template <typename T>
+class MatMulMatOpCpu : public OpImpl {
+ public:
+  explicit MatMulMatOpCpu(const OpDef& def);
+  void Compute(OpContext* context) override;
+
+ private:
+  bool TransA;
+  bool TransB;
+};
+
+template <typename T>
+MatMulMatOpCpu<T>::MatMulMatOpCpu(const OpDef& def)
+    : OpImpl(def), TransA(false), TransB(false) {
+  for (auto& t : GetListArg<int>(op_def_, "Transpose")) {
+    if (t == 0) TransA = true;
+    if (t == 1) TransB = true;
+  }
+}
+
+template <typename T>
+void MatMulMatOpCpu<T>::Compute(OpContext* context) {
+  const Tensor& A = context->Input(0);
+  const Tensor& B = context->Input(1);
+  Tensor* C = context->Output(0);
+
+  int MA = (TransA == false)? A.dims(0) : A.dims(1);
+  int KA = (TransA == false)? A.dims(1) : A.dims(0);
+  int KB = (TransB == false)? B.dims(0) : B.dims(1);
+  int NB = (TransB == false)? B.dims(1) : B.dims(0);
+  CHECK(KA == KB);
+  CHECK(C->dims(0) == MA)
+    << "C.dims(0): " << C->dims(0)
+    << "\tMA: "      << MA;
+  CHECK(C->dims(1) == NB)
+    << "C.dims(1): " << C->dims(1)
+    << "\tNB: "      << NB;
+
+  MatMulMatCpu<T>(TransA, TransB,
+      MA, NB, KA, 1.f, A.data<T>(), B.data<T>(),
+      0, C->mutable_data<T>());
+  A.DebugNumerical<T>();
+  B.DebugNumerical<T>();
+  C->DebugNumerical<T>();
+}
+
+REGISTER_OP_IMPL_BUILDER(Key("MatMul").Device("CPU"), MatMulMatOpCpu<float>);
+
+} //namespace backend
@@ -3,8 +3,10 @@
 #include "cavs/backend/cublas_wrapper.h"
 #include "cavs/backend/op_impl_elementwise.cuh"
 #include "cavs/backend/functor_elementwise.h"
+#include "cavs/backend/functor_row_sparse.cuh"
 
 #include <algorithm>
+#include <cmath>
 
 namespace backend {
 
@@ -13,14 +15,25 @@ using ::midend::Tensor;
 template <typename T>
 class ClipOpImpl : public OpImpl {
  public:
-  explicit ClipOpImpl(const OpDef& def) : OpImpl(def) {
+  explicit ClipOpImpl(const OpDef& def) : OpImpl(def), sum_buf_(NULL) {
     clip_ = GetSingleArg<float>(def, "clip"); 
     CHECK(clip_ > 0);
   }
+  ~ClipOpImpl() {
+    if (sum_buf_) checkCudaError(cudaFree(sum_buf_));
+  }
   void Compute(OpContext* context) override;
 
  private:
+  //the listed rows of a row-sparse gradient when it is clipped in place
+  static const midend::RowSparseIndex* InPlaceRows(const Tensor& in, const Tensor* out) {
+    const midend::RowSparseIndex* index = in.row_sparse_index();
+    if (index && !index->overflow() && in.data<T>() == out->data<T>())
+      return index;
+    return NULL;
+  }
   float clip_;
+  T* sum_buf_;
 };
 
 template <typename T>
@@ -29,7 +42,20 @@ void ClipOpImpl<T>::Compute(OpContext* context) {
   for (int i = 0; i < context->InputSize(); i++) {
     const Tensor& value = context->Input(i);
     T tmp;
-    Nrm2CublasWrapperHost(value.count(), value.data<T>(), &tmp);
+    if (const midend::RowSparseIndex* index = InPlaceRows(value, context->Output(i))) {
+      if (!sum_buf_)
+        checkCudaError(cudaMalloc((void**)&sum_buf_, sizeof(T)));
+      checkCudaError(cudaMemsetAsync(sum_buf_, 0, sizeof(T), cudaStreamDefault));
+      const int width = value.count()/value.dims(0);
+      if (index->bound() > 0) {
+        RowSparseSquaredSumKernel<T><<<index->bound(), RowSparseThreads(width)>>>(
+            sum_buf_, value.data<T>(), width, index->ids(), index->count());
+      }
+      checkCudaError(cudaMemcpy(&tmp, sum_buf_, sizeof(T), cudaMemcpyDeviceToHost));
+      tmp = std::sqrt(tmp);
+    }else {
+      Nrm2CublasWrapperHost(value.count(), value.data<T>(), &tmp);
+    }
     sum += tmp;
   }
 
@@ -37,10 +63,19 @@ void ClipOpImpl<T>::Compute(OpContext* context) {
   for (int i = 0; i < context->OutputSize(); i++) {
     const Tensor& in = context->Input(i);
     Tensor* out = context->Output(i);
-    CUDABinaryConstScalarFunctor<math::Mul<T>, T>::Compute(
-        out->mutable_data<T>(), out->count(),
-        in.data<T>(), in.count(), 
-        clip_/std::max(sum, clip_), cudaStreamDefault);
+    if (const midend::RowSparseIndex* index = InPlaceRows(in, out)) {
+      const int width = out->count()/out->dims(0);
+      if (index->bound() > 0) {
+        RowSparseScaleKernel<T><<<index->bound(), RowSparseThreads(width)>>>(
+            out->mutable_data<T>(), in.data<T>(), clip_/std::max(sum, clip_),
+            width, index->ids(), index->count());
+      }
+    }else {
+      CUDABinaryConstScalarFunctor<math::Mul<T>, T>::Compute(
+          out->mutable_data<T>(), out->count(),
+          in.data<T>(), in.count(), 
+          clip_/std::max(sum, clip_), cudaStreamDefault);
+    }
     VLOG(V_EXHAUSTIVE_DEBUG) << "clip: " << clip_ << "\tsum: " << sum
                              << "\tscale: " << clip_/std::max(sum, clip_);
     in.DebugNumerical<T>();
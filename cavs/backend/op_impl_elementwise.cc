@@ -0,0 +1,39 @@
+#include "cavs/backend/op_impl_elementwise_cpu.h"
+#include "cavs/backend/op_impl_elementwise_common.h"
+#include "cavs/backend/functor_elementwise.h"
+
+namespace backend {
+
+REGISTER_OP_IMPL_BUILDER(Key("Abs").Device("CPU"),
+    CpuUnaryOpInstance(math::Abs, float));
+REGISTER_OP_IMPL_BUILDER(Key("Neg").Device("CPU"),
+    CpuUnaryOpInstance(math::Neg, float));
+REGISTER_OP_IMPL_BUILDER(Key("Assign").Device("CPU"),
+    CpuUnaryOpInstance(math::Assign, float));
+
+REGISTER_OP_IMPL_BUILDER(Key("Add").Device("CPU"),
+    CpuBinaryOpInstance(math::Add, float));
+REGISTER_OP_IMPL_BUILDER(Key("Sub").Device("CPU"),
+    CpuBinaryOpInstance(math::Sub, float));
+REGISTER_OP_IMPL_BUILDER(Key("Mul").Device("CPU"),
+    CpuBinaryOpInstance(math::Mul, float));
+REGISTER_OP_IMPL_BUILDER(Key("Div").Device("CPU"),
+    CpuBinaryOpInstance(math::Div, float));
+REGISTER_OP_IMPL_BUILDER(Key("Square").Device("CPU"),
+    CpuUnaryOpInstance(math::Square, float));
+REGISTER_OP_IMPL_BUILDER(Key("Scal").Device("CPU"),
+    CpuBinaryOpInstance(math::Mul, float));
+//Fill is the backward operator of reduction operator
+REGISTER_OP_IMPL_BUILDER(Key("Fill").Device("CPU"),
+    CpuUnaryOpInstance(math::Assign, float));
+
+REGISTER_OP_IMPL_BUILDER(Key("Equal").Device("CPU"),
+    CpuBinaryOpInstance(math::Equal, float));
+
+//For partial-add, we have reset the augend tensor to 0 in each iteration
+REGISTER_OP_IMPL_BUILDER(Key("Accumulate").Device("CPU"),
+    CpuAccumulateBinaryOpInstance(math::Add, float));
+REGISTER_OP_IMPL_BUILDER(Key("PartialAccumulate").Device("CPU"),
+    CpuPartialAccumulateBinaryOpInstance(math::Add, float));
+
+} //namespace backend
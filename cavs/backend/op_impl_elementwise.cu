@@ -1,6 +1,7 @@
 #include "cavs/backend/op_impl_elementwise.cuh"
 #include "cavs/backend/op_impl_elementwise_common.h"
 #include "cavs/backend/functor_elementwise.h"
+#include "cavs/backend/functor_row_sparse.cuh"
 
 namespace backend {
 
@@ -30,9 +31,42 @@ REGISTER_OP_IMPL_BUILDER(Key("Fill").Device("GPU"),
 REGISTER_OP_IMPL_BUILDER(Key("Equal").Device("GPU"),
     CudaBinaryOpInstance(math::Equal, float));
 
+//Accumulating a row-sparse gradient only adds its listed rows,
+//which the output lists as well.
+//A dense gradient overflows the index of the output
+template <typename T>
+class RowSparseAccumulateOp : public CudaAccumulateBinaryOpInstance(math::Add, T) {
+  typedef CudaAccumulateBinaryOpInstance(math::Add, T) DenseOp;
+ public:
+  explicit RowSparseAccumulateOp(const OpDef& def) : DenseOp(def) {}
+  void Compute(OpContext* context) override {
+    const Tensor& inp = context->Input(0);
+    Tensor* out = context->Output(0);
+    midend::RowSparseIndex* out_index = out->row_sparse_index();
+    const midend::RowSparseIndex* inp_index = inp.row_sparse_index();
+    if (out_index && !out_index->overflow() &&
+        inp_index && !inp_index->overflow() &&
+        inp.count() == out->count() && inp.dims(0) == out->dims(0)) {
+      if (inp_index->bound() > 0) {
+        const int width = inp.count()/inp.dims(0);
+        RowSparseAccumulateKernel<T><<<inp_index->bound(), RowSparseThreads(width)>>>(
+            out->mutable_data<T>(), inp.data<T>(), width,
+            inp_index->ids(), inp_index->count(),
+            out_index->ids(), out_index->count(), out_index->listed());
+        checkCudaError(cudaGetLastError());
+        out_index->AddToBound(inp_index->bound());
+      }
+      return;
+    }
+    if (out_index)
+      out_index->SetOverflow();
+    DenseOp::Compute(context);
+  }
+};
+
 //For partial-add, we have reset the augend tensor to 0 in each iteration
 REGISTER_OP_IMPL_BUILDER(Key("Accumulate").Device("GPU"),
-    CudaAccumulateBinaryOpInstance(math::Add, float));
+    RowSparseAccumulateOp<float>);
 REGISTER_OP_IMPL_BUILDER(Key("PartialAccumulate").Device("GPU"),
     CudaPartialAccumulateBinaryOpInstance(math::Add, float));
 
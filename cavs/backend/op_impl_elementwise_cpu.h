@@ -0,0 +1,270 @@
+#ifndef CAVS_BACKEND_OP_IMPL_ELEMENTWISE_CPU_H_
+#define CAVS_BACKEND_OP_IMPL_ELEMENTWISE_CPU_H_
+
+#include "cavs/backend/cpu_common.h"
+#include "cavs/backend/cpu_simd.h"
+#include "cavs/backend/functor_elementwise.h"
+#include "cavs/util/logging.h"
+#include "cavs/util/macros.h"
+#include "cavs/util/macros_gpu.h"
+
+#include <type_traits>
+
+//host counterparts of the functors in op_impl_elementwise.cuh.
+//they keep the same Compute signatures (the stream is ignored)
+//so that UnaryOp/BinaryOp can be instantiated with them directly.
+namespace backend {
+
+namespace simd {
+
+template <typename OP>
+struct VecOp {
+  static const bool value = false;
+};
+
+#ifdef CAVS_CPU_SIMD
+#define VEC_UNARY_OP(math_op, expr)                               \
+  template <> struct VecOp<math::math_op<float>> {                \
+    static const bool value = true;                               \
+    FORCE_INLINE static vfloat Compute(vfloat a) { return expr; } \
+  };
+#define VEC_BINARY_OP(math_op, expr)                                        \
+  template <> struct VecOp<math::math_op<float>> {                          \
+    static const bool value = true;                                         \
+    FORCE_INLINE static vfloat Compute(vfloat a, vfloat b) { return expr; } \
+  };
+
+VEC_UNARY_OP(Abs,    VAbs(a))
+VEC_UNARY_OP(Neg,    VSub(Set1(0.f), a))
+VEC_UNARY_OP(Square, VMul(a, a))
+VEC_UNARY_OP(Assign, a)
+VEC_BINARY_OP(Add,   VAdd(a, b))
+VEC_BINARY_OP(Sub,   VSub(a, b))
+VEC_BINARY_OP(Mul,   VMul(a, b))
+VEC_BINARY_OP(Div,   VDiv(a, b))
+VEC_BINARY_OP(Max,   VMax(a, b))
+VEC_BINARY_OP(Min,   VMin(a, b))
+
+#undef VEC_UNARY_OP
+#undef VEC_BINARY_OP
+#endif
+
+//Equal and Cast change the element type, they stay scalar
+template <typename OP, typename T, typename U>
+struct Vectorizable {
+  static const bool value = VecOp<OP>::value &&
+      std::is_same<T, float>::value && std::is_same<U, float>::value;
+};
+
+template <typename OP, typename T, typename U,
+          bool VEC = Vectorizable<OP, T, U>::value>
+struct Loop {
+  static void Unary(T* out, const U* inp, size_t n) {
+    for (size_t i = 0; i < n; i++) out[i] = OP::Compute(inp[i]);
+  }
+  static void UnaryScalar(T* out, const U value, size_t n) {
+    for (size_t i = 0; i < n; i++) out[i] = OP::Compute(value);
+  }
+  //out += OP(inp)
+  static void UnaryAccumulate(T* out, const U* inp, size_t n) {
+    for (size_t i = 0; i < n; i++) out[i] += OP::Compute(inp[i]);
+  }
+  static void Binary(T* out, const U* inp0, const U* inp1, size_t n) {
+    for (size_t i = 0; i < n; i++) out[i] = OP::Compute(inp0[i], inp1[i]);
+  }
+  static void BinaryScalar(T* out, const U* inp0, const U inp1, size_t n) {
+    for (size_t i = 0; i < n; i++) out[i] = OP::Compute(inp0[i], inp1);
+  }
+  static void ScalarBinary(T* out, const U inp0, const U* inp1, size_t n) {
+    for (size_t i = 0; i < n; i++) out[i] = OP::Compute(inp0, inp1[i]);
+  }
+};
+
+#ifdef CAVS_CPU_SIMD
+template <typename OP>
+struct Loop<OP, float, float, true> {
+  typedef Loop<OP, float, float, false> Tail;
+  static void Unary(float* out, const float* inp, size_t n) {
+    size_t i = 0;
+    for (; i + WIDTH <= n; i += WIDTH)
+      Store(out+i, VecOp<OP>::Compute(Load(inp+i)));
+    Tail::Unary(out+i, inp+i, n-i);
+  }
+  static void UnaryScalar(float* out, const float value, size_t n) {
+    size_t i = 0;
+    vfloat v = VecOp<OP>::Compute(Set1(value));
+    for (; i + WIDTH <= n; i += WIDTH)
+      Store(out+i, v);
+    Tail::UnaryScalar(out+i, value, n-i);
+  }
+  static void UnaryAccumulate(float* out, const float* inp, size_t n) {
+    size_t i = 0;
+    for (; i + WIDTH <= n; i += WIDTH)
+      Store(out+i, VAdd(Load(out+i), VecOp<OP>::Compute(Load(inp+i))));
+    Tail::UnaryAccumulate(out+i, inp+i, n-i);
+  }
+  static void Binary(float* out, const float* inp0, const float* inp1, size_t n) {
+    size_t i = 0;
+    for (; i + WIDTH <= n; i += WIDTH)
+      Store(out+i, VecOp<OP>::Compute(Load(inp0+i), Load(inp1+i)));
+    Tail::Binary(out+i, inp0+i, inp1+i, n-i);
+  }
+  static void BinaryScalar(float* out, const float* inp0, const float inp1, size_t n) {
+    size_t i = 0;
+    vfloat v1 = Set1(inp1);
+    for (; i + WIDTH <= n; i += WIDTH)
+      Store(out+i, VecOp<OP>::Compute(Load(inp0+i), v1));
+    Tail::BinaryScalar(out+i, inp0+i, inp1, n-i);
+  }
+  static void ScalarBinary(float* out, const float inp0, const float* inp1, size_t n) {
+    size_t i = 0;
+    vfloat v0 = Set1(inp0);
+    for (; i + WIDTH <= n; i += WIDTH)
+      Store(out+i, VecOp<OP>::Compute(v0, Load(inp1+i)));
+    Tail::ScalarBinary(out+i, inp0, inp1+i, n-i);
+  }
+};
+#endif
+
+} //namespace simd
+
+template <typename OP, typename T, typename U=T>
+struct CPUUnaryFunctor {
+  static void Compute(T* out, size_t n_out, const U* inp, size_t n_inp, cudaStream_t) {
+    typedef simd::Loop<OP, T, U> L;
+    if (n_out == n_inp) {
+      ParallelFor(n_out, CPU_MIN_PARALLEL_WORK, [=](int s, int e) {
+        L::Unary(out+s, inp+s, e-s);
+      });
+    }else if (n_inp == 1) {
+      const U value = *inp;
+      ParallelFor(n_out, CPU_MIN_PARALLEL_WORK, [=](int s, int e) {
+        L::UnaryScalar(out+s, value, e-s);
+      });
+    }else if (n_inp > n_out && n_inp % n_out == 0) {
+      //the backward of broadcasting binary operators
+      size_t dim0 = n_inp/n_out;
+      ParallelFor(n_out, CPU_MIN_PARALLEL_WORK/dim0, [=](int s, int e) {
+        std::fill(out+s, out+e, T(0));
+        for (size_t j = 0; j < dim0; j++)
+          L::UnaryAccumulate(out+s, inp+j*n_out+s, e-s);
+      });
+    }else {
+      LOG(FATAL) << "Unrecognized Pattern:";
+    }
+  }
+};
+
+template <typename OP, typename T, typename U=T>
+struct CPUUnaryConstScalarFunctor {
+  static void Compute(T* out, const U value, size_t n, cudaStream_t) {
+    ParallelFor(n, CPU_MIN_PARALLEL_WORK, [=](int s, int e) {
+      simd::Loop<OP, T, U>::UnaryScalar(out+s, value, e-s);
+    });
+  }
+};
+
+//out = OP(out, inp), folded over the broadcast dimension
+template <typename OP, typename T, typename U=T>
+struct CPUUnaryStatefulFunctor {
+  static void Compute(T* out, size_t n_out, const U* inp, size_t n_inp, cudaStream_t) {
+    typedef simd::Loop<OP, T, U> L;
+    if (n_out == n_inp) {
+      ParallelFor(n_out, CPU_MIN_PARALLEL_WORK, [=](int s, int e) {
+        L::Binary(out+s, out+s, inp+s, e-s);
+      });
+    }else if (n_out < n_inp && n_inp % n_out == 0) {
+      size_t dim0 = n_inp/n_out;
+      ParallelFor(n_out, CPU_MIN_PARALLEL_WORK/dim0, [=](int s, int e) {
+        for (size_t j = 0; j < dim0; j++)
+          L::Binary(out+s, out+s, inp+j*n_out+s, e-s);
+      });
+    }else {
+      LOG(FATAL) << "Unrecognized Pattern:";
+    }
+  }
+};
+
+template <typename OP, typename T, typename U=T>
+struct CPUBinaryFunctor {
+  static void Compute(T* out, size_t n_out,
+      const U* inp0, size_t n_inp0, const U* inp1, size_t n_inp1, cudaStream_t) {
+    typedef simd::Loop<OP, T, U> L;
+    if (n_out == n_inp0 && n_inp0 == n_inp1) {
+      ParallelFor(n_out, CPU_MIN_PARALLEL_WORK, [=](int s, int e) {
+        L::Binary(out+s, inp0+s, inp1+s, e-s);
+      });
+    }else if (n_inp1 == 1 && n_out == n_inp0) {
+      const U value = *inp1;
+      ParallelFor(n_out, CPU_MIN_PARALLEL_WORK, [=](int s, int e) {
+        L::BinaryScalar(out+s, inp0+s, value, e-s);
+      });
+    }else if (n_inp0 == 1 && n_out == n_inp1) {
+      const U value = *inp0;
+      ParallelFor(n_out, CPU_MIN_PARALLEL_WORK, [=](int s, int e) {
+        L::ScalarBinary(out+s, value, inp1+s, e-s);
+      });
+    }else if (n_out == n_inp0) {
+      //inp1 is broadcast along the first dimension
+      CHECK(n_out > n_inp1 && n_out % n_inp1 == 0) << n_out << "\t" << n_inp1;
+      size_t stride = n_inp1;
+      ParallelFor(n_out/stride, CPU_MIN_PARALLEL_WORK/stride, [=](int s, int e) {
+        for (size_t r = s; r < e; r++)
+          L::Binary(out+r*stride, inp0+r*stride, inp1, stride);
+      });
+    }else if (n_out == n_inp1) {
+      CHECK(n_out > n_inp0 && n_out % n_inp0 == 0) << n_out << "\t" << n_inp0;
+      size_t stride = n_inp0;
+      ParallelFor(n_out/stride, CPU_MIN_PARALLEL_WORK/stride, [=](int s, int e) {
+        for (size_t r = s; r < e; r++)
+          L::Binary(out+r*stride, inp0, inp1+r*stride, stride);
+      });
+    }else {
+      LOG(FATAL) << "Unrecognized Pattern:\t"
+                 << n_out << "\t" << n_inp0 << "\t" << n_inp1;
+    }
+  }
+};
+
+template <typename OP, typename T, typename U=T>
+struct CPUBinaryConstScalarFunctor {
+  static void Compute(T* out, size_t n_out, const U* inp0, size_t n_inp0,
+      const U inp1, cudaStream_t) {
+    CHECK(n_out == n_inp0);
+    ParallelFor(n_out, CPU_MIN_PARALLEL_WORK, [=](int s, int e) {
+      simd::Loop<OP, T, U>::BinaryScalar(out+s, inp0+s, inp1, e-s);
+    });
+  }
+};
+
+template <typename OP, typename T, typename U=T>
+struct CPUBinaryStridedFunctor {
+  static void Compute(T* out, size_t stride_out,
+      const U* inp0, size_t stride_inp0,
+      const U* inp1, size_t stride_inp1,
+      int num_blocks, int workload_of_one_block, cudaStream_t) {
+    CHECK(num_blocks > 0);
+    int grain = CPU_MIN_PARALLEL_WORK/std::max(workload_of_one_block, 1);
+    ParallelFor(num_blocks, grain, [=](int s, int e) {
+      for (int b = s; b < e; b++) {
+        simd::Loop<OP, T, U>::Binary(out+b*stride_out,
+            inp0+b*stride_inp0, inp1+b*stride_inp1, workload_of_one_block);
+      }
+    });
+  }
+};
+
+#define CpuUnaryOpInstance(math, dtype)    \
+    UnaryOp<CPUUnaryFunctor<math<dtype>, dtype>, dtype>
+#define CpuUnaryConstScalarOpInstance(math, dtype)    \
+    UnaryOp<CPUUnaryConstScalarFunctor<math<dtype>, dtype>, dtype>
+#define CpuBinaryOpInstance(math, dtype)   \
+    BinaryOp<CPUBinaryFunctor<math<dtype>, dtype>, dtype>
+#define CpuAccumulateBinaryOpInstance(math, dtype)    \
+    UnaryOp<CPUUnaryStatefulFunctor<math<dtype>, dtype>, dtype>
+#define CpuPartialAccumulateBinaryOpInstance(math, dtype)    \
+    PartialAccumulateBinaryOp<CPUBinaryStridedFunctor<math<dtype>, dtype>, CPUBinaryFunctor<math<dtype>, dtype>, dtype>
+
+} //namespace backend
+
+#endif
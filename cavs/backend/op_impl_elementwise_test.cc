@@ -1,7 +1,12 @@
 #include "cavs/midend/op_test.h"
+#include "cavs/midend/op_context.h"
 #include "cavs/util/logging.h"
 #include "cavs/util/op_def_builder.h"
 
+#include <cmath>
+#include <cstring>
+#include <functional>
+
 using namespace midend;
 using namespace backend;
 using namespace midend::test;
@@ -11,7 +16,161 @@ class AddOptest : public OpTest {
   AddOptest(const OpDef& def) : OpTest(def) {}
 };
 
+//the sizes cover the tails of every vector width and a split loop
+const vector<int> kSizes = {1, 3, 7, 8, 15, 16, 17, 33, 100003};
+
+vector<float> Values(int n, float scale, float shift) {
+  vector<float> v(n);
+  for (int i = 0; i < n; i++)
+    v[i] = (i % 11)*scale + shift;
+  return v;
+}
+
+//runs the CPU implementation of def on the inputs,
+//out is the initial value of the output and gets the result
+void RunCpu(const OpDef& def, const vector<vector<float>>& inputs,
+    vector<float>* out) {
+  Allocator* alloc = GetAllocator(def);
+  vector<Tensor> tensors;
+  for (int i = 0; i < inputs.size(); i++) {
+    tensors.emplace_back("test:x" + std::to_string(i), alloc, DT_FLOAT,
+        TensorShape(vector<int>{(int)inputs[i].size()}));
+  }
+  Tensor output("test:y", alloc, DT_FLOAT, TensorShape(vector<int>{(int)out->size()}));
+  OpContext ctxt;
+  for (int i = 0; i < inputs.size(); i++) {
+    memcpy(tensors[i].mutable_data<float>(), inputs[i].data(), inputs[i].size()*sizeof(float));
+    ctxt.AppendInput(&tensors[i]);
+  }
+  memcpy(output.mutable_data<float>(), out->data(), out->size()*sizeof(float));
+  ctxt.AppendOutput(&output);
+  std::unique_ptr<OpImpl> op(CreateOp(def));
+  op->Compute(&ctxt);
+  memcpy(out->data(), output.data<float>(), out->size()*sizeof(float));
+}
+
+OpDef CpuDef(const string& name, int inputs) {
+  OpDefBuilder builder(name);
+  for (int i = 0; i < inputs; i++)
+    builder.Input("x" + std::to_string(i));
+  OpDef def;
+  builder.Output("y").Device("CPU").Finalize(&def);
+  return def;
+}
+
+void Expect(const string& what, const vector<float>& out, const vector<float>& ref) {
+  CHECK(out.size() == ref.size());
+  for (int i = 0; i < out.size(); i++) {
+    CHECK(std::fabs(out[i] - ref[i]) <= 1e-5f*std::max(1.f, std::fabs(ref[i])))
+        << what << "[" << i << "]: " << out[i] << " vs " << ref[i];
+  }
+}
+
+//plain, scalar input, and the reduction over the broadcast dimension
+void TestUnary(const string& name, std::function<float(float)> f) {
+  for (int n : kSizes) {
+    vector<float> x = Values(n, 0.5f, -2.f);
+    vector<float> out(n, 0.f), ref(n);
+    RunCpu(CpuDef(name, 1), {x}, &out);
+    for (int i = 0; i < n; i++) ref[i] = f(x[i]);
+    Expect(name + " " + std::to_string(n), out, ref);
+
+    std::fill(out.begin(), out.end(), 0.f);
+    RunCpu(CpuDef(name, 1), {{-1.5f}}, &out);
+    std::fill(ref.begin(), ref.end(), f(-1.5f));
+    Expect(name + " scalar " + std::to_string(n), out, ref);
+
+    const int dim0 = 3;
+    vector<float> big = Values(dim0*n, 0.25f, -1.1f);
+    RunCpu(CpuDef(name, 1), {big}, &out);
+    for (int i = 0; i < n; i++) {
+      ref[i] = 0;
+      for (int j = 0; j < dim0; j++) ref[i] += f(big[j*n+i]);
+    }
+    Expect(name + " reduced " + std::to_string(n), out, ref);
+  }
+}
+
+//plain, either input a scalar, and either input broadcast along the rows
+void TestBinary(const string& name, std::function<float(float, float)> f) {
+  for (int n : kSizes) {
+    vector<float> a = Values(n, 0.5f, -2.25f);
+    vector<float> b = Values(n, 0.75f, 1.f);
+    b[n/2] = a[n/2];
+    vector<float> out(n, 0.f), ref(n);
+    RunCpu(CpuDef(name, 2), {a, b}, &out);
+    for (int i = 0; i < n; i++) ref[i] = f(a[i], b[i]);
+    Expect(name + " " + std::to_string(n), out, ref);
+
+    RunCpu(CpuDef(name, 2), {a, {3.f}}, &out);
+    for (int i = 0; i < n; i++) ref[i] = f(a[i], 3.f);
+    Expect(name + " rhs scalar " + std::to_string(n), out, ref);
+
+    RunCpu(CpuDef(name, 2), {{3.f}, b}, &out);
+    for (int i = 0; i < n; i++) ref[i] = f(3.f, b[i]);
+    Expect(name + " lhs scalar " + std::to_string(n), out, ref);
+
+    if (n == 1) continue;
+    const int rows = 5;
+    vector<float> big = Values(rows*n, 0.25f, -1.1f);
+    vector<float> out_big(rows*n, 0.f), ref_big(rows*n);
+    RunCpu(CpuDef(name, 2), {big, b}, &out_big);
+    for (int i = 0; i < rows*n; i++) ref_big[i] = f(big[i], b[i%n]);
+    Expect(name + " rhs broadcast " + std::to_string(n), out_big, ref_big);
+
+    RunCpu(CpuDef(name, 2), {b, big}, &out_big);
+    for (int i = 0; i < rows*n; i++) ref_big[i] = f(b[i%n], big[i]);
+    Expect(name + " lhs broadcast " + std::to_string(n), out_big, ref_big);
+  }
+}
+
+void TestAccumulate() {
+  for (int n : kSizes) {
+    vector<float> x = Values(n, 0.5f, -2.f);
+    vector<float> out = Values(n, 0.125f, 1.f), ref(n);
+    for (int i = 0; i < n; i++) ref[i] = out[i] + x[i];
+    RunCpu(CpuDef("Accumulate", 1), {x}, &out);
+    Expect("Accumulate " + std::to_string(n), out, ref);
+
+    const int dim0 = 3;
+    vector<float> big = Values(dim0*n, 0.25f, -1.1f);
+    for (int i = 0; i < n; i++) {
+      for (int j = 0; j < dim0; j++) ref[i] += big[j*n+i];
+    }
+    RunCpu(CpuDef("Accumulate", 1), {big}, &out);
+    Expect("Accumulate folded " + std::to_string(n), out, ref);
+
+    //a slice of a tensor of 3*n
+    OpDef def;
+    OpDefBuilder("PartialAccumulate").Input("x0").Output("y")
+      .AttrSingle<int>("Offset", n).AttrSingle<int>("Stride", n)
+      .Device("CPU").Finalize(&def);
+    vector<float> whole = Values(3*n, 0.5f, 0.f), ref_whole = whole;
+    for (int i = 0; i < n; i++) ref_whole[n+i] += x[i];
+    RunCpu(def, {x}, &whole);
+    Expect("PartialAccumulate " + std::to_string(n), whole, ref_whole);
+  }
+}
+
+void TestCpuElementwise() {
+  TestUnary("Abs",    [](float a) { return std::fabs(a); });
+  TestUnary("Neg",    [](float a) { return -a; });
+  TestUnary("Assign", [](float a) { return a; });
+  TestUnary("Fill",   [](float a) { return a; });
+  TestUnary("Square", [](float a) { return a*a; });
+  TestBinary("Add",   [](float a, float b) { return a+b; });
+  TestBinary("Sub",   [](float a, float b) { return a-b; });
+  TestBinary("Mul",   [](float a, float b) { return a*b; });
+  TestBinary("Scal",  [](float a, float b) { return a*b; });
+  TestBinary("Div",   [](float a, float b) { return a/b; });
+  TestBinary("Equal", [](float a, float b) { return (a == b) ? 1.f : 0.f; });
+  TestAccumulate();
+  LOG(INFO) << "CPU elementwise operators passed";
+}
+
 int main() {
+  TestCpuElementwise();
+
   OpDef op_def;
   auto shape = {2, 3};
   OpDefBuilder("Add").Input("A").Input("B").Output("C")
@@ -1,6 +1,7 @@
 #include "cavs/backend/op_impl.h"
 #include "cavs/backend/cuda_common.h"
 #include "cavs/backend/cublas_wrapper.h"
+#include "cavs/backend/functor_row_sparse.cuh"
 #include "cavs/proto/tensor_shape.pb.h"
 #include "cavs/util/macros_gpu.h"
 
@@ -87,12 +88,16 @@ class EmbeddingLookupGradOp: public OpImpl {
   cudaStream_t stream_;
 };
 
+//the rows are listed in the index of dMatrix unless ids is NULL
 template <typename T>
 __global__ void BatchedSparseUpdate(T *dMatrix,
     const T* data, const T* dY,
-    int embedding_size) {
+    int embedding_size,
+    int* ids, int* count, int* listed) {
   int dY_offset = blockIdx.x*embedding_size;
   int dMatrix_offset = data[blockIdx.x]*embedding_size;
+  if (ids && threadIdx.x == 0)
+    ListRow((int)data[blockIdx.x], ids, count, listed);
   for (int round = 0; round < (embedding_size+blockDim.x-1)/blockDim.x; round++) {
     int offset_within_vec = threadIdx.x + round*blockDim.x;
     if (offset_within_vec < embedding_size) {  
@@ -137,10 +142,20 @@ void EmbeddingLookupGradOp<T>::Compute(OpContext* context) {
                          embedding_size : MAX_THREADS_IN_BLOCK;
   int blocksPerGrid = slices;
 
+  //the rows touched by the batch are listed,
+  //so that the update and the zeroing skip the others
+  midend::RowSparseIndex* index = dMatrix->row_sparse_index();
+  if (index && index->overflow())
+    index = NULL;
   BatchedSparseUpdate<<<blocksPerGrid, threadsPerBlock, 0, stream_>>>(
       dMatrix->mutable_data<T>(),
       input.data<T>(), dY.data<T>(),
-      embedding_size);
+      embedding_size,
+      index ? index->ids() : NULL,
+      index ? index->count() : NULL,
+      index ? index->listed() : NULL);
+  if (index)
+    index->AddToBound(slices);
 
   dY.DebugNumerical<T>();
   input.DebugNumerical<T>();
@@ -0,0 +1,169 @@
+#include "cavs/backend/op_impl.h"
+#include "cavs/midend/op_context.h"
+#include "cavs/midend/session_base.h"
+#include "cavs/midend/tensor.h"
+#include "cavs/util/logging.h"
+#include "cavs/util/macros_gpu.h"
+#include "cavs/util/op_def_builder.h"
+#include "cavs/util/op_util.h"
+
+#include <cmath>
+#include <memory>
+#include <set>
+
+using namespace midend;
+using namespace backend;
+using std::string;
+using std::vector;
+
+const int kVocabulary = 40;
+const int kEmbedding  = 16;
+const int kBatch      = 12;
+const int kIters      = 6;
+//the iteration that accumulates a dense gradient
+const int kOverflowIter = 3;
+
+//the sessions list the rows of a buffer according to its writers
+class RowSparseSession : public SessionBase {
+ public:
+  static void Track(const OpDef& def, Tensor* t) {
+    TrackRowSparse(def, 0, t);
+  }
+};
+
+OpDef GpuDef(const string& name, int inputs) {
+  OpDefBuilder builder(name);
+  for (int i = 0; i < inputs; i++)
+    builder.Input("x" + std::to_string(i));
+  OpDef def;
+  builder.Output("y").Device("GPU").Finalize(&def);
+  return def;
+}
+
+void Run(OpImpl* op, const vector<Tensor*>& inputs, Tensor* output) {
+  OpContext ctxt;
+  for (auto* t : inputs) ctxt.AppendInput(t);
+  ctxt.AppendOutput(output);
+  op->Compute(&ctxt);
+  checkCudaError(cudaDeviceSynchronize());
+}
+
+void Upload(Tensor* t, const vector<float>& v) {
+  CHECK(t->count() == v.size());
+  checkCudaError(cudaMemcpy(t->mutable_data<float>(), v.data(),
+        v.size()*sizeof(float), cudaMemcpyHostToDevice));
+}
+
+vector<float> Download(const Tensor& t) {
+  vector<float> v(t.count());
+  checkCudaError(cudaMemcpy(v.data(), t.data<float>(),
+        v.size()*sizeof(float), cudaMemcpyDeviceToHost));
+  return v;
+}
+
+//ids with repeats, the last two repeat the first two
+vector<float> Ids(int iter) {
+  vector<float> ids(kBatch);
+  for (int i = 0; i < kBatch; i++)
+    ids[i] = (iter*7 + i*i) % kVocabulary;
+  ids[kBatch-1] = ids[0];
+  ids[kBatch-2] = ids[1];
+  return ids;
+}
+
+vector<float> Values(int n, int iter, float scale) {
+  vector<float> v(n);
+  for (int i = 0; i < n; i++)
+    v[i] = ((i*(iter+3)) % 13 - 6)*scale;
+  return v;
+}
+
+//an embedding model: W -= lr*Clip(Accumulate(EmbeddingLookupGrad(dY, ids)))
+//with the gradients listing their rows, or written densely as well.
+//returns W after kIters iterations
+vector<float> TrainEmbedding(bool sparse) {
+  Allocator* alloc = GetAllocator("GPU");
+  TensorShape matrix_shape(vector<int>{kVocabulary, kEmbedding});
+  Tensor W("test:W", alloc, DT_FLOAT, matrix_shape);
+  Tensor dW("test:dW", alloc, DT_FLOAT, matrix_shape);
+  Tensor sum("test:sum", alloc, DT_FLOAT, matrix_shape);
+  Tensor dense("test:dense", alloc, DT_FLOAT, matrix_shape);
+  Tensor ids("test:ids", alloc, DT_FLOAT, TensorShape(vector<int>{kBatch}));
+  Tensor dY("test:dY", alloc, DT_FLOAT, TensorShape(vector<int>{kBatch, kEmbedding}));
+  Upload(&W, Values(W.count(), 0, 0.05f));
+  Upload(&dense, Values(dense.count(), 1, 0.01f));
+
+  OpDef grad_def = GpuDef(GetGradientName("EmbeddingLookup"), 2);
+  OpDef accumulate_def = GpuDef("Accumulate", 1);
+  OpDef clip_def;
+  OpDefBuilder("Clip").Input("x0").Output("x0").Device("GPU")
+    .AttrSingle<float>("clip", 1.f).Finalize(&clip_def);
+  OpDef sgd_def;
+  OpDefBuilder("SGD").Input("x0").Input("x1").Output("x0").Device("GPU")
+    .AttrSingle<float>("Learning_rate", 0.5f).Finalize(&sgd_def);
+  dW.SetZeroInitEnforced();
+  sum.SetZeroInitEnforced();
+  RowSparseSession::Track(grad_def, &dW);
+  RowSparseSession::Track(accumulate_def, &sum);
+  RowSparseSession::Track(clip_def, &sum);
+  if (!sparse) {
+    RowSparseSession::Track(GpuDef("Fill", 1), &dW);
+    RowSparseSession::Track(GpuDef("Fill", 1), &sum);
+  }
+  CHECK((dW.row_sparse_index() != NULL) == sparse);
+  CHECK((sum.row_sparse_index() != NULL) == sparse);
+
+  std::unique_ptr<OpImpl> grad(CreateOp(grad_def));
+  std::unique_ptr<OpImpl> accumulate(CreateOp(accumulate_def));
+  std::unique_ptr<OpImpl> clip(CreateOp(clip_def));
+  std::unique_ptr<OpImpl> sgd(CreateOp(sgd_def));
+  for (int iter = 1; iter <= kIters; iter++) {
+    CHECK(dW.InitWithZero(iter));
+    CHECK(sum.InitWithZero(iter));
+    vector<float> batch_ids = Ids(iter);
+    Upload(&ids, batch_ids);
+    Upload(&dY, Values(dY.count(), iter, 0.1f));
+    Run(grad.get(), {&dY, &ids}, &dW);
+    Run(accumulate.get(), {&dW}, &sum);
+    if (iter == kOverflowIter)
+      Run(accumulate.get(), {&dense}, &sum);
+
+    if (sparse) {
+      //each repeated id is listed once
+      const RowSparseIndex* index = sum.row_sparse_index();
+      CHECK(index->overflow() == (iter == kOverflowIter)) << iter;
+      if (!index->overflow()) {
+        int count = 0;
+        checkCudaError(cudaMemcpy(&count, index->count(), sizeof(int),
+              cudaMemcpyDeviceToHost));
+        std::set<float> unique_ids(batch_ids.begin(), batch_ids.end());
+        CHECK(count == unique_ids.size()) << count << "\t" << unique_ids.size();
+        CHECK(index->bound() >= count && index->bound() <= kVocabulary);
+      }
+    }
+    Run(clip.get(), {&sum}, &sum);
+    Run(sgd.get(), {&W, &sum}, &W);
+  }
+  return Download(W);
+}
+
+void TestRowSparseUpdate() {
+  vector<float> sparse = TrainEmbedding(true);
+  vector<float> dense = TrainEmbedding(false);
+  vector<float> initial = Values(sparse.size(), 0, 0.05f);
+  int updated = 0;
+  for (int i = 0; i < sparse.size(); i++) {
+    CHECK(std::fabs(sparse[i] - dense[i]) <= 1e-5f*std::max(1.f, std::fabs(dense[i])))
+      << "W[" << i/kEmbedding << "][" << i%kEmbedding << "]: "
+      << sparse[i] << " vs " << dense[i];
+    updated += (dense[i] != initial[i]);
+  }
+  CHECK(updated > 0);
+  LOG(INFO) << "row-sparse embedding update passed, "
+            << updated << " weights updated";
+}
+
+int main() {
+  TestRowSparseUpdate();
+  return 0;
+}
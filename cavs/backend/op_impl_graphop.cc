@@ -0,0 +1,238 @@
+#include "cavs/backend/op_impl.h"
+#include "cavs/backend/functor_batched_memcpy.h"
+#include "cavs/midend/graph_scheduler.h"
+#include "cavs/midend/tensor.h"
+#include "cavs/util/op_util.h"
+
+#include <string.h>
+#include <string>
+
+using ::midend::Tensor;
+using ::midend::GraphSchedulerBase;
+using ::midend::IdRange;
+using std::vector;
+using std::string;
+
+namespace backend {
+
+//the host versions of op_impl_graphop.cu,
+//the tensor ids are consumed directly from the scheduler
+//instead of being staged into gpu_idx_buf
+template <typename T>
+class GraphGatherOpCPU : public OpImpl {
+ public:
+  explicit GraphGatherOpCPU(const OpDef& def) :
+    OpImpl(def), count_(1) {
+    CHECK(def.input_size()  == 0);
+    CHECK(def.output_size() == 1);
+    CHECK(def.shape_size()  == 1);
+    for (auto d : def.shape(0).dim())
+      count_ *= d;
+    child_offset_ = GetSingleArg<int>(def, "Child");
+    CHECK(child_offset_ >= 0);
+    //with a reduction, all the children of a job are gathered into one row
+    reduce_ = GetSingleArg<string>(def, "Reduce", "");
+    CHECK(reduce_.empty() || reduce_ == "Sum" || reduce_ == "Mean") << reduce_;
+  }
+
+  void Compute(OpContext* context) override {
+    Tensor* out = context->Output(0);
+    GraphSchedulerBase* gs = context->graph_scheduler();
+    const Tensor& inp = gs->GetMessagePasser(0);
+    CHECK(inp.device_type() == CPU) << inp.debug_info();
+
+    IdRange gids = gs->GetJobId();
+    context->SetDynDim(gids.size());
+    context->ScaleOutputTensor();
+    int stride = out->count()/out->dims(0);
+    CHECK(stride == count_) << out->debug_info() << op_def_.DebugString();
+    VLOG(V_DEBUG) << "Batching jobs of this round: " << gids.size();
+
+    IdRange tensor_ids_for_gather = gs->CurrentRoundTensorIdsForGather(child_offset_);
+    if (!reduce_.empty()) {
+      IdRange offsets = gs->CurrentRoundSegmentOffsets();
+      CHECK(offsets.size() == gids.size()+1) << offsets.size() << "\t" << gids.size();
+      BatchedSegmentReduceInputSlice<T>(
+          out->mutable_data<T>(), stride, inp.data<T>(), stride,
+          offsets.data(), gs->CurrentRoundSegmentTensorIds().data(),
+          gids.size(), stride, reduce_ == "Mean");
+    }else if (!tensor_ids_for_gather.empty()) {
+      BatchedDynamicSelectedInputSliceCopy<T>(
+          out->mutable_data<T>(), stride, inp.data<T>(), stride,
+          tensor_ids_for_gather.data(), tensor_ids_for_gather.size(), stride);
+    }else {
+      //no job of this round has such a child
+      BatchedDynamicSelectedAssignZero<T>(
+          out->mutable_data<T>(), stride, gids.size(), stride);
+    }
+
+    out->DebugNumerical<T>();
+  }
+
+ private:
+  int count_;
+  int child_offset_;
+  string reduce_;
+};
+
+template <typename T>
+class GraphScatterOpCPU : public OpImpl {
+ public:
+  explicit GraphScatterOpCPU(const OpDef& def) : OpImpl(def) {
+    child_offset_ = GetSingleArg<int>(def, "Child");
+    CHECK(child_offset_ >= 0);
+    accumulate_ = GetSingleArg<bool>(def, "Accumulate", false);
+    //the gradient of a reducing gather
+    reduce_ = GetSingleArg<string>(def, "Reduce", "");
+    CHECK(reduce_.empty() || (accumulate_ && (reduce_ == "Sum" || reduce_ == "Mean")))
+      << reduce_ << "\t" << accumulate_;
+  }
+
+  void Compute(OpContext* context) override {
+    const Tensor& inp = context->Input(0);
+    Tensor* out = context->Output(0);
+    CHECK(out->count() == inp.count())
+          << "Input count:\t" << inp.count()
+          << "\t" << inp.debug_size() << "Bytes\n"
+          << "Output count:\t" << out->count()
+          << "\t" << out->debug_size() << "Bytes";
+    CHECK(inp.IsDynamicShape());
+    CHECK(out->IsDynamicShape());
+    CHECK(out->dims(0) == inp.dims(0));
+    int stride = out->count()/out->dims(0);
+    CHECK(stride == inp.count()/inp.dims(0));
+
+    out->SetOffsetWithId(0);
+    GraphSchedulerBase* gs = context->graph_scheduler();
+    IdRange tensor_ids_for_scatter = gs->CurrentRoundTensorIdsForScatter(child_offset_);
+    VLOG(V_DEBUG) << "tensor ids for scatter: " << tensor_ids_for_scatter.size();
+    if (!reduce_.empty()) {
+      IdRange offsets = gs->CurrentRoundSegmentOffsets();
+      CHECK(offsets.size() == inp.dims(0)+1) << offsets.size() << "\t" << inp.dims(0);
+      BatchedSegmentReduceOutputSliceAccumulate<T>(
+          out->mutable_data<T>(), stride, offsets.data(),
+          gs->CurrentRoundSegmentTensorIds().data(), inp.data<T>(), stride,
+          inp.dims(0), stride, reduce_ == "Mean");
+    }else if (!tensor_ids_for_scatter.empty()) {
+      if (accumulate_) {
+        BatchedDynamicSelectedOutputSliceAccumulate<T>(
+            out->mutable_data<T>(), stride, tensor_ids_for_scatter.data(),
+            inp.data<T>(), stride, tensor_ids_for_scatter.size(), stride);
+      }else {
+        BatchedDynamicSelectedOutputSliceCopy<T>(
+            out->mutable_data<T>(), stride, tensor_ids_for_scatter.data(),
+            inp.data<T>(), stride, tensor_ids_for_scatter.size(), stride);
+      }
+    }
+
+    out->DebugNumerical<T>();
+  }
+
+ private:
+  int child_offset_;
+  bool accumulate_;
+  string reduce_;
+};
+
+template <typename T>
+class GraphPushOpCPU : public OpImpl {
+ public:
+  explicit GraphPushOpCPU(const OpDef& def) : OpImpl(def) {}
+  void Compute(OpContext* context) override {
+    GraphSchedulerBase* gs = context->graph_scheduler();
+    CHECK_NOTNULL(gs);
+    const Tensor& inp = context->Input(0);
+    Tensor* out = context->Output(0);
+    VLOG(V_DEBUG) << "Input count:\t" << inp.count()
+                  << "\t" << inp.debug_size() << "Bytes\n"
+                  << "Output count:\t" << out->count()
+                  << "\t" << out->debug_size() << "Bytes";
+    CHECK(!out->IsFullShape());
+    memcpy(out->mutable_data<T>(), inp.data<T>(), inp.count()*sizeof(T));
+    gs->SetFuncRet(*out);
+
+    inp.DebugNumerical<T>();
+    out->DebugNumerical<T>();
+  }
+};
+
+template <typename T>
+class GraphPullOpCPU : public OpImpl {
+ public:
+  explicit GraphPullOpCPU(const OpDef& def) : OpImpl(def) {}
+
+  void Compute(OpContext* context) override {
+    GraphSchedulerBase* gs = context->graph_scheduler();
+    CHECK_NOTNULL(gs);
+    const Tensor& inp = gs->GetFuncArg();
+    Tensor* out = context->Output(0);
+    CHECK(inp.count() >= out->count())
+          << "Input count:\t" << inp.count()
+          << "\t" << inp.debug_size() << "Bytes\n"
+          << "Output count:\t" << out->count()
+          << "\t" << out->debug_size() << "Bytes";
+    CHECK(inp.device_type() == CPU) << inp.debug_info();
+
+    IdRange gids = gs->GetJobId();
+    context->SetDynDim(gids.size());
+    context->ScaleOutputTensor();
+    int stride = out->count()/out->dims(0);
+    CHECK(out->dims(0) == gids.size());
+    BatchedDynamicSelectedInputSliceCopy<T>(
+        out->mutable_data<T>(), stride, inp.data<T>(), stride,
+        gids.data(), gids.size(), stride);
+
+    inp.DebugNumerical<T>();
+    out->DebugNumerical<T>();
+  }
+};
+
+template <typename T>
+class FunctionPushArgOpCPU : public OpImpl {
+ public:
+  explicit FunctionPushArgOpCPU(const OpDef& def) : OpImpl(def) {}
+  void Compute(OpContext* context) override {
+    const Tensor& inp = context->Input(0);
+    GraphSchedulerBase* gs = context->graph_scheduler();
+    CHECK_NOTNULL(gs);
+    gs->SetFuncArg(inp);
+    inp.DebugNumerical<T>();
+  }
+};
+
+template <typename T>
+class FunctionPopRetOpCPU : public OpImpl {
+ public:
+  explicit FunctionPopRetOpCPU(const OpDef& def) : OpImpl(def) {}
+
+  void Compute(OpContext* context) override {
+    GraphSchedulerBase* gs = context->graph_scheduler();
+    CHECK_NOTNULL(gs);
+    const Tensor& inp = gs->GetFuncRet();
+    Tensor* out = context->Output(0);
+    CHECK(inp.count() <= out->count())
+      << inp.count() << "\t" << out->count();
+    CHECK(inp.debug_size() >= out->debug_size())
+        << inp.debug_size() << "\t" << out->debug_size();
+    CHECK(inp.IsDynamicShape());
+    CHECK(out->device_type() == CPU) << out->debug_info();
+
+    int stride = inp.count()/inp.dims(0);
+    IdRange tids2gids = gs->TensorIdsToJobIds();
+    BatchedDynamicSelectedOutputSliceCopy<T>(
+        out->mutable_data<T>(), stride, tids2gids.data(),
+        inp.data<T>(), stride, tids2gids.size(), stride);
+
+    inp.DebugNumerical<T>();
+    out->DebugNumerical<T>();
+  }
+};
+
+REGISTER_OP_IMPL_BUILDER(Key("Pull").Device("CPU"),    GraphPullOpCPU<float>);
+REGISTER_OP_IMPL_BUILDER(Key("Push").Device("CPU"),    GraphPushOpCPU<float>);
+REGISTER_OP_IMPL_BUILDER(Key("Scatter").Device("CPU"), GraphScatterOpCPU<float>);
+REGISTER_OP_IMPL_BUILDER(Key("Gather").Device("CPU"),  GraphGatherOpCPU<float>);
+REGISTER_OP_IMPL_BUILDER(Key("FunctionPushArg").Device("CPU"), FunctionPushArgOpCPU<float>);
+REGISTER_OP_IMPL_BUILDER(Key("FunctionPopRet").Device("CPU"), FunctionPopRetOpCPU<float>);
+
+} //namespace backend
@@ -9,6 +9,7 @@
 
 using ::midend::Tensor;
 using ::midend::GraphSchedulerBase;
+using ::midend::IdRange;
 using std::vector;
 using std::string;
 
@@ -27,6 +28,8 @@ class GraphGatherOp : public OpImpl {
       count_ *= d;
     child_offset_ = GetSingleArg<int>(def, "Child");
     CHECK(child_offset_ >= 0);
+    reduce_ = GetSingleArg<string>(def, "Reduce", "");
+    CHECK(reduce_.empty() || reduce_ == "Sum" || reduce_ == "Mean") << reduce_;
   }
 
   void Compute(OpContext* context) override {
@@ -35,7 +38,7 @@ class GraphGatherOp : public OpImpl {
     GraphSchedulerBase* gs = context->graph_scheduler();
     const Tensor& inp = gs->GetMessagePasser(0);
 
-    const vector<int>& gids = gs->GetJobId();
+    IdRange gids = gs->GetJobId();
     context->SetDynDim(gids.size());
     context->ScaleOutputTensor();
     int stride = out->count()/out->dims(0);
@@ -48,7 +51,7 @@ class GraphGatherOp : public OpImpl {
     }
 
     /*const vector<int>& child_tensor_ids = gs->GatherTensorIds(gids, child_offset_);*/
-    const vector<int>& tensor_ids_for_gather = gs->CurrentRoundTensorIdsForGather(child_offset_);
+    IdRange tensor_ids_for_gather = gs->CurrentRoundTensorIdsForGather(child_offset_);
     if (VLOG_IS_ON(V_DEBUG)) {
       string out;
       for (int id : tensor_ids_for_gather) out += std::to_string(id) + "\t";
@@ -64,23 +67,39 @@ class GraphGatherOp : public OpImpl {
       VLOG(V_DEBUG) << "[Unary] Assign new stream with ID " << context->GetStreamID();
     }
 
-    if (!tensor_ids_for_gather.empty()) {
+    const int MAX_THREADS_IN_BLOCK = 1 << 10;
+    int threadsPerBlock = (MAX_THREADS_IN_BLOCK > stride)? stride : MAX_THREADS_IN_BLOCK;
+    if (!reduce_.empty()) {
+      //the offsets and the ids are staged back to back
+      IdRange offsets = gs->CurrentRoundSegmentOffsets();
+      IdRange segment_ids = gs->CurrentRoundSegmentTensorIds();
+      CHECK(offsets.size() == gids.size()+1) << offsets.size() << "\t" << gids.size();
+      checkCudaError(cudaMemcpyAsync(gs->gpu_idx_buf(), offsets.data(),
+                     offsets.size()*sizeof(int), cudaMemcpyHostToDevice, stream_));
+      checkCudaError(cudaMemcpyAsync(gs->gpu_idx_buf()+offsets.size(), segment_ids.data(),
+                     segment_ids.size()*sizeof(int), cudaMemcpyHostToDevice, stream_));
+      BatchedSegmentReduceInputSliceKernel<T><<<gids.size(), threadsPerBlock, 0, stream_>>>(
+              out->mutable_data<T>(), stride, inp.data<T>(), stride,
+              gs->gpu_idx_buf(), gs->gpu_idx_buf()+offsets.size(), stride, reduce_ == "Mean");
+    }else if (tensor_ids_for_gather.IsContiguous()) {
+      //the rows are adjacent in the message pool, no index is staged
+      checkCudaError(cudaMemcpyAsync(out->mutable_data<T>(),
+                     inp.data<T>() + tensor_ids_for_gather[0]*stride,
+                     tensor_ids_for_gather.size()*stride*sizeof(T),
+                     cudaMemcpyDeviceToDevice, stream_));
+    }else if (!tensor_ids_for_gather.empty()) {
       checkCudaError(cudaMemcpyAsync(gs->gpu_idx_buf(), tensor_ids_for_gather.data(),
                      tensor_ids_for_gather.size()*sizeof(int), cudaMemcpyHostToDevice, stream_));
       /*int blocksPerGrid = gids.size();*/
       int blocksPerGrid = tensor_ids_for_gather.size();
       /*int threadsPerBlock = stride;*/
-      const int MAX_THREADS_IN_BLOCK = 1 << 10;
-      int threadsPerBlock = (MAX_THREADS_IN_BLOCK > stride)? stride : MAX_THREADS_IN_BLOCK;
       BatchedDynamicSelectedInputSliceCopyKernel<T><<<blocksPerGrid, threadsPerBlock, 0, stream_>>>(
               out->mutable_data<T>(), stride, inp.data<T>(), stride, gs->gpu_idx_buf(), stride);
     }else {
       /*checkCudaError(cudaMemset(out->mutable_data<T>(), 0, gids.size()*stride*sizeof(T)));*/
-      int blocksPerGrid = gs->CurrentRoundTensorIdsForGatherInitialization().size();
-      checkCudaError(cudaMemcpyAsync(gs->gpu_idx_buf(), gs->CurrentRoundTensorIdsForGatherInitialization().data(),
-                     blocksPerGrid*sizeof(int), cudaMemcpyHostToDevice, stream_));
-      const int MAX_THREADS_IN_BLOCK = 1 << 10;
-      int threadsPerBlock = (MAX_THREADS_IN_BLOCK > stride)? stride : MAX_THREADS_IN_BLOCK;
+      //no job of this round has such a child,
+      //the kernel clears the first rows and never reads the ids
+      int blocksPerGrid = gids.size();
       BatchedDynamicSelectedAssignZeroKernel<T><<<blocksPerGrid, threadsPerBlock, 0, stream_>>>(
               out->mutable_data<T>(), stride, gs->gpu_idx_buf(), stride);
     }
@@ -92,6 +111,7 @@ class GraphGatherOp : public OpImpl {
  private:
   int count_;
   int child_offset_;
+  string reduce_;
   cudaStream_t stream_;
 };
 
@@ -103,6 +123,10 @@ class GraphScatterOp : public OpImpl {
 
     child_offset_ = GetSingleArg<int>(def, "Child");
     CHECK(child_offset_ >= 0);
+    accumulate_ = GetSingleArg<bool>(def, "Accumulate", false);
+    reduce_ = GetSingleArg<string>(def, "Reduce", "");
+    CHECK(reduce_.empty() || (accumulate_ && (reduce_ == "Sum" || reduce_ == "Mean")))
+      << reduce_ << "\t" << accumulate_;
   }
 
   void Compute(OpContext* context) override {
@@ -122,7 +146,7 @@ class GraphScatterOp : public OpImpl {
 
     out->SetOffsetWithId(0);
     GraphSchedulerBase* gs = context->graph_scheduler();
-    const vector<int>& gids = gs->GetJobId();
+    IdRange gids = gs->GetJobId();
     VLOG(V_DEBUG) << "Batching jobs of this round: " << gids.size();
     if (VLOG_IS_ON(V_DEBUG)) {
       string out;
@@ -130,7 +154,7 @@ class GraphScatterOp : public OpImpl {
       VLOG(V_DEBUG) << out;
     }
 
-    const vector<int>& tensor_ids_for_scatter = gs->CurrentRoundTensorIdsForScatter(child_offset_);
+    IdRange tensor_ids_for_scatter = gs->CurrentRoundTensorIdsForScatter(child_offset_);
     VLOG(V_DEBUG) << "tensor ids for scatter: " << tensor_ids_for_scatter.size();
     if (VLOG_IS_ON(V_DEBUG)) {
       string out;
@@ -145,15 +169,37 @@ class GraphScatterOp : public OpImpl {
       stream_ = StreamEventHandlePool::GetCudaStream(context->GetStreamID());
       VLOG(V_DEBUG) << "[Unary] Assign new stream with ID " << context->GetStreamID();
     }
-    if (!tensor_ids_for_scatter.empty()) {
+    if (!reduce_.empty()) {
+      IdRange offsets = gs->CurrentRoundSegmentOffsets();
+      IdRange segment_ids = gs->CurrentRoundSegmentTensorIds();
+      CHECK(offsets.size() == inp.dims(0)+1) << offsets.size() << "\t" << inp.dims(0);
+      checkCudaError(cudaMemcpyAsync(gs->gpu_idx_buf(), offsets.data(),
+                     offsets.size()*sizeof(int), cudaMemcpyHostToDevice, stream_));
+      checkCudaError(cudaMemcpyAsync(gs->gpu_idx_buf()+offsets.size(), segment_ids.data(),
+                     segment_ids.size()*sizeof(int), cudaMemcpyHostToDevice, stream_));
+      const int MAX_THREADS_IN_BLOCK = 1 << 10;
+      int threadsPerBlock = (MAX_THREADS_IN_BLOCK > stride)? stride : MAX_THREADS_IN_BLOCK;
+      BatchedSegmentReduceOutputSliceAccumulateKernel<T><<<inp.dims(0), threadsPerBlock, 0, stream_>>>(
+              out->mutable_data<T>(), stride, gs->gpu_idx_buf(), gs->gpu_idx_buf()+offsets.size(),
+              inp.data<T>(), stride, stride, reduce_ == "Mean");
+    }else if (!accumulate_ && tensor_ids_for_scatter.IsContiguous()) {
+      checkCudaError(cudaMemcpyAsync(out->mutable_data<T>() + tensor_ids_for_scatter[0]*stride,
+                     inp.data<T>(), tensor_ids_for_scatter.size()*stride*sizeof(T),
+                     cudaMemcpyDeviceToDevice, stream_));
+    }else if (!tensor_ids_for_scatter.empty()) {
       checkCudaError(cudaMemcpyAsync(gs->gpu_idx_buf(), tensor_ids_for_scatter.data(),
                      tensor_ids_for_scatter.size()*sizeof(int), cudaMemcpyHostToDevice, stream_));
       int blocksPerGrid = tensor_ids_for_scatter.size();
       /*int threadsPerBlock = stride;*/
       const int MAX_THREADS_IN_BLOCK = 1 << 10;
       int threadsPerBlock = (MAX_THREADS_IN_BLOCK > stride)? stride : MAX_THREADS_IN_BLOCK;
-      BatchedDynamicSelectedOutputSliceCopyKernel<T><<<blocksPerGrid, threadsPerBlock, 0, stream_>>>(
-              out->mutable_data<T>(), stride, gs->gpu_idx_buf(), inp.data<T>(), stride, stride);
+      if (accumulate_) {
+        BatchedDynamicSelectedOutputSliceAccumulateKernel<T><<<blocksPerGrid, threadsPerBlock, 0, stream_>>>(
+                out->mutable_data<T>(), stride, gs->gpu_idx_buf(), inp.data<T>(), stride, stride);
+      }else {
+        BatchedDynamicSelectedOutputSliceCopyKernel<T><<<blocksPerGrid, threadsPerBlock, 0, stream_>>>(
+                out->mutable_data<T>(), stride, gs->gpu_idx_buf(), inp.data<T>(), stride, stride);
+      }
     }
 
     checkCudaError(cudaGetLastError());
@@ -162,6 +208,8 @@ class GraphScatterOp : public OpImpl {
 
  private:
   int child_offset_;
+  bool accumulate_;
+  string reduce_;
   cudaStream_t stream_;
 };
 
@@ -226,7 +274,7 @@ class GraphPullOp : public OpImpl {
     //out tensor must be local
     //if in tensor is a global tensor(in the backward of pull)
     //CHECK(inp.IsFullShape());
-    const vector<int>& gids = gs->GetJobId();
+    IdRange gids = gs->GetJobId();
     context->SetDynDim(gids.size());
     context->ScaleOutputTensor();
     int stride = out->count()/out->dims(0);
@@ -301,7 +349,7 @@ class FunctionPopRetOp : public OpImpl {
     //for example, the placeholder may be {2, 4} (batch, time_step)
     //here, the inp shape may be {1, 1} (serial model) or {2, 1} (batch mode)
     /*CHECK(stride == out->count()/out_dyn_dim);*/
-    const vector<int>& tids2gids= gs->TensorIdsToJobIds();
+    IdRange tids2gids = gs->TensorIdsToJobIds();
     for (int i = 0; i < tids2gids.size(); i++) {
       VLOG(V_DEBUG) << "i: " << i << "\tgid: " << tids2gids[i];
     }
@@ -1,5 +1,6 @@
 #include "cavs/backend/functor_elementwise.h"
 #include "cavs/backend/cuda_common.h"
+#include "cavs/backend/functor_row_sparse.cuh"
 #include "cavs/backend/op_impl.h"
 #include "cavs/midend/tensor.h"
 #include "cavs/midend/op_context.h"
@@ -19,6 +20,16 @@ __global__ void SGDKernel(T* out, const T* inp0, const T* inp1,
   } 
 }
 
+//the gradient is zero out of the listed rows, which the update skips
+template <typename T> 
+__global__ void RowSparseSGDKernel(T* out, const T* inp0, const T* inp1,
+    const float lr, int width, const int* ids, const int* count) {
+  if (blockIdx.x >= *count) return;
+  const int offset = ids[blockIdx.x]*width;
+  for (int i = threadIdx.x; i < width; i += blockDim.x)
+    out[offset+i] = inp0[offset+i] - lr*inp1[offset+i];
+}
+
 template <typename T>
 class SGDOpImpl : public OpImpl {
  public:
@@ -40,9 +51,20 @@ class SGDOpImpl : public OpImpl {
     inp1.DebugNumerical<T>();
     Tensor* out = context->Output(0);
     int n = out->count();
-    SGDKernel<T><<<BLOCKS_PER_GRID(n), THREADS_PER_BLOCK>>> (
-        out->mutable_data<T>(),
-        inp0.data<T>(), inp1.data<T>(), lr_, n);
+    const midend::RowSparseIndex* index = inp1.row_sparse_index();
+    if (index && !index->overflow() && out->data<T>() == inp0.data<T>()) {
+      if (index->bound() > 0) {
+        const int width = n/out->dims(0);
+        RowSparseSGDKernel<T><<<index->bound(), RowSparseThreads(width)>>> (
+            out->mutable_data<T>(),
+            inp0.data<T>(), inp1.data<T>(), lr_, width,
+            index->ids(), index->count());
+      }
+    }else {
+      SGDKernel<T><<<BLOCKS_PER_GRID(n), THREADS_PER_BLOCK>>> (
+          out->mutable_data<T>(),
+          inp0.data<T>(), inp1.data<T>(), lr_, n);
+    }
     out->DebugNumerical<T>();
   }
 
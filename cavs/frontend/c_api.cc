@@ -6,6 +6,7 @@
 #include "cavs/proto/func_def.pb.h"
 #include "cavs/proto/op_def.pb.h"
 #include "cavs/midend/session_base.h"
+#include "cavs/midend/graph_stats.h"
 #include "cavs/midend/tensor.h"
 #include "cavs/midend/scope.h"
 #include "cavs/backend/op_decl.h"
@@ -171,6 +172,40 @@ void C_Run(C_Session* s,
   }
 }
 
+void C_Prefetch(C_Session* s,
+    const char** c_input_names, C_Tensor* const* c_input_tensors, int ninputs) {
+  vector<string> input_names(ninputs);
+  vector<Tensor> input_tensors(ninputs);
+  for (int i = 0; i < ninputs; i++) {
+    input_names[i] = c_input_names[i];
+    input_tensors[i] = c_input_tensors[i]->tensor;
+  }
+  s->session->Prefetch(input_names, input_tensors);
+}
+
+void C_GetGraphStats(C_Session* s, int backward, C_GraphStats* stats) {
+  static_assert(sizeof(stats->round_histogram)/sizeof(long long)
+                == midend::GraphStats::HISTOGRAM_BUCKETS, "histogram buckets");
+  CHECK(stats);
+  midend::GraphStats gs;
+  if (backward)
+    s->session->GetGraphStats(NULL, &gs);
+  else
+    s->session->GetGraphStats(&gs, NULL);
+  stats->batches    = gs.batches;
+  stats->rounds     = gs.rounds;
+  stats->vertices   = gs.vertices;
+  stats->statements = gs.statements;
+  for (int i = 0; i < midend::GraphStats::HISTOGRAM_BUCKETS; i++)
+    stats->round_histogram[i] = gs.round_histogram[i];
+  stats->schedule_ms = gs.schedule_ms;
+  stats->compute_ms  = gs.compute_ms;
+}
+
+void C_ResetGraphStats(C_Session* s) {
+  s->session->ResetGraphStats();
+}
+
 void* C_TensorData(const C_Tensor* t) { 
   CHECK(t);
   if (midend::TensorCApi::IsVirtual(t->tensor))
@@ -17,6 +17,17 @@ typedef struct C_Session  C_Session;
 typedef struct C_Tensor   C_Tensor;
 typedef struct C_Scope    C_Scope;
 
+//see midend::GraphStats, bucket k counts the rounds of [2^k, 2^(k+1)) jobs
+typedef struct {
+  long long batches;
+  long long rounds;
+  long long vertices;
+  long long statements;
+  long long round_histogram[32];
+  double schedule_ms;
+  double compute_ms;
+} C_GraphStats;
+
 extern C_Session* C_NewSession(
     const char* name, size_t name_len, int opt);
 extern C_Tensor* C_NewTensor(const char* name, size_t name_len, 
@@ -32,6 +43,10 @@ extern void C_AddControlDependency(const void* def, size_t def_length);
 extern void C_Run(C_Session* s, 
     const char** c_output_names, C_Tensor** c_output_tensors, int noutputs,
     const char** c_input_names, C_Tensor* const* c_input_tensors, int ninputs);
+extern void C_Prefetch(C_Session* s,
+    const char** c_input_names, C_Tensor* const* c_input_tensors, int ninputs);
+extern void C_GetGraphStats(C_Session* s, int backward, C_GraphStats* stats);
+extern void C_ResetGraphStats(C_Session* s);
 extern void* C_TensorData(const C_Tensor* t);
 extern size_t C_TensorSize(const C_Tensor* t);
 
@@ -0,0 +1,152 @@
+#include "cavs/frontend/cxx/graph_sampler.h"
+#include "cavs/util/logging.h"
+
+#include <algorithm>
+#include <numeric>
+
+using std::vector;
+
+GraphBatchSampler::GraphBatchSampler(int batch_size, int max_length,
+    bool bucketing, bool shuffle, unsigned seed)
+  : batch_size_(batch_size), max_length_(max_length),
+    bucketing_(bucketing), shuffle_(shuffle), generator_(seed),
+    next_batch_(0) {
+  CHECK(batch_size_ > 0 && max_length_ > 0);
+}
+
+int GraphBatchSampler::AddSample(const vector<int>& parents) {
+  const int n = parents.size();
+  CHECK(n > 0 && n <= max_length_) << n << "\t" << max_length_;
+  CHECK(parents[n-1] == -1) << "the root ends a sample";
+  //the distance of each vertex to the root, in vertices
+  vector<int> level(n, 0);
+  vector<int> path;
+  int depth = 0;
+  level[n-1] = 1;
+  for (int v = 0; v < n; v++) {
+    int u = v;
+    while (level[u] == 0) {
+      CHECK(parents[u] >= 0 && parents[u] < n && path.size() < n)
+        << "vertex " << u << " of sample " << num_samples();
+      path.push_back(u);
+      u = parents[u];
+    }
+    for (int i = path.size()-1; i >= 0; i--)
+      level[path[i]] = level[parents[path[i]]] + 1;
+    path.clear();
+    depth = std::max(depth, level[v]);
+  }
+  //a single vertex has nothing to schedule
+  depth_.push_back((n > 1) ? depth : 0);
+  parents_.push_back(parents);
+  order_.clear();
+  return parents_.size()-1;
+}
+
+void GraphBatchSampler::NewEpoch() {
+  CHECK(num_samples() > 0);
+  order_.resize(num_samples());
+  std::iota(order_.begin(), order_.end(), 0);
+  if (shuffle_)
+    std::shuffle(order_.begin(), order_.end(), generator_);
+  if (bucketing_) {
+    if (shuffle_) {
+      std::stable_sort(order_.begin(), order_.end(),
+          [this](int a, int b) { return depth_[a] < depth_[b]; });
+    }else {
+      std::sort(order_.begin(), order_.end(),
+          [this](int a, int b) {
+            return depth_[a] < depth_[b] ||
+                   (depth_[a] == depth_[b] && parents_[a].size() < parents_[b].size());
+          });
+    }
+  }
+  for (int i = 0; order_.size() < num_batches()*batch_size_; i++)
+    order_.push_back(order_[i]);
+  batch_order_.resize(num_batches());
+  std::iota(batch_order_.begin(), batch_order_.end(), 0);
+  if (shuffle_)
+    std::shuffle(batch_order_.begin(), batch_order_.end(), generator_);
+  next_batch_ = 0;
+}
+
+const vector<int>& GraphBatchSampler::NextBatch() {
+  if (order_.empty() || next_batch_ == num_batches())
+    NewEpoch();
+  auto begin = order_.begin() + batch_order_[next_batch_++]*batch_size_;
+  batch_.assign(begin, begin + batch_size_);
+  return batch_;
+}
+
+void GraphBatchSampler::FillGraph(const vector<int>& batch, int* graph) const {
+  CHECK(batch.size() == batch_size_);
+  std::fill(graph, graph + batch_size_*max_length_, -1);
+  for (int i = 0; i < batch_size_; i++) {
+    const vector<int>& parents = parents_.at(batch[i]);
+    std::copy(parents.begin(), parents.end(), graph + i*max_length_);
+  }
+}
+
+int GraphBatchSampler::FillRaggedGraph(const vector<int>& batch, int* graph) const {
+  CHECK(batch.size() == batch_size_);
+  graph[0] = batch_size_;
+  int* offsets = graph + 1;
+  int* parents = offsets + batch_size_ + 1;
+  offsets[0] = 0;
+  for (int i = 0; i < batch_size_; i++) {
+    const vector<int>& sample = parents_.at(batch[i]);
+    std::copy(sample.begin(), sample.end(), parents + offsets[i]);
+    offsets[i+1] = offsets[i] + sample.size();
+  }
+  return batch_size_ + 2 + offsets[batch_size_];
+}
+
+int GraphBatchSampler::Rounds(const vector<int>& batch) const {
+  int rounds = 0;
+  for (int id : batch)
+    rounds = std::max(rounds, depth_[id]);
+  return rounds;
+}
+
+int GraphBatchSampler::Jobs(const vector<int>& batch) const {
+  int jobs = 0;
+  for (int id : batch)
+    jobs += (depth_[id] > 0) ? parents_[id].size() : 0;
+  return jobs;
+}
+
+float GraphBatchSampler::JobsPerRound(const vector<int>& batch) const {
+  int rounds = Rounds(batch);
+  return (rounds > 0) ? (float)Jobs(batch)/rounds : 0.f;
+}
+
+float GraphBatchSampler::RoundsPerBatch() const {
+  CHECK(!order_.empty());
+  int64_t rounds = 0;
+  for (int b = 0; b < num_batches(); b++) {
+    vector<int> batch(order_.begin() + b*batch_size_, order_.begin() + (b+1)*batch_size_);
+    rounds += Rounds(batch);
+  }
+  return (float)rounds/num_batches();
+}
+
+float GraphBatchSampler::AverageJobsPerRound() const {
+  CHECK(!order_.empty());
+  int64_t rounds = 0, jobs = 0;
+  for (int b = 0; b < num_batches(); b++) {
+    vector<int> batch(order_.begin() + b*batch_size_, order_.begin() + (b+1)*batch_size_);
+    rounds += Rounds(batch);
+    jobs += Jobs(batch);
+  }
+  return (rounds > 0) ? (float)jobs/rounds : 0.f;
+}
+
+void GraphBatchSampler::LogStats() const {
+  CHECK(!order_.empty()) << "no epoch is sampled yet";
+  LOG(INFO) << num_samples() << " samples in " << num_batches()
+            << " batches of " << batch_size_
+            << (bucketing_ ? ", bucketed by depth" : "")
+            << (shuffle_ ? ", shuffled" : "")
+            << ":\t" << RoundsPerBatch() << " rounds per batch\t"
+            << AverageJobsPerRound() << " jobs per round";
+}
@@ -0,0 +1,66 @@
+#ifndef CAVS_FRONTEND_CXX_GRAPH_SAMPLER_H_
+#define CAVS_FRONTEND_CXX_GRAPH_SAMPLER_H_
+
+#include <vector>
+#include <random>
+
+//The batch scheduler runs as many rounds as the deepest graph of a batch,
+//so the sampler groups the samples of similar depth into the same batch.
+//The samples are sorted by (depth, vertices) and cut into batches,
+//with shuffling the samples of one depth are mixed instead,
+//and the batches are visited in a random order every epoch.
+//
+//The graphs are given in the parent-idx form of the graph placeholder,
+//the other inputs of a sample are looked up by the ids of NextBatch().
+class GraphBatchSampler {
+ public:
+  GraphBatchSampler(int batch_size, int max_length,
+                    bool bucketing = true, bool shuffle = false,
+                    unsigned seed = 0);
+  //returns the id of the sample
+  int AddSample(const std::vector<int>& parents);
+  //the ids of the samples in the next batch,
+  //the last batch of an epoch is filled up from the first samples
+  const std::vector<int>& NextBatch();
+  //writes the [batch_size, max_length] graph of the batch,
+  //the unused vertices are -1
+  void FillGraph(const std::vector<int>& batch, int* graph) const;
+  //the same batch in the ragged form, {batch, offsets, parents...},
+  //returns the words written out of ragged_capacity()
+  int FillRaggedGraph(const std::vector<int>& batch, int* graph) const;
+  inline int ragged_capacity() const {
+    return batch_size_ + 2 + batch_size_*max_length_;
+  }
+
+  inline int num_samples() const { return parents_.size(); }
+  inline int num_batches() const {
+    return (num_samples() + batch_size_ - 1) / batch_size_;
+  }
+  inline int depth(int sample) const { return depth_[sample]; }
+  //the rounds the batch scheduler needs for a batch
+  //and the jobs each round has on average
+  int Rounds(const std::vector<int>& batch) const;
+  float JobsPerRound(const std::vector<int>& batch) const;
+  //over all the batches of an epoch
+  float RoundsPerBatch() const;
+  float AverageJobsPerRound() const;
+  void LogStats() const;
+
+ private:
+  void NewEpoch();
+  int Jobs(const std::vector<int>& batch) const;
+  int batch_size_;
+  int max_length_;
+  bool bucketing_;
+  bool shuffle_;
+  std::default_random_engine generator_;
+  std::vector<std::vector<int>> parents_;
+  std::vector<int> depth_;
+  //the samples of the epoch, batch b is [b*batch_size, (b+1)*batch_size)
+  std::vector<int> order_;
+  std::vector<int> batch_order_;
+  int next_batch_;
+  std::vector<int> batch_;
+};
+
+#endif
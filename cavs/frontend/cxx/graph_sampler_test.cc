@@ -0,0 +1,82 @@
+#include "cavs/frontend/cxx/graph_sampler.h"
+#include "cavs/midend/graph_scheduler.h"
+#include "cavs/midend/allocator.h"
+#include "cavs/util/logging.h"
+
+#include <stdlib.h>
+
+using namespace midend;
+using std::vector;
+
+//a random tree of n vertices numbered so that the root comes last,
+//half of them are grown as a chain to get skewed depths
+vector<int> RandomTree(int n) {
+  vector<int> parents(n, -1);
+  bool chain = (rand() % 2 == 0);
+  for (int v = n-2; v >= 0; v--)
+    parents[v] = chain ? v+1 : v+1 + rand() % (n-1-v);
+  return parents;
+}
+
+//the rounds reported for a batch are the ones the scheduler runs
+void CheckRounds(const GraphBatchSampler& sampler, const vector<int>& batch,
+    int batch_size, int max_length) {
+  Tensor graph("graph", GetAllocator("CPU"), DT_INT32,
+               TensorShape({batch_size, max_length}));
+  sampler.FillGraph(batch, graph.mutable_data<int>());
+  BatchGraphScheduler gs;
+  gs.LoadGraph(graph);
+  gs.Initialize();
+  int rounds = 0, jobs = 0;
+  while (!gs.Terminate()) {
+    rounds++;
+    jobs += gs.GetJobId().size();
+    gs.ActivateNext();
+  }
+  CHECK(rounds == sampler.Rounds(batch)) << rounds << "\t" << sampler.Rounds(batch);
+  CHECK(jobs == (int)(sampler.JobsPerRound(batch)*rounds + 0.5f));
+
+  //the ragged form holds the same graphs
+  Tensor ragged("ragged", GetAllocator("CPU"), DT_INT32,
+                TensorShape({sampler.ragged_capacity()}));
+  sampler.FillRaggedGraph(batch, ragged.mutable_data<int>());
+  BatchGraphScheduler rs;
+  CHECK(rs.LoadGraph(ragged) == gs.total_length());
+  rs.Initialize();
+  int ragged_rounds = 0;
+  for (; !rs.Terminate(); rs.ActivateNext())
+    ragged_rounds++;
+  CHECK(ragged_rounds == rounds) << ragged_rounds << "\t" << rounds;
+}
+
+int main() {
+  const int BATCH = 16;
+  const int MAX_LENGTH = 40;
+  const int SAMPLES = 1000;
+  srand(1);
+  vector<vector<int>> trees;
+  for (int i = 0; i < SAMPLES; i++)
+    trees.push_back(RandomTree(1 + rand() % MAX_LENGTH));
+
+  float rounds[2], jobs[2];
+  for (bool bucketing : {false, true}) {
+    GraphBatchSampler sampler(BATCH, MAX_LENGTH, bucketing, true, 7);
+    for (auto& t : trees)
+      sampler.AddSample(t);
+    vector<int> seen(SAMPLES, 0);
+    for (int b = 0; b < sampler.num_batches(); b++) {
+      const vector<int>& batch = sampler.NextBatch();
+      for (int id : batch)
+        seen[id]++;
+      CheckRounds(sampler, batch, BATCH, MAX_LENGTH);
+    }
+    //every sample is visited once an epoch, the last batch wraps around
+    for (int i = 0; i < SAMPLES; i++)
+      CHECK(seen[i] >= 1 && seen[i] <= 2) << i << "\t" << seen[i];
+    sampler.LogStats();
+    rounds[bucketing] = sampler.RoundsPerBatch();
+    jobs[bucketing] = sampler.AverageJobsPerRound();
+  }
+  CHECK(rounds[1] < rounds[0] && jobs[1] > jobs[0]);
+  return 0;
+}
@@ -0,0 +1,405 @@
+#include "cavs/frontend/cxx/graph_server.h"
+#include "cavs/util/logging.h"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <algorithm>
+
+using std::vector;
+using std::string;
+using std::mutex;
+using std::unique_lock;
+using std::lock_guard;
+
+namespace {
+
+//the latencies kept for the percentiles
+const int LATENCY_SAMPLES = 1 << 14;
+
+bool ReadFull(int fd, void* buf, size_t size) {
+  char* p = (char*)buf;
+  while (size > 0) {
+    ssize_t n = read(fd, p, size);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    p += n;
+    size -= n;
+  }
+  return true;
+}
+
+bool WriteFull(int fd, const void* buf, size_t size) {
+  const char* p = (const char*)buf;
+  while (size > 0) {
+    ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    p += n;
+    size -= n;
+  }
+  return true;
+}
+
+sockaddr_un SocketAddress(const string& path) {
+  sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  CHECK(path.length() < sizeof(addr.sun_path)) << path;
+  strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path)-1);
+  return addr;
+}
+
+} //namespace
+
+GraphBatchServer::GraphBatchServer(BatchRunner runner, int max_batch,
+    int max_vertices, int input_width, int output_width, int timeout_us)
+  : runner_(runner), max_batch_(max_batch), max_vertices_(max_vertices),
+    input_width_(input_width), output_width_(output_width),
+    timeout_us_(timeout_us), stopping_(false), listen_fd_(-1),
+    requests_(0), batches_(0) {
+  CHECK(runner_);
+  CHECK(max_batch_ > 0 && max_vertices_ > 0);
+  CHECK(input_width_ > 0 && output_width_ > 0 && timeout_us_ >= 0);
+  graph_.resize(ragged_capacity());
+  inputs_.resize(max_vertices_*input_width_);
+  outputs_.resize(max_vertices_*output_width_);
+  ResetStats();
+  dispatcher_ = std::thread(&GraphBatchServer::Dispatch, this);
+}
+
+GraphBatchServer::~GraphBatchServer() {
+  Stop();
+}
+
+//the scheduler CHECKs the same, so a bad request
+//would take down the server with every queued caller
+bool GraphBatchServer::ValidRequest(const vector<int>& parents, string* reason) {
+  const int n = parents.size();
+  int roots = 0;
+  for (int v = 0; v < n; v++) {
+    const int p = parents[v];
+    if (p < -1 || p >= n || p == v) {
+      *reason = "illegal parent " + std::to_string(p) + " of vertex " + std::to_string(v);
+      return false;
+    }
+    roots += (p < 0);
+  }
+  if (roots == 0) {
+    *reason = "no root";
+    return false;
+  }
+  //walks up from every vertex, 1 marks the current path and 2 a vertex
+  //known to reach a root
+  vector<char> state(n, 0);
+  for (int v = 0; v < n; v++) {
+    int u = v;
+    while (u >= 0 && state[u] == 0) {
+      state[u] = 1;
+      u = parents[u];
+    }
+    if (u >= 0 && state[u] == 1) {
+      *reason = "a cycle through vertex " + std::to_string(u);
+      return false;
+    }
+    for (u = v; u >= 0 && state[u] == 1; u = parents[u])
+      state[u] = 2;
+  }
+  return true;
+}
+
+//the vertex becomes a leaf, the padding root is only there to be its parent
+vector<int> GraphBatchServer::PaddedParents(const vector<int>& parents) {
+  vector<char> has_child(parents.size(), 0);
+  for (int p : parents) {
+    if (p >= 0) has_child[p] = 1;
+  }
+  vector<int> padded(parents);
+  for (int v = 0; v < parents.size(); v++) {
+    if (parents[v] < 0 && !has_child[v]) {
+      padded[v] = padded.size();
+      padded.push_back(-1);
+    }
+  }
+  return padded;
+}
+
+std::future<vector<float>> GraphBatchServer::Submit(
+    const vector<int>& parents, const vector<float>& inputs) {
+  CHECK(!parents.empty());
+  CHECK(inputs.size() == parents.size()*input_width_)
+    << inputs.size() << "\t" << parents.size();
+  string reason;
+  CHECK(ValidRequest(parents, &reason)) << reason;
+  Request* req = new Request();
+  req->vertices = parents.size();
+  req->parents = PaddedParents(parents);
+  CHECK(req->parents.size() <= max_vertices_)
+    << req->parents.size() << "\t" << max_vertices_;
+  //the padding roots have zero inputs
+  req->inputs = inputs;
+  req->inputs.resize(req->parents.size()*input_width_, 0.f);
+  std::future<vector<float>> ret = req->response.get_future();
+  {
+    lock_guard<mutex> lock(mu_);
+    CHECK(!stopping_) << "the server is stopped";
+    req->arrival = Clock::now();
+    queue_.push_back(req);
+  }
+  cv_.notify_one();
+  return ret;
+}
+
+void GraphBatchServer::Dispatch() {
+  vector<Request*> batch;
+  while (true) {
+    {
+      unique_lock<mutex> lock(mu_);
+      cv_.wait(lock, [this]() { return stopping_ || !queue_.empty(); });
+      if (queue_.empty())
+        return;
+      //the oldest request decides how long the batch may wait
+      Clock::time_point deadline =
+        queue_.front()->arrival + std::chrono::microseconds(timeout_us_);
+      auto full = [this]() {
+        int vertices = 0;
+        for (int i = 0; i < queue_.size() && i < max_batch_; i++) {
+          vertices += queue_[i]->parents.size();
+          if (vertices > max_vertices_)
+            return true;
+        }
+        return queue_.size() >= max_batch_;
+      };
+      while (!stopping_ && !full() && Clock::now() < deadline)
+        cv_.wait_until(lock, deadline);
+      int vertices = 0;
+      while (!queue_.empty() && batch.size() < max_batch_ &&
+             vertices + queue_.front()->parents.size() <= max_vertices_) {
+        vertices += queue_.front()->parents.size();
+        batch.push_back(queue_.front());
+        queue_.pop_front();
+      }
+    }
+    RunBatch(&batch);
+    batch.clear();
+  }
+}
+
+void GraphBatchServer::RunBatch(vector<Request*>* batch) {
+  const int n = batch->size();
+  CHECK(n > 0 && n <= max_batch_);
+  graph_[0] = n;
+  int* offsets = graph_.data() + 1;
+  int* parents = offsets + n + 1;
+  offsets[0] = 0;
+  for (int i = 0; i < n; i++) {
+    const Request* req = (*batch)[i];
+    std::copy(req->parents.begin(), req->parents.end(), parents + offsets[i]);
+    std::copy(req->inputs.begin(), req->inputs.end(),
+              inputs_.begin() + offsets[i]*input_width_);
+    offsets[i+1] = offsets[i] + req->parents.size();
+  }
+  runner_(graph_.data(), inputs_.data(), outputs_.data());
+
+  Clock::time_point now = Clock::now();
+  {
+    lock_guard<mutex> lock(stats_mu_);
+    for (auto* req : *batch) {
+      float us = std::chrono::duration<float, std::micro>(now - req->arrival).count();
+      if (latencies_us_.size() < LATENCY_SAMPLES)
+        latencies_us_.push_back(us);
+      else
+        latencies_us_[requests_ % LATENCY_SAMPLES] = us;
+      requests_++;
+    }
+    batches_++;
+    stats_end_ = now;
+  }
+  for (int i = 0; i < n; i++) {
+    Request* req = (*batch)[i];
+    req->response.set_value(vector<float>(
+          outputs_.begin() + offsets[i]*output_width_,
+          outputs_.begin() + (offsets[i] + req->vertices)*output_width_));
+    delete req;
+  }
+}
+
+void GraphBatchServer::Listen(const string& socket_path) {
+  CHECK(listen_fd_ < 0) << "already listening on " << socket_path_;
+  sockaddr_un addr = SocketAddress(socket_path);
+  unlink(socket_path.c_str());
+  CHECK((listen_fd_ = socket(AF_UNIX, SOCK_STREAM, 0)) >= 0) << strerror(errno);
+  CHECK(bind(listen_fd_, (sockaddr*)&addr, sizeof(addr)) == 0)
+    << socket_path << ": " << strerror(errno);
+  CHECK(listen(listen_fd_, 128) == 0) << strerror(errno);
+  socket_path_ = socket_path;
+  acceptor_ = std::thread([this]() {
+    int fd;
+    while ((fd = accept(listen_fd_, NULL, NULL)) >= 0 || errno == EINTR) {
+      if (fd < 0)
+        continue;
+      unique_lock<mutex> lock(mu_);
+      ReapConnections(&lock);
+      connection_fds_.push_back(fd);
+      connections_.emplace_back(&GraphBatchServer::Serve, this, fd);
+    }
+  });
+  LOG(INFO) << "Serving graphs on " << socket_path_;
+}
+
+void GraphBatchServer::ReapConnections(unique_lock<mutex>* lock) {
+  vector<std::thread> done;
+  for (int i = 0; i < connections_.size(); ) {
+    if (connection_fds_[i] < 0) {
+      done.push_back(std::move(connections_[i]));
+      connections_[i] = std::move(connections_.back());
+      connection_fds_[i] = connection_fds_.back();
+      connections_.pop_back();
+      connection_fds_.pop_back();
+    }else {
+      i++;
+    }
+  }
+  //they only have to return, but not with the lock held
+  lock->unlock();
+  for (auto& t : done)
+    t.join();
+  lock->lock();
+}
+
+int GraphBatchServer::connection_threads() {
+  lock_guard<mutex> lock(mu_);
+  return connections_.size();
+}
+
+void GraphBatchServer::Serve(int fd) {
+  int n;
+  vector<int> parents;
+  vector<float> inputs;
+  string reason;
+  while (ReadFull(fd, &n, sizeof(int))) {
+    if (n <= 0 || n > max_vertices_) {
+      LOG(WARNING) << "Dropping a connection asking for " << n << " vertices";
+      break;
+    }
+    parents.resize(n);
+    inputs.resize(n*input_width_);
+    if (!ReadFull(fd, parents.data(), n*sizeof(int)) ||
+        !ReadFull(fd, inputs.data(), inputs.size()*sizeof(float)))
+      break;
+    if (!ValidRequest(parents, &reason)) {
+      LOG(WARNING) << "Dropping a connection sending an illegal graph: " << reason;
+      break;
+    }
+    if (PaddedParents(parents).size() > max_vertices_) {
+      LOG(WARNING) << "Dropping a connection asking for " << n
+                   << " vertices and their padding";
+      break;
+    }
+    vector<float> outputs = Submit(parents, inputs).get();
+    if (!WriteFull(fd, outputs.data(), outputs.size()*sizeof(float)))
+      break;
+  }
+  lock_guard<mutex> lock(mu_);
+  for (auto& c : connection_fds_) {
+    if (c == fd)
+      c = -1;
+  }
+  close(fd);
+}
+
+void GraphBatchServer::Stop() {
+  if (listen_fd_ >= 0) {
+    //the front end goes first, its pending requests are still answered
+    shutdown(listen_fd_, SHUT_RDWR);
+    acceptor_.join();
+    close(listen_fd_);
+    listen_fd_ = -1;
+    {
+      lock_guard<mutex> lock(mu_);
+      for (int fd : connection_fds_) {
+        if (fd >= 0)
+          shutdown(fd, SHUT_RDWR);
+      }
+    }
+    for (auto& t : connections_)
+      t.join();
+    connections_.clear();
+    connection_fds_.clear();
+    unlink(socket_path_.c_str());
+  }
+  {
+    lock_guard<mutex> lock(mu_);
+    stopping_ = true;
+  }
+  cv_.notify_all();
+  if (dispatcher_.joinable())
+    dispatcher_.join();
+}
+
+GraphBatchServer::Stats GraphBatchServer::GetStats() const {
+  lock_guard<mutex> lock(stats_mu_);
+  Stats s = {requests_, batches_, 0.f, 0.f, 0.f, 0.f};
+  if (s.requests == 0)
+    return s;
+  vector<float> sorted(latencies_us_);
+  const int n = sorted.size();
+  std::nth_element(sorted.begin(), sorted.begin() + (n-1)*50/100, sorted.end());
+  s.p50_us = sorted[(n-1)*50/100];
+  std::nth_element(sorted.begin(), sorted.begin() + (n-1)*99/100, sorted.end());
+  s.p99_us = sorted[(n-1)*99/100];
+  float seconds = std::chrono::duration<float>(stats_end_ - stats_begin_).count();
+  s.requests_per_second = (seconds > 0) ? s.requests/seconds : 0.f;
+  s.samples_per_batch = (float)s.requests/batches_;
+  return s;
+}
+
+void GraphBatchServer::ResetStats() {
+  lock_guard<mutex> lock(stats_mu_);
+  latencies_us_.clear();
+  requests_ = 0;
+  batches_ = 0;
+  stats_begin_ = stats_end_ = Clock::now();
+}
+
+void GraphBatchServer::LogStats() const {
+  Stats s = GetStats();
+  LOG(INFO) << "Served " << s.requests << " requests in " << s.batches
+            << " batches(at most " << max_batch_ << ", "
+            << timeout_us_ << "us timeout):\t"
+            << s.samples_per_batch << " samples per batch\t"
+            << "p50 " << s.p50_us << "us\tp99 " << s.p99_us << "us\t"
+            << s.requests_per_second << " requests/s";
+}
+
+GraphBatchClient::GraphBatchClient(const string& socket_path,
+    int input_width, int output_width)
+  : input_width_(input_width), output_width_(output_width) {
+  sockaddr_un addr = SocketAddress(socket_path);
+  CHECK((fd_ = socket(AF_UNIX, SOCK_STREAM, 0)) >= 0) << strerror(errno);
+  CHECK(connect(fd_, (sockaddr*)&addr, sizeof(addr)) == 0)
+    << socket_path << ": " << strerror(errno);
+}
+
+GraphBatchClient::~GraphBatchClient() {
+  close(fd_);
+}
+
+vector<float> GraphBatchClient::Run(const vector<int>& parents,
+    const vector<float>& inputs) {
+  int n = parents.size();
+  CHECK(inputs.size() == n*input_width_);
+  CHECK(WriteFull(fd_, &n, sizeof(int)) &&
+        WriteFull(fd_, parents.data(), n*sizeof(int)) &&
+        WriteFull(fd_, inputs.data(), inputs.size()*sizeof(float)));
+  vector<float> outputs(n*output_width_);
+  CHECK(ReadFull(fd_, outputs.data(), outputs.size()*sizeof(float)))
+    << "the server closed the connection";
+  return outputs;
+}
@@ -0,0 +1,139 @@
+#ifndef CAVS_FRONTEND_CXX_GRAPH_SERVER_H_
+#define CAVS_FRONTEND_CXX_GRAPH_SERVER_H_
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <future>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <chrono>
+
+//Serves the requests of single graphs with batched forward passes.
+//A request is one sample in the parent-idx form, with input_width
+//values per vertex. The requests of many callers are queued and
+//coalesced into one batch once it has max_batch samples, once it would
+//outgrow max_vertices, or once the oldest request waited timeout_us.
+//The batch is handed to the runner in the ragged form of the graph
+//placeholder, {batch, offsets, parents...}, with the inputs packed in
+//the same vertex order. The runner writes output_width values for each
+//vertex(the Push outputs in the order of the ragged vertices),
+//and each caller gets the rows of its own sample back.
+//
+//A request must be a forest: the parents are in [-1, n) and not the vertex
+//itself, and there is no cycle. The scheduler never runs a vertex with
+//neither parent nor child, so such a vertex(a one-vertex sample, say) is
+//run as a leaf under a padding root, which counts against max_vertices.
+//
+//Listen() adds a unix-socket front end, one thread per connection.
+//A request is {int n, int parents[n], float inputs[n*input_width]},
+//the response is {float outputs[n*output_width]}.
+//A connection sending a malformed request is dropped.
+class GraphBatchServer {
+ public:
+  typedef std::function<void(const int* graph, const float* inputs,
+                             float* outputs)> BatchRunner;
+  GraphBatchServer(BatchRunner runner, int max_batch, int max_vertices,
+                   int input_width, int output_width, int timeout_us);
+  ~GraphBatchServer();
+  //thread-safe, the future is set once the batch of the request has run.
+  //the request must be valid(see ValidRequest)
+  std::future<std::vector<float>> Submit(const std::vector<int>& parents,
+                                         const std::vector<float>& inputs);
+  void Listen(const std::string& socket_path);
+  void Stop();
+  //the reason is set if the parents do not form a valid request
+  static bool ValidRequest(const std::vector<int>& parents, std::string* reason);
+  //the connection threads not joined yet,
+  //the finished ones are joined when the next connection is accepted
+  int connection_threads();
+
+  //the words of the ragged graph placeholder
+  inline int ragged_capacity() const { return max_batch_ + 2 + max_vertices_; }
+  inline int max_batch() const { return max_batch_; }
+  inline int timeout_us() const { return timeout_us_; }
+
+  //over the requests served since the last ResetStats(),
+  //the percentiles over the latest of them(see LATENCY_SAMPLES)
+  struct Stats {
+    int64_t requests;
+    int64_t batches;
+    float p50_us;
+    float p99_us;
+    float requests_per_second;
+    float samples_per_batch;
+  };
+  Stats GetStats() const;
+  void ResetStats();
+  void LogStats() const;
+
+ private:
+  typedef std::chrono::steady_clock Clock;
+  struct Request {
+    //the vertices of the caller, the padding roots follow them
+    int vertices;
+    std::vector<int> parents;
+    std::vector<float> inputs;
+    std::promise<std::vector<float>> response;
+    Clock::time_point arrival;
+  };
+  void Dispatch();
+  void RunBatch(std::vector<Request*>* batch);
+  void Serve(int fd);
+  //the parents with a padding root for each vertex with neither parent nor child
+  static std::vector<int> PaddedParents(const std::vector<int>& parents);
+  //joins the connection threads that are done, with mu_ held
+  void ReapConnections(std::unique_lock<std::mutex>* lock);
+
+  BatchRunner runner_;
+  const int max_batch_;
+  const int max_vertices_;
+  const int input_width_;
+  const int output_width_;
+  const int timeout_us_;
+
+  std::mutex mu_;
+  std::condition_variable cv_;
+  std::deque<Request*> queue_;
+  bool stopping_;
+  std::thread dispatcher_;
+  //the buffers of the batch being run, only touched by the dispatcher
+  std::vector<int> graph_;
+  std::vector<float> inputs_;
+  std::vector<float> outputs_;
+
+  //the front end
+  int listen_fd_;
+  std::string socket_path_;
+  std::thread acceptor_;
+  //a finished connection sets its fd to -1
+  std::vector<std::thread> connections_;
+  std::vector<int> connection_fds_;
+
+  mutable std::mutex stats_mu_;
+  //a ring of the latest latencies
+  std::vector<float> latencies_us_;
+  int64_t requests_;
+  int64_t batches_;
+  Clock::time_point stats_begin_;
+  Clock::time_point stats_end_;
+};
+
+//a blocking client of the unix-socket front end
+class GraphBatchClient {
+ public:
+  GraphBatchClient(const std::string& socket_path,
+                   int input_width, int output_width);
+  ~GraphBatchClient();
+  std::vector<float> Run(const std::vector<int>& parents,
+                         const std::vector<float>& inputs);
+
+ private:
+  int fd_;
+  const int input_width_;
+  const int output_width_;
+};
+
+#endif
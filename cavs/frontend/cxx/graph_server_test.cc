@@ -0,0 +1,219 @@
+#include "cavs/frontend/cxx/graph_server.h"
+#include "cavs/midend/graph_scheduler.h"
+#include "cavs/midend/allocator.h"
+#include "cavs/util/logging.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <random>
+#include <atomic>
+
+using namespace midend;
+using std::vector;
+using std::thread;
+
+const int MAX_BATCH = 64;
+const int MAX_LENGTH = 20;
+const int ROUND_US = 50;
+
+//a random tree of n vertices numbered so that the root comes last
+vector<int> RandomTree(std::default_random_engine* gen, int n) {
+  vector<int> parents(n, -1);
+  for (int v = n-2; v >= 0; v--)
+    parents[v] = v+1 + (*gen)() % (n-1-v);
+  return parents;
+}
+
+//each vertex outputs its input plus the outputs of its children
+vector<float> SubtreeSums(const int* parents, const float* inputs, int n) {
+  vector<float> out(inputs, inputs + n);
+  for (int v = 0; v < n; v++) {
+    if (parents[v] >= 0)
+      out[parents[v]] += out[v];
+  }
+  return out;
+}
+
+//the batched model: runs the rounds of the batch scheduler,
+//each round costs the same however many jobs it has
+class SubtreeSumRunner {
+ public:
+  SubtreeSumRunner(int capacity)
+    : graph_("graph", GetAllocator("CPU"), DT_INT32, TensorShape({capacity})) {}
+  void operator()(const int* graph, const float* inputs, float* outputs) {
+    const int batch = graph[0];
+    const int* offsets = graph + 1;
+    const int* parents = offsets + batch + 1;
+    CHECK(batch + 2 + offsets[batch] <= graph_.count());
+    memcpy(graph_.mutable_data<int>(), graph,
+           (batch + 2 + offsets[batch])*sizeof(int));
+    const int vertices = scheduler_.LoadGraph(graph_);
+    CHECK(vertices == offsets[batch]);
+    children_.assign(vertices, vector<int>());
+    for (int i = 0; i < batch; i++) {
+      for (int v = offsets[i]; v < offsets[i+1]; v++) {
+        if (parents[v] >= 0)
+          children_[offsets[i] + parents[v]].push_back(v);
+      }
+    }
+    scheduler_.Initialize();
+    for (; !scheduler_.Terminate(); scheduler_.ActivateNext()) {
+      for (int v : scheduler_.GetJobId()) {
+        outputs[v] = inputs[v];
+        for (int c : children_[v])
+          outputs[v] += outputs[c];
+      }
+      std::this_thread::sleep_for(std::chrono::microseconds(ROUND_US));
+    }
+  }
+
+ private:
+  Tensor graph_;
+  BatchGraphScheduler scheduler_;
+  vector<vector<int>> children_;
+};
+
+GraphBatchServer* NewServer(SubtreeSumRunner* runner, int max_batch, int timeout_us) {
+  return new GraphBatchServer(
+      [runner](const int* g, const float* i, float* o) { (*runner)(g, i, o); },
+      max_batch, max_batch*MAX_LENGTH, 1, 1, timeout_us);
+}
+
+//closed-loop callers, each waits for its answer before the next request
+void RunCallers(GraphBatchServer* server, const std::string& socket_path,
+    int callers, int requests) {
+  std::atomic<int> checked(0);
+  vector<thread> threads;
+  for (int c = 0; c < callers; c++) {
+    threads.emplace_back([&, c]() {
+      std::default_random_engine gen(c);
+      GraphBatchClient* client = socket_path.empty() ? NULL :
+        new GraphBatchClient(socket_path, 1, 1);
+      for (int r = 0; r < requests; r++) {
+        //the single vertices are padded by the server
+        vector<int> parents = RandomTree(&gen, 1 + gen() % MAX_LENGTH);
+        vector<float> inputs(parents.size());
+        for (auto& x : inputs)
+          x = gen() % 10;
+        vector<float> out = client ? client->Run(parents, inputs) :
+                                     server->Submit(parents, inputs).get();
+        CHECK(out == SubtreeSums(parents.data(), inputs.data(), parents.size()))
+          << "caller " << c << " request " << r;
+        checked++;
+      }
+      delete client;
+    });
+  }
+  for (auto& t : threads)
+    t.join();
+  CHECK(checked == callers*requests);
+}
+
+//the requests the scheduler would CHECK-fail on drop their connection,
+//the server goes on serving the others
+void TestIllegalRequests(GraphBatchServer* server, const std::string& socket_path) {
+  vector<vector<int>> illegal = {
+    {1, 2, -1, 4},    //out of range
+    {1, 1, -1},       //self-parent
+    {1, 2, 0},        //no root
+    {-1, 2, 1, 0},    //cycle 1 -> 2 -> 1
+  };
+  sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path)-1);
+  for (auto& parents : illegal) {
+    std::string reason;
+    CHECK(!GraphBatchServer::ValidRequest(parents, &reason));
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    CHECK(fd >= 0 && connect(fd, (sockaddr*)&addr, sizeof(addr)) == 0);
+    int n = parents.size();
+    vector<float> inputs(n, 1.f);
+    CHECK(write(fd, &n, sizeof(int)) == sizeof(int));
+    CHECK(write(fd, parents.data(), n*sizeof(int)) == n*sizeof(int));
+    CHECK(write(fd, inputs.data(), n*sizeof(float)) == n*sizeof(float));
+    float out;
+    CHECK(read(fd, &out, sizeof(float)) == 0) << "no answer expected: " << reason;
+    close(fd);
+  }
+  RunCallers(server, socket_path, 2, 10);
+  //the dropped connections are joined as new ones come in
+  CHECK(server->connection_threads() <= 2) << server->connection_threads();
+}
+
+//the vertices with neither parent nor child are answered like leaves
+void TestLoneVertices(GraphBatchServer* server, const std::string& socket_path) {
+  vector<vector<int>> lone = {
+    {-1},             //a one-vertex sample
+    {1, -1, -1},      //a lone root next to a tree
+    {-1, 2, -1, -1},  //two of them
+  };
+  GraphBatchClient client(socket_path, 1, 1);
+  for (auto& parents : lone) {
+    std::string reason;
+    CHECK(GraphBatchServer::ValidRequest(parents, &reason)) << reason;
+    vector<float> inputs(parents.size());
+    for (int v = 0; v < inputs.size(); v++)
+      inputs[v] = v + 1;
+    vector<float> expected = SubtreeSums(parents.data(), inputs.data(), parents.size());
+    CHECK(client.Run(parents, inputs) == expected);
+    CHECK(server->Submit(parents, inputs).get() == expected);
+  }
+}
+
+int main() {
+  SubtreeSumRunner runner(MAX_BATCH + 2 + MAX_BATCH*MAX_LENGTH);
+  {
+    GraphBatchServer* server = NewServer(&runner, 16, 1000);
+    RunCallers(server, "", 8, 100);
+    GraphBatchServer::Stats s = server->GetStats();
+    CHECK(s.requests == 800 && s.samples_per_batch > 1.f) << s.samples_per_batch;
+    delete server;
+    LOG(INFO) << "In-process requests passed";
+  }
+  {
+    //more requests than the latencies kept for the percentiles
+    GraphBatchServer* server = NewServer(&runner, MAX_BATCH, 0);
+    RunCallers(server, "", 32, 600);
+    GraphBatchServer::Stats s = server->GetStats();
+    CHECK(s.requests == 32*600);
+    CHECK(s.p50_us > 0.f && s.p50_us <= s.p99_us) << s.p50_us << "\t" << s.p99_us;
+    delete server;
+  }
+  {
+    const std::string path = "/tmp/cavs_graph_server_" + std::to_string(getpid());
+    GraphBatchServer* server = NewServer(&runner, 16, 1000);
+    server->Listen(path);
+    RunCallers(server, path, 4, 50);
+    CHECK(server->GetStats().requests == 200);
+    TestIllegalRequests(server, path);
+    CHECK(server->GetStats().requests == 220);
+    TestLoneVertices(server, path);
+    CHECK(server->GetStats().requests == 226);
+    delete server;
+    CHECK(access(path.c_str(), F_OK) != 0);
+    LOG(INFO) << "Unix-socket requests passed";
+  }
+
+  //the knobs: a batch of one runs every request alone,
+  //larger batches trade the wait for the throughput
+  float unbatched = 0.f, batched = 0.f;
+  for (int max_batch : {1, 16, MAX_BATCH}) {
+    for (int timeout_us : {0, 500, 2000}) {
+      GraphBatchServer* server = NewServer(&runner, max_batch, timeout_us);
+      RunCallers(server, "", 32, 50);
+      server->LogStats();
+      float rps = server->GetStats().requests_per_second;
+      if (max_batch == 1)
+        unbatched = std::max(unbatched, rps);
+      else
+        batched = std::max(batched, rps);
+      delete server;
+    }
+  }
+  CHECK(batched > 2*unbatched) << batched << "\t" << unbatched;
+  return 0;
+}
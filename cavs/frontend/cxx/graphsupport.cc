@@ -7,6 +7,26 @@
 using std::string;
 using std::vector;
 
+namespace {
+
+//returns the shape of what the function pushes
+vector<int> AddFunction(const FunctionDef& func) {
+  VLOG(V_DEBUG) << func.DebugString();
+  string serialization;
+  func.SerializeToString(&serialization);
+
+  int *dim = NULL;
+  size_t dim_length = 0;
+  C_AddFunction(serialization.c_str(), serialization.length(),
+                &dim, &dim_length);
+  CHECK(dim_length > 0);
+  vector<int> shape(dim, dim+dim_length);
+  free(dim);
+  return shape;
+}
+
+} //namespace
+
 Sym GraphSupport::Output() {
   VLOG(V_DEBUG) << "Generating node functions";
   vector<int> node_shape;
@@ -14,18 +34,19 @@ Sym GraphSupport::Output() {
   {
     FuncConf::FuncDefineBegin("Node");
     this->Node();
-    FunctionDef func = FuncConf::FuncDefineEnd("Node");
-    VLOG(V_DEBUG) << func.DebugString();
-    string serialization;
-    func.SerializeToString(&serialization);
-
-    int *dim = NULL;
-    size_t dim_length = 0;
-    C_AddFunction(serialization.c_str(), serialization.length(),
-                  &dim, &dim_length);
-    CHECK(dim_length > 0);
-    node_shape = vector<int>(dim, dim+dim_length);
-    free(dim);
+    node_shape = AddFunction(FuncConf::FuncDefineEnd("Node"));
+  }
+
+  {
+    FuncConf::FuncDefineBegin("Leaf");
+    this->Leaf();
+    FunctionDef func = FuncConf::FuncDefineEnd("Leaf");
+    //not overridden
+    if (func.ops_size() > 0) {
+      vector<int> leaf_shape = AddFunction(func);
+      CHECK(leaf_shape == node_shape)
+        << "Leaf() and Node() must push the same shape";
+    }
   }
 
   CHECK(!node_shape.empty());
@@ -60,6 +81,20 @@ Sym GraphSupport::Gather(int child,
   return Sym(def);
 }
 
+Sym GraphSupport::GatherReduce(const std::string& reduce,
+    const std::vector<int>& shape) {
+  CHECK(!shape.empty());
+  CHECK(reduce == "Sum" || reduce == "Mean") << reduce;
+  OpDef def = OpDefBuilder("Gather")
+                .Dtype(raw_vertex_.type())
+                .Device(raw_vertex_.device())
+                .Shape(shape)
+                .AttrSingle("Child", 0)
+                .AttrSingle("Reduce", reduce)
+                .Finalize();
+  return Sym(def);
+}
+
 Sym GraphSupport::Pull(int offset,
     const std::vector<int>& shape) {
   OpDef def = OpDefBuilder("Pull")
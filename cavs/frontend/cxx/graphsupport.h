@@ -6,17 +6,30 @@
 #include <vector>
 #include <string>
 
+//graph_ph holds the structure of a batch of graphs, either
+//the parent ids of each vertex([batch, max_length], trees and chains),
+//(child, parent) edge pairs([batch, max_edges, 2], any dag) or
+//the parent ids of the samples packed with their offsets([capacity], forests),
+//see GraphSchedulerBase::LoadGraph for the layouts
 class GraphSupport {
  public:
   GraphSupport(const Sym& graph_ph, const Sym& vertex_ph) : 
     raw_graph_(graph_ph), raw_vertex_(vertex_ph) {}
-  //virtual void Inode() = 0; 
-  //virtual void Leaf() = 0;
+  //the function of every vertex
   virtual void Node() = 0;
+  //the function of the vertices without children, optional.
+  //Once it is defined, the rounds made up of such vertices run it
+  //instead of Node() in both directions, so the leaves skip the
+  //Gathers and all the work on the zeros they return.
+  //It must Scatter and Push the same shapes as Node().
+  virtual void Leaf() {}
   Sym Output();
 
  protected:
   Sym Gather(int child, const std::vector<int>& shape);
+  //all the children of a vertex reduced into one row,
+  //reduce is "Sum" or "Mean", a vertex without children gets zeros
+  Sym GatherReduce(const std::string& reduce, const std::vector<int>& shape);
   Sym Pull(int offset, const std::vector<int>& shape);
   void Push(const Sym& s);
   void Scatter(const Sym& s);
@@ -6,10 +6,9 @@ using std::vector;
 using std::initializer_list;
 using std::pair;
 
-void Session::Run(vector<Sym> outputs,
-    const initializer_list<pair<Sym&, void*>>& feed) {
-  vector<C_Tensor*> input_tensor;
-  vector<const char*> input_name;
+void Session::Feed(const initializer_list<pair<Sym&, void*>>& feed,
+    vector<const char*>* input_name,
+    vector<C_Tensor*>* input_tensor) {
   for (auto& input : feed) {
     const Sym& sym = input.first;
     void* data = input.second;
@@ -22,9 +21,23 @@ void Session::Run(vector<Sym> outputs,
     }
     C_Tensor* ft = feed_map_[sym.output(0)];
     memcpy(C_TensorData(ft), data, C_TensorSize(ft));
-    input_tensor.push_back(ft);
-    input_name.push_back(sym.output(0).data());
+    input_tensor->push_back(ft);
+    input_name->push_back(sym.output(0).data());
   }
+}
+
+void Session::Prefetch(const initializer_list<pair<Sym&, void*>>& feed) {
+  vector<C_Tensor*> input_tensor;
+  vector<const char*> input_name;
+  Feed(feed, &input_name, &input_tensor);
+  C_Prefetch(s_, input_name.data(), input_tensor.data(), input_name.size());
+}
+
+void Session::Run(vector<Sym> outputs,
+    const initializer_list<pair<Sym&, void*>>& feed) {
+  vector<C_Tensor*> input_tensor;
+  vector<const char*> input_name;
+  Feed(feed, &input_name, &input_tensor);
 
   vector<C_Tensor*> output_tensor;
   vector<const char*> output_name;
@@ -23,8 +23,21 @@ class Session {
     std::vector<Sym> out = {output};
     Run(out, feed);
   }
+  //stages the feed of a later Run(outputs) without feed,
+  //the session has to be created with OPT_PIPELINING
+  void Prefetch(const std::initializer_list<std::pair<Sym&, void*>>& feed);
+  //how well the graph rounds batched the vertices since the last reset
+  C_GraphStats GraphStats(bool backward = false) {
+    C_GraphStats stats;
+    C_GetGraphStats(s_, backward, &stats);
+    return stats;
+  }
+  void ResetGraphStats() { C_ResetGraphStats(s_); }
 
  private:
+  void Feed(const std::initializer_list<std::pair<Sym&, void*>>& feed,
+            std::vector<const char*>* names,
+            std::vector<C_Tensor*>* tensors);
   C_Session* s_;
   std::unordered_map<string, C_Tensor*> feed_map_;
 };
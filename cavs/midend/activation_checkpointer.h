@@ -0,0 +1,99 @@
+#ifndef CAVS_MIDEND_ACTIVATION_CHECKPOINTER_H_
+#define CAVS_MIDEND_ACTIVATION_CHECKPOINTER_H_
+
+#include "cavs/midend/node.h"
+#include "cavs/util/op_util.h"
+
+#include <list>
+#include <unordered_set>
+
+namespace midend {
+
+//The checkpoints of a vertex function are the inputs of its rounds,
+//the gathered children states and the pulled rows, kept for all the vertices.
+//The batched activations computed from them only hold one round,
+//and each backward round recomputes them for its own rows
+//before its gradients read them.
+class ActivationCheckpointer {
+ public:
+  ActivationCheckpointer(const std::list<Node*>& nodes,
+                         const std::unordered_set<const Node*>& hoisted,
+                         std::list<Node*>* recomputed) {
+    CHECK(!nodes.empty());
+    CHECK(recomputed->empty());
+    Scope* s = nodes.front()->scope();
+
+    //the weight gradients and the gradients of the hoisted nodes
+    //are computed over the rows of all the rounds once they are done
+    auto read_out_of_rounds = [&](const Edge* e) {
+      for (Node* dst : e->dst()) {
+        if (dst->scope() == s)
+          continue;
+        for (Edge* grad : dst->output()) {
+          if (!grad->isGradient())
+            continue;
+          const Edge* forward_e = dst->scope()->FindEdge(GetOriginName(grad->name()));
+          CHECK(forward_e);
+          if (!forward_e->IsDynamicEnabled())
+            return true;
+          for (Node* src : forward_e->src()) {
+            if (hoisted.find(src) != hoisted.end())
+              return true;
+          }
+        }
+      }
+      return false;
+    };
+
+    //a kept view keeps the tensor it views
+    std::unordered_set<const Node*> kept;
+    for (auto iter = nodes.rbegin(); iter != nodes.rend(); iter++) {
+      Node* n = *iter;
+      CHECK(n->scope() == s);
+      bool keep = (kept.find(n) != kept.end());
+      for (Edge* e : n->output())
+        keep |= read_out_of_rounds(e);
+      if (!keep)
+        continue;
+      kept.insert(n);
+      if (ShareMemory(n)) {
+        for (Node* src : n->input(0)->src(true))
+          kept.insert(src);
+      }
+    }
+
+    std::unordered_set<const Node*> moved;
+    for (Node* n : nodes) {
+      if (n->name() == "Gather" || n->name() == "Pull" ||
+          n->name() == "Scatter" || n->name() == "Push" ||
+          kept.find(n) != kept.end() || hoisted.find(n) != hoisted.end()) {
+        continue;
+      }
+      bool recompute = true;
+      if (ShareMemory(n)) {
+        recompute = (n->input(0)->src_size(true) > 0);
+        for (Node* src : n->input(0)->src(true))
+          recompute &= (moved.find(src) != moved.end());
+      }else {
+        for (Edge* e : n->output())
+          recompute &= e->IsDynamicEnabled();
+      }
+      if (recompute) {
+        VLOG(V_DEBUG) << "Recomputing " << n->debug_info();
+        moved.insert(n);
+        recomputed->push_back(n);
+      }
+    }
+  }
+
+ private:
+  static bool ShareMemory(const Node* n) {
+    CHECK(n->IsSingleNode());
+    return GetSingleArg<bool>(dynamic_cast<const SingleNode*>(n)->op_def(),
+                              "ShareMemory", false);
+  }
+};
+
+} //namespace midend
+
+#endif
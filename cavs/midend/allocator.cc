@@ -3,7 +3,18 @@
 #include "cavs/util/logging.h"
 #include "cavs/util/op_util.h"
 
+#include <gflags/gflags.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+DEFINE_string(cpu_allocator, "CPU",
+    "allocator of host tensors: CPU (malloc/free) or CPUCaching");
+DEFINE_int32(cpu_allocator_cache_mb, 1024,
+    "high-water mark of the bytes kept by the caching CPU allocator");
+
 using std::string;
+using std::vector;
 
 namespace midend {
 
@@ -29,6 +40,175 @@ Allocator* cpu_allocator() {
 
 REGISTER_STATIC_ALLOCATOR(DeviceTypeToString(CPU), cpu_allocator());
 
+namespace {
+
+//every block carries its size class in front of the user pointer
+const size_t BLOCK_HEADER = 64;
+const size_t MIN_BLOCK = 256;
+const int LOG_MIN_BLOCK = 8;
+const int CLASSES_PER_POWER = 4;
+//a thread keeps at most this many freed bytes for itself
+const size_t THREAD_CACHE_BYTES = 64 << 20;
+
+FORCE_INLINE void* UserPtr(void* block) {
+  return static_cast<char*>(block) + BLOCK_HEADER;
+}
+FORCE_INLINE void* BlockPtr(void* user) {
+  return static_cast<char*>(user) - BLOCK_HEADER;
+}
+FORCE_INLINE int& BlockClass(void* block) {
+  return *static_cast<int*>(block);
+}
+
+} //namespace
+
+struct CachingCPUAllocator::ThreadCache {
+  explicit ThreadCache(CachingCPUAllocator* a) : owner(a), bytes(0) {}
+  //hand everything to the shared bins when the thread exits
+  ~ThreadCache() {
+    for (int c = 0; c < bins.size(); c++) {
+      for (void* block : bins[c])
+        owner->PushShared(c, block);
+    }
+  }
+  CachingCPUAllocator* owner;
+  vector<vector<void*>> bins;
+  size_t bytes;
+};
+
+CachingCPUAllocator::CachingCPUAllocator()
+    : Allocator("CPUCaching", CPU),
+      shared_bytes_(0), bytes_cached_(0), hits_(0), misses_(0) {}
+
+size_t CachingCPUAllocator::ThreadCacheLimit() {
+  return std::min(THREAD_CACHE_BYTES, ((size_t)FLAGS_cpu_allocator_cache_mb << 20) / 4);
+}
+
+int CachingCPUAllocator::SizeClass(size_t nbytes) {
+  if (nbytes <= MIN_BLOCK) return 0;
+  //2^lg < nbytes <= 2^(lg+1)
+  int lg = 63 - __builtin_clzll(nbytes - 1);
+  size_t step = (1ull << lg) / CLASSES_PER_POWER;
+  int sub = (nbytes - (1ull << lg) + step - 1) / step;
+  return (lg - LOG_MIN_BLOCK)*CLASSES_PER_POWER + sub;
+}
+
+size_t CachingCPUAllocator::ClassSize(int size_class) {
+  if (size_class == 0) return MIN_BLOCK;
+  int lg = (size_class - 1) / CLASSES_PER_POWER + LOG_MIN_BLOCK;
+  int sub = (size_class - 1) % CLASSES_PER_POWER + 1;
+  return (1ull << lg) + sub*((1ull << lg) / CLASSES_PER_POWER);
+}
+
+CachingCPUAllocator::ThreadCache* CachingCPUAllocator::LocalCache() {
+  static thread_local ThreadCache cache(this);
+  CHECK(cache.owner == this);
+  return &cache;
+}
+
+void* CachingCPUAllocator::AllocateRaw(size_t nbytes) {
+  int c = SizeClass(nbytes);
+  ThreadCache* tc = LocalCache();
+  if (c < tc->bins.size() && !tc->bins[c].empty()) {
+    void* block = tc->bins[c].back();
+    tc->bins[c].pop_back();
+    tc->bytes -= ClassSize(c);
+    bytes_cached_ -= ClassSize(c);
+    hits_++;
+    return UserPtr(block);
+  }
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    if (c < bins_.size() && !bins_[c].empty()) {
+      void* block = bins_[c].back();
+      bins_[c].pop_back();
+      shared_bytes_ -= ClassSize(c);
+      bytes_cached_ -= ClassSize(c);
+      hits_++;
+      return UserPtr(block);
+    }
+  }
+  misses_++;
+  void* block = NULL;
+  CHECK(posix_memalign(&block, BLOCK_HEADER, BLOCK_HEADER + ClassSize(c)) == 0)
+      << "Out of host memory when allocating " << nbytes << " bytes";
+  BlockClass(block) = c;
+  return UserPtr(block);
+}
+
+void CachingCPUAllocator::DeallocateRaw(void* buf) {
+  void* block = BlockPtr(buf);
+  int c = BlockClass(block);
+  size_t size = ClassSize(c);
+  bytes_cached_ += size;
+  ThreadCache* tc = LocalCache();
+  if (tc->bytes + size <= ThreadCacheLimit()) {
+    if (tc->bins.size() <= c) tc->bins.resize(c+1);
+    tc->bins[c].push_back(block);
+    tc->bytes += size;
+  }else {
+    PushShared(c, block);
+  }
+}
+
+//only the shared bins count against the limit,
+//so a trim always gets them back under it
+void CachingCPUAllocator::PushShared(int size_class, void* block) {
+  std::lock_guard<std::mutex> lock(mu_);
+  if (bins_.size() <= size_class) bins_.resize(size_class+1);
+  bins_[size_class].push_back(block);
+  shared_bytes_ += ClassSize(size_class);
+  size_t high_water = (size_t)FLAGS_cpu_allocator_cache_mb << 20;
+  if (shared_bytes_ > high_water)
+    TrimLocked(high_water/2);
+}
+
+void CachingCPUAllocator::Trim(size_t target_bytes) {
+  std::lock_guard<std::mutex> lock(mu_);
+  TrimLocked(target_bytes);
+}
+
+void CachingCPUAllocator::TrimLocked(size_t target_bytes) {
+  //the large blocks go first, they are the cheapest to get back
+  for (int c = (int)bins_.size()-1; c >= 0 && shared_bytes_ > target_bytes; c--) {
+    while (!bins_[c].empty() && shared_bytes_ > target_bytes) {
+      free(bins_[c].back());
+      bins_[c].pop_back();
+      shared_bytes_ -= ClassSize(c);
+      bytes_cached_ -= ClassSize(c);
+    }
+  }
+  VLOG(V_TIMING) << "Trimmed the CPU cache: " << debug_info();
+}
+
+size_t CachingCPUAllocator::shared_bytes() {
+  std::lock_guard<std::mutex> lock(mu_);
+  return shared_bytes_;
+}
+
+void CachingCPUAllocator::InitWithZero(void* buf, size_t nbytes) {
+  memset(buf, 0, nbytes);
+}
+
+float CachingCPUAllocator::hit_rate() const {
+  size_t total = hits_ + misses_;
+  return (total == 0) ? 0.f : (float)hits_ / total;
+}
+
+string CachingCPUAllocator::debug_info() const {
+  return "hit rate: " + std::to_string(hit_rate())
+       + "\thits: " + std::to_string(hits_)
+       + "\tmisses: " + std::to_string(misses_)
+       + "\tbytes cached: " + std::to_string(bytes_cached_);
+}
+
+Allocator* caching_cpu_allocator() {
+  static CachingCPUAllocator caching_cpu_alloc;
+  return &caching_cpu_alloc;
+}
+
+REGISTER_STATIC_ALLOCATOR("CPUCaching", caching_cpu_allocator());
+
 TrackingAllocator::TrackingAllocator(Allocator* allocator)
     : allocator_(allocator), capacity_(0) {}
 
@@ -69,10 +249,12 @@ Allocator* GetAllocator(const OpDef& def) {
 }
 
 Allocator* GetAllocator(const string& dev) {
-  if (allocator_factory::GlobalAllocatorRegistry()->count(dev) == 0)
+  //host tensors go to the allocator chosen on the command line
+  const string& key = (dev == DeviceTypeToString(CPU)) ? FLAGS_cpu_allocator : dev;
+  if (allocator_factory::GlobalAllocatorRegistry()->count(key) == 0)
     return NULL;
   else
-    return allocator_factory::GlobalAllocatorRegistry()->at(dev);
+    return allocator_factory::GlobalAllocatorRegistry()->at(key);
 }
 
 } //namespace midend 
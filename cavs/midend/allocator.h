@@ -5,8 +5,11 @@
 #include "cavs/proto/op_def.pb.h"
 #include "cavs/util/macros.h"
 
+#include <atomic>
+#include <mutex>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 namespace midend {
 
@@ -58,6 +61,51 @@ class TrackingAllocator : public Allocator {
   std::unordered_map<void*, size_t> trace_;
 };
 
+//keeps freed host blocks in size-class bins (four classes per power of two)
+//and hands them out again instead of going back to malloc.
+//freed blocks first go to a per-thread free list of at most a quarter of
+//--cpu_allocator_cache_mb(and 64MB), the overflow goes to the shared bins,
+//which are trimmed to half of --cpu_allocator_cache_mb once they exceed it.
+//a thread hands its list to the shared bins when it exits, so the cache
+//holds at most the limit plus the lists of the running threads.
+//there is one instance per process, selected with --cpu_allocator=CPUCaching
+class CachingCPUAllocator : public Allocator {
+ public:
+  CachingCPUAllocator();
+  void* AllocateRaw(size_t nbytes) override;
+  void DeallocateRaw(void* buf) override;
+  void InitWithZero(void* buf, size_t nbytes) override;
+  //releases shared-bin blocks until at most target_bytes are left in the bins
+  void Trim(size_t target_bytes);
+  float hit_rate() const;
+  //in the shared bins and the lists of all the threads
+  FORCE_INLINE size_t bytes_cached() const { return bytes_cached_; }
+  size_t shared_bytes();
+  //the most a thread keeps for itself
+  static size_t ThreadCacheLimit();
+  std::string debug_info() const;
+
+  struct ThreadCache;
+
+ private:
+  static int SizeClass(size_t nbytes);
+  static size_t ClassSize(int size_class);
+  void PushShared(int size_class, void* block);
+  void TrimLocked(size_t target_bytes);
+  ThreadCache* LocalCache();
+
+  std::mutex mu_;
+  std::vector<std::vector<void*>> bins_;
+  //guarded by mu_
+  size_t shared_bytes_;
+  std::atomic<size_t> bytes_cached_;
+  std::atomic<size_t> hits_;
+  std::atomic<size_t> misses_;
+
+  friend struct ThreadCache;
+  DISALLOW_COPY_AND_ASSIGN(CachingCPUAllocator);
+};
+
 Allocator* GetAllocator(const OpDef& def);
 Allocator* GetAllocator(const std::string& device);
 
@@ -0,0 +1,62 @@
+#include "cavs/midend/allocator.h"
+#include "cavs/util/logging.h"
+
+#include <gflags/gflags.h>
+#include <string.h>
+#include <thread>
+
+DECLARE_int32(cpu_allocator_cache_mb);
+
+using namespace midend;
+using std::vector;
+
+//a freed block comes back for the next request of its size class
+void TestReuse(CachingCPUAllocator* a) {
+  void* p = a->AllocateRaw(3000);
+  memset(p, 1, 3000);
+  a->DeallocateRaw(p);
+  float hit_rate = a->hit_rate();
+  void* q = a->AllocateRaw(2900);
+  CHECK(q == p) << p << "\t" << q;
+  CHECK(a->hit_rate() > hit_rate) << a->debug_info();
+  a->DeallocateRaw(q);
+  LOG(INFO) << "reuse passed: " << a->debug_info();
+}
+
+//frees far more than the limit, from this thread and from threads that exit
+void TestBounded(CachingCPUAllocator* a) {
+  const size_t limit = (size_t)FLAGS_cpu_allocator_cache_mb << 20;
+  const size_t block = 256 << 10;
+  auto churn = [a, block, limit]() {
+    vector<void*> blocks;
+    for (size_t i = 0; i < 4*limit/block; i++)
+      blocks.push_back(a->AllocateRaw(block));
+    for (void* p : blocks) {
+      a->DeallocateRaw(p);
+      CHECK(a->shared_bytes() <= limit) << a->debug_info();
+    }
+  };
+  churn();
+  CHECK(a->bytes_cached() <= limit + CachingCPUAllocator::ThreadCacheLimit())
+    << a->debug_info();
+  for (int i = 0; i < 4; i++) {
+    std::thread t(churn);
+    t.join();
+    CHECK(a->shared_bytes() <= limit) << a->debug_info();
+    CHECK(a->bytes_cached() <= limit + CachingCPUAllocator::ThreadCacheLimit())
+      << a->debug_info();
+  }
+  a->Trim(0);
+  CHECK(a->shared_bytes() == 0) << a->debug_info();
+  LOG(INFO) << "bound passed: " << a->debug_info();
+}
+
+int main() {
+  FLAGS_cpu_allocator_cache_mb = 8;
+  CachingCPUAllocator* a =
+    dynamic_cast<CachingCPUAllocator*>(GetAllocator("CPUCaching"));
+  CHECK(a);
+  TestReuse(a);
+  TestBounded(a);
+  return 0;
+}
@@ -1,110 +1,335 @@
 #include "cavs/midend/graph_scheduler.h"
 #include "cavs/proto/devices.pb.h"
+#include "cavs/proto/opt.pb.h"
 #include "cavs/util/macros_gpu.h"
 
+#include <gflags/gflags.h>
+#include <string.h>
+#include <limits.h>
 #include <algorithm>
+#include <thread>
+
+DEFINE_int32(graph_schedule_cache_mb, 64,
+    "bytes of batch schedules kept for the graphs seen before, 0 disables the cache");
+DEFINE_int32(hybrid_batching_threshold, 16,
+    "ready vertices below which the hybrid batching policy runs them all in one round");
+DEFINE_bool(renumber_message_pool, false,
+    "lays the message rows of each round out in the order their parents gather them");
+DEFINE_int32(dataflow_workers, 0,
+    "workers of the dataflow scheduler, 0 takes one per hardware thread");
+DEFINE_int32(dataflow_min_batch, 8,
+    "ready vertices the dataflow scheduler waits for before running a mini-batch");
 
 using std::vector;
 
 namespace midend {
 
-//parent-idx form
-int GraphSchedulerBase::LoadGraph(const Tensor& graph_struct) {
-  VLOG(V_DEBUG) << "Loading graph...";
-  CHECK(graph_struct.dims() == 2) << graph_struct.debug_info();
+namespace {
+
+vector<int> GraphDims(const Tensor& graph_struct) {
+  vector<int> dims(graph_struct.dims());
+  for (int i = 0; i < dims.size(); i++)
+    dims[i] = graph_struct.dims(i);
+  return dims;
+}
+
+//the words of the graph structure that are read,
+//the ragged form leaves the tail of the tensor unused
+int GraphWords(const Tensor& graph_struct) {
+  if (graph_struct.dims() != 1)
+    return graph_struct.count();
+  const int* data = graph_struct.data<int>();
+  const int batch = data[0];
+  CHECK(batch > 0 && batch+2 <= graph_struct.count())
+    << "ragged graph of " << batch << " samples in " << graph_struct.count() << " words";
+  const int words = batch + 2 + data[batch+1];
+  CHECK(words >= batch+2 && words <= graph_struct.count())
+    << "ragged graph of " << data[batch+1] << " vertices in " << graph_struct.count() << " words";
+  return words;
+}
+
+bool SameGraph(const vector<int>& dims, const vector<int>& graph,
+    const Tensor& graph_struct) {
+  if (dims.size() != graph_struct.dims())
+    return false;
+  for (int i = 0; i < dims.size(); i++) {
+    if (dims[i] != graph_struct.dims(i))
+      return false;
+  }
+  return graph.size() == GraphWords(graph_struct) &&
+         std::equal(graph.begin(), graph.end(), graph_struct.data<int>());
+}
+
+template <typename T>
+size_t Bytes(const vector<T>& v) {
+  return v.size()*sizeof(T);
+}
+
+//FNV-1a over the shape and the content of the graph structure
+uint64_t HashGraph(const Tensor& graph_struct) {
+  uint64_t h = 14695981039346656037ULL;
+  auto mix = [&h](const char* p, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+      h ^= (unsigned char)p[i];
+      h *= 1099511628211ULL;
+    }
+  };
+  for (int i = 0; i < graph_struct.dims(); i++) {
+    int d = graph_struct.dims(i);
+    mix((const char*)&d, sizeof(int));
+  }
+  mix(graph_struct.data<char>(), GraphWords(graph_struct)*sizeof(int));
+  return h;
+}
+
+} //namespace
+
+void GraphSchedulerBase::ReserveFor(const Tensor& graph_struct) {
+  CHECK(graph_struct.dims() >= 1 && graph_struct.dims() <= 3) << graph_struct.debug_info();
   CHECK(graph_struct.device_type() == CPU) << graph_struct.debug_info();
-  if (batch_size_ == 0 && max_seq_length_ == 0) {
-    batch_size_ = graph_struct.dims(0);
-    max_seq_length_ = graph_struct.dims(1);
-    __forward_parents_ids_.resize(batch_size_*max_seq_length_); 
-    __forward_children_ids_.resize(batch_size_*max_seq_length_); 
-    sample_offset_in_gid_.resize(batch_size_);
-    //activated_times_.resize(batch_size_*max_seq_length_, 0);
-    checkCudaError(cudaMalloc((void**)&gpu_idx_buf_, batch_size_*max_seq_length_*sizeof(int)));
+  int vertices;
+  if (graph_struct.dims() == 1) {
+    GraphWords(graph_struct);
+    const int* offsets = graph_struct.data<int>() + 1;
+    batch_size_ = graph_struct.data<int>()[0];
+    max_seq_length_ = 0;
+    CHECK(offsets[0] == 0) << offsets[0];
+    for (int i = 0; i < batch_size_; i++) {
+      CHECK(offsets[i+1] >= offsets[i]) << "sample " << i << " ends before it starts";
+      max_seq_length_ = std::max(max_seq_length_, offsets[i+1] - offsets[i]);
+    }
+    vertices = offsets[batch_size_];
   }else {
-    CHECK(batch_size_ == graph_struct.dims(0)); 
-    CHECK(max_seq_length_ == graph_struct.dims(1)); 
-    for (int i = 0; i < batch_size_*max_seq_length_; i++) {
-      __forward_parents_ids_[i].clear();
-      __forward_children_ids_[i].clear();
+    batch_size_ = graph_struct.dims(0);
+    //in the edge-list form, one sample has at most 2*max_edges vertices
+    max_seq_length_ = (graph_struct.dims() == 2) ?
+                      graph_struct.dims(1) : graph_struct.dims(1)*graph_struct.dims(2);
+    vertices = batch_size_*max_seq_length_;
+  }
+  sample_offset_in_gid_.resize(batch_size_);
+  if (vertices > capacity_) {
+    capacity_ = vertices;
+    edges_.reserve(2*capacity_);
+    ready_.reserve(capacity_);
+    activated_times_.reserve(capacity_);
+    for (Adjacency* adj : {&__forward_parents_ids_, &__forward_children_ids_}) {
+      adj->offsets.reserve(capacity_+1);
+      adj->ids.reserve(capacity_);
     }
   }
+}
 
+int GraphSchedulerBase::LoadGraph(const Tensor& graph_struct) {
+  VLOG(V_DEBUG) << "Loading graph...";
+  ReserveFor(graph_struct);
+  edges_.clear();
+  if (graph_struct.dims() == 1) {
+    ParseRaggedParentIds(graph_struct);
+  }else if (graph_struct.dims() == 2) {
+    ParseParentIds(graph_struct);
+  }else {
+    ParseEdgeList(graph_struct);
+  }
+  BuildAdjacency(0, &__forward_parents_ids_);
+  BuildAdjacency(1, &__forward_children_ids_);
+  //a root ends a sample of the padded form, which leaves no room for a cycle
+  if (graph_struct.dims() != 2)
+    CheckAcyclic();
+  parents_ = &__forward_parents_ids_;
+  children_ = &__forward_children_ids_;
+  rc_.Reset();
+  VLOG(V_DEBUG) << "Loading graph completed...";
+  return total_length_;
+}
+
+//parent-idx form
+void GraphSchedulerBase::ParseParentIds(const Tensor& graph_struct) {
   total_length_ = 0;
-  int prev_seq_length = 0;
   for (int i = 0; i < batch_size_; i++) {
     const int *start = graph_struct.data<int>() + i*max_seq_length_;
-    for (int ix = 0; ix < max_seq_length_; ix++)
-      VLOG(V_DEBUG) << *(start+ix);
     int curr_seq_length = std::find(start, start+max_seq_length_, -1) + 1 - start;
-    sample_offset_in_gid_[i] = prev_seq_length + ((i > 0) ? sample_offset_in_gid_[i-1] : 0);
     CHECK(curr_seq_length <= max_seq_length_) << curr_seq_length << "\t" << max_seq_length_;
     VLOG(V_DEBUG) << "sequence_lengh = " << curr_seq_length;
-    total_length_ += curr_seq_length;
-    for (int j = 0; j < curr_seq_length-1; j++) {
-      __forward_parents_ids_[toGlobalId(i, j)].resize(1);
-      __forward_parents_ids_[toGlobalId(i, j)][0] = toGlobalId(i, *(start+j));
-      //__forward_children_ids_[toGlobalId(i, j)].clear();
-      VLOG(V_DEBUG) << "parents[" << i << "][" << j << "](" << toGlobalId(i, j)
-                    << ") = " << __forward_parents_ids_[toGlobalId(i, j)][0];
+    AddParentIds(i, start, curr_seq_length);
+  }
+}
+
+//ragged parent-idx form, the samples are packed one after another
+void GraphSchedulerBase::ParseRaggedParentIds(const Tensor& graph_struct) {
+  const int* offsets = graph_struct.data<int>() + 1;
+  const int* parents = offsets + batch_size_ + 1;
+  total_length_ = 0;
+  for (int i = 0; i < batch_size_; i++)
+    AddParentIds(i, parents + offsets[i], offsets[i+1] - offsets[i]);
+}
+
+//the vertices of the sample follow the ones of the samples before it
+void GraphSchedulerBase::AddParentIds(int sample, const int* parents, int length) {
+  sample_offset_in_gid_[sample] = total_length_;
+  total_length_ += length;
+  for (int j = 0; j < length; j++) {
+    if (parents[j] < 0)
+      continue;
+    CHECK(parents[j] < length && parents[j] != j)
+      << "illegal parent " << parents[j] << " of vertex " << j << " in sample " << sample;
+    edges_.push_back(toGlobalId(sample, j));
+    edges_.push_back(toGlobalId(sample, parents[j]));
+    VLOG(V_DEBUG) << "parents[" << sample << "][" << j << "](" << toGlobalId(sample, j)
+                  << ") = " << edges_.back();
+  }
+}
+
+//edge-list form,
+//the vertices of one sample are numbered from 0 to its largest id
+void GraphSchedulerBase::ParseEdgeList(const Tensor& graph_struct) {
+  CHECK(graph_struct.dims(2) == 2) << graph_struct.debug_info();
+  const int max_edges = graph_struct.dims(1);
+  total_length_ = 0;
+  vector<char> mentioned;
+  for (int i = 0; i < batch_size_; i++) {
+    const int *edges = graph_struct.data<int>() + i*max_edges*2;
+    int num_edges = 0;
+    int num_vertices = 0;
+    while (num_edges < max_edges && edges[2*num_edges] != -1) {
+      int child  = edges[2*num_edges];
+      int parent = edges[2*num_edges+1];
+      CHECK(child >= 0 && parent >= 0 && child != parent)
+        << "illegal edge(" << child << ", " << parent << ") in sample " << i;
+      num_vertices = std::max(num_vertices, std::max(child, parent)+1);
+      num_edges++;
     }
-    //__forward_children_ids_[toGlobalId(i, curr_seq_length-1)].clear();
-    for (int j = 0; j < curr_seq_length; j++) {
-      if (!__forward_parents_ids_[toGlobalId(i, j)].empty()) {
-        int parent = __forward_parents_ids_[toGlobalId(i, j)][0];
-        __forward_children_ids_[parent].push_back(toGlobalId(i, j));
-        VLOG(V_DEBUG) << "children[ " << i << "][" << j << "](" << parent
-                      << ") = " << __forward_children_ids_[parent].back();
-      }
+    //an empty sample would silently drop out of the batch
+    CHECK(num_edges > 0) << "sample " << i << " has no edge";
+    CHECK(num_vertices <= max_seq_length_) << num_vertices << "\t" << max_seq_length_;
+    //an id no edge mentions would get a row that is never scheduled
+    mentioned.assign(num_vertices, 0);
+    for (int e = 0; e < 2*num_edges; e++)
+      mentioned[edges[e]] = 1;
+    for (int v = 0; v < num_vertices; v++)
+      CHECK(mentioned[v]) << "vertex " << v << " of sample " << i << " has no edge";
+    VLOG(V_DEBUG) << "sample " << i << ": " << num_vertices
+                  << " vertices, " << num_edges << " edges";
+    sample_offset_in_gid_[i] = total_length_;
+    total_length_ += num_vertices;
+    for (int e = 0; e < num_edges; e++) {
+      edges_.push_back(toGlobalId(i, edges[2*e]));
+      edges_.push_back(toGlobalId(i, edges[2*e+1]));
     }
-    prev_seq_length = curr_seq_length;
   }
-  parents_ = &__forward_parents_ids_;
-  children_ = &__forward_children_ids_;
-  round2offset_.clear();
-  rc_.Reset();
-  activated_times_.resize(total_length_, 0);
-  tids_to_jobids_.resize(total_length_, 0);
-  jobids_to_tids_.resize(total_length_, 0);
-  VLOG(V_DEBUG) << "Loading graph completed...";
-  return total_length_;
+}
+
+//a stable counting sort of the edges by their key end(0 for the child,
+//1 for the parent), so the neighbours keep the order of the edges
+void GraphSchedulerBase::BuildAdjacency(int key, Adjacency* adj) {
+  const int num_edges = edges_.size()/2;
+  adj->offsets.assign(total_length_+1, 0);
+  adj->ids.resize(num_edges);
+  for (int e = 0; e < num_edges; e++)
+    adj->offsets[edges_[2*e+key]+1]++;
+  for (int v = 0; v < total_length_; v++)
+    adj->offsets[v+1] += adj->offsets[v];
+  //offsets[v] walks to the end of v's range and is shifted back afterwards
+  for (int e = 0; e < num_edges; e++)
+    adj->ids[adj->offsets[edges_[2*e+key]]++] = edges_[2*e+1-key];
+  for (int v = total_length_; v > 0; v--)
+    adj->offsets[v] = adj->offsets[v-1];
+  adj->offsets[0] = 0;
+}
+
+//a cycle would leave its vertices unscheduled forever
+void GraphSchedulerBase::CheckAcyclic() {
+  vector<int>& pending_children = activated_times_;
+  pending_children.resize(total_length_);
+  ready_.clear();
+  for (int gid = 0; gid < total_length_; gid++) {
+    pending_children[gid] = __forward_children_ids_[gid].size();
+    if (pending_children[gid] == 0) ready_.push_back(gid);
+  }
+  for (int i = 0; i < ready_.size(); i++) {
+    for (int pid : __forward_parents_ids_[ready_[i]]) {
+      if (--pending_children[pid] == 0) ready_.push_back(pid);
+    }
+  }
+  CHECK(ready_.size() == total_length_)
+    << "the graph contains a cycle: only " << ready_.size()
+    << " of " << total_length_ << " vertices can be scheduled";
+}
+
+void GraphSchedulerBase::ClearMessagePasser() {
+  if (message_passer_.empty())
+    return;
+  message_passer_.SetOffsetWithId(0);
+  if (message_passer_.device_type() == GPU) {
+    checkCudaError(cudaMemset(message_passer_.mutable_data<char>(), 0,
+                   message_passer_.debug_size()));
+  }else {
+    memset(message_passer_.mutable_data<char>(), 0, message_passer_.debug_size());
+  }
+}
+
+int* GraphSchedulerBase::gpu_idx_buf() {
+  if (gpu_idx_capacity_ < capacity_) {
+    CHECK(capacity_ > 0);
+    if (gpu_idx_buf_)
+      checkCudaError(cudaFree(gpu_idx_buf_));
+    //large enough for the segment offsets followed by the segment ids
+    checkCudaError(cudaMalloc((void**)&gpu_idx_buf_, (2*capacity_+1)*sizeof(int)));
+    gpu_idx_capacity_ = capacity_;
+  }
+  return gpu_idx_buf_;
+}
+
+bool GraphSchedulerBase::IsLeafRound() const {
+  for (int job : GetJobId()) {
+    if (!__forward_children_ids_[job].empty())
+      return false;
+  }
+  return true;
 }
 
 int GraphSchedulerBase::ReverseGraph() {
   CHECK(batch_size_ > 0);
+  CHECK(!forward_only_) << "an inference graph has no backward pass";
   //CHECK(max_seq_length_ > 0);
   children_ = &__forward_parents_ids_;
   parents_ = &__forward_children_ids_;
   rc_.SetBackward();
+  ClearMessagePasser();
   //++rc_;
   return total_length_;
 }
 
+int SerialGraphScheduler::LoadGraph(const Tensor& graph_struct) {
+  GraphSchedulerBase::LoadGraph(graph_struct);
+  if (pending_.capacity() < total_length_) {
+    pending_.reserve(capacity_);
+    tids_to_jobids_buf_.reserve(capacity_);
+  }
+  tids_to_jobids_buf_.assign(total_length_, 0);
+  tids_to_jobids_ = tids_to_jobids_buf_;
+  return total_length_;
+}
+
 void SerialGraphScheduler::Initialize() {
   ++rc_;
   CHECK(Terminate());
-  std::fill(activated_times_.begin(), activated_times_.end(), 0);
-  //tids_to_jobids_.resize(activated_times_.size(), 0);
-  InitializeSample(0);
-  int gid = pending_list_.front();
-  ready_to_execute_ids_[0] = gid;
-  tids_to_jobids_[gid] = gid;
-
-  if (rc_.IsForward()) {
-    for (auto& child : tids_for_gather_)  child.clear();
-    for (auto& child : tids_for_scatter_)  child.clear();
-    for (int i = 0; i < (*parents_)[gid].size(); i++) {
-      tids_for_scatter_[0].push_back(gid);
-    }
-    if (!HasChild(gid)) tids_for_gather_init_[0] = {gid};
-  }else {
-    for (auto& child : tids_for_gather_)  child.clear();
-    for (auto& child : tids_for_scatter_)  child.clear();
-    for (int i = 0; i < (*parents_)[gid].size(); i++) {
-      tids_for_scatter_[i].push_back((*parents_)[gid][i]);
-    }
-    if (!HasChild(gid)) tids_for_gather_init_[1] = {gid};
+  activated_times_.assign(total_length_, 0);
+  pending_.clear();
+  pending_head_ = 0;
+  sample_id_ = -1;
+  NextSample();
+  if (Terminate()) {
+    ClearRound();
+    return;
   }
+  PrepareJob(pending_[pending_head_]);
+}
+
+//a sample may have several roots in the edge-list form,
+//so the next sample starts when the current one is drained
+void SerialGraphScheduler::NextSample() {
+  while (Terminate() && ++sample_id_ < batch_size())
+    InitializeSample(sample_id_);
 }
 
 void SerialGraphScheduler::InitializeSample(int sid) {
@@ -115,146 +340,751 @@ void SerialGraphScheduler::InitializeSample(int sid) {
     VLOG(V_DEBUG) << "Child?[" << gid << "]\t" << (*children_)[gid].empty();
     VLOG(V_DEBUG) << "Parent?[" << gid << "]\t" << (*parents_)[gid].empty();
     if ((*children_)[gid].empty() && !(*parents_)[gid].empty()) {
-      pending_list_.push_back(gid);
+      pending_.push_back(gid);
       VLOG(V_DEBUG) << "Activating job_id: " << gid;
     }
   }
   sample_id_ = sid;
 }
 
+//the lists only ever grow to the largest fan-in,
+//so they are cleared rather than released between jobs
+void SerialGraphScheduler::PrepareJob(int gid) {
+  job_[0] = gid;
+  tids_to_jobids_buf_[gid] = gid;
+  for (auto& child : gather_ids_)  child.clear();
+  for (auto& child : scatter_ids_) child.clear();
+  IdRange children;
+  if (rc_.IsForward()) {
+    //one message is scattered however many parents read it
+    if (scatter_ids_.empty()) scatter_ids_.resize(1);
+    if (!(*parents_)[gid].empty()) {
+      scatter_ids_[0].push_back(gid);
+    }
+    children = (*children_)[gid];
+    if (gather_ids_.size() < children.size())
+      gather_ids_.resize(children.size());
+    for (int i = 0; i < children.size(); i++) {
+      gather_ids_[i].push_back(children[i]);
+    }
+    if (!HasChild(gid)) gather_init_ids_[0].assign(1, gid);
+  }else {
+    //the gradients of all the parents are accumulated in one row
+    if (gather_ids_.empty()) gather_ids_.resize(1);
+    if (!(*children_)[gid].empty()) {
+      gather_ids_[0].push_back(gid);
+    }
+    //the forward children
+    children = (*parents_)[gid];
+    if (scatter_ids_.size() < children.size())
+      scatter_ids_.resize(children.size());
+    for (int i = 0; i < children.size(); i++) {
+      scatter_ids_[i].push_back(children[i]);
+    }
+    if (!HasChild(gid)) gather_init_ids_[1].assign(1, gid);
+  }
+  segment_ids_buf_.assign(children.begin(), children.end());
+  segment_offsets_buf_.assign(1, 0);
+  segment_offsets_buf_.push_back(children.size());
+
+  jobs_ = job_;
+  gather_init_[0] = gather_init_ids_[0];
+  gather_init_[1] = gather_init_ids_[1];
+  gather_slots_.assign(gather_ids_.begin(), gather_ids_.end());
+  scatter_slots_.assign(scatter_ids_.begin(), scatter_ids_.end());
+  segment_offsets_ = segment_offsets_buf_;
+  segment_tids_ = segment_ids_buf_;
+}
+
 void SerialGraphScheduler::ActivateNext() {
   ++rc_;
-  int gid = pending_list_.front();
-  if (!(*parents_)[gid].empty()) {
-    for (int pid : (*parents_)[gid]) {
-      if (++activated_times_[pid] == (*children_)[pid].size()) {
-        pending_list_.push_back(pid);
-        VLOG(V_DEBUG) << "Activating job_id: " << pid;
+  int gid = pending_[pending_head_];
+  for (int pid : (*parents_)[gid]) {
+    if (++activated_times_[pid] == (*children_)[pid].size()) {
+      pending_.push_back(pid);
+      VLOG(V_DEBUG) << "Activating job_id: " << pid;
+    }
+  }
+  tids_to_jobids_buf_[gid] = gid;
+  pending_head_++;
+  NextSample();
+  if (Terminate()) {
+    ClearRound();
+    return;
+  }
+  PrepareJob(pending_[pending_head_]);
+}
+
+void LevelBatchingPolicy::Pick(vector<int>* ready, const Adjacency& children,
+    vector<int>* round) {
+  round->insert(round->end(), ready->begin(), ready->end());
+  ready->clear();
+}
+
+void AgendaBatchingPolicy::Pick(vector<int>* ready, const Adjacency& children,
+    vector<int>* round) {
+  for (int v : *ready) {
+    const int fanin = children[v].size();
+    if (fanin >= count_.size())
+      count_.resize(fanin+1, 0);
+    count_[fanin]++;
+  }
+  //the smaller fan-in wins a tie
+  int best = 0;
+  for (int f = 1; f < count_.size(); f++) {
+    if (count_[f] > count_[best])
+      best = f;
+  }
+  int kept = 0;
+  for (int v : *ready) {
+    if (children[v].size() == best)
+      round->push_back(v);
+    else
+      (*ready)[kept++] = v;
+  }
+  ready->resize(kept);
+  std::fill(count_.begin(), count_.end(), 0);
+}
+
+void HybridBatchingPolicy::Pick(vector<int>* ready, const Adjacency& children,
+    vector<int>* round) {
+  if (ready->size() < threshold_)
+    level_.Pick(ready, children, round);
+  else
+    agenda_.Pick(ready, children, round);
+}
+
+BatchingPolicy* NewBatchingPolicy(int opt) {
+  CHECK(!((opt & OPT_BATCHING_AGENDA) && (opt & OPT_BATCHING_HYBRID)))
+    << "only one batching policy can be selected";
+  if (opt & OPT_BATCHING_AGENDA)
+    return new AgendaBatchingPolicy();
+  if (opt & OPT_BATCHING_HYBRID)
+    return new HybridBatchingPolicy(FLAGS_hybrid_batching_threshold);
+  return new LevelBatchingPolicy();
+}
+
+BatchGraphScheduler::BatchGraphScheduler(BatchingPolicy* policy) :
+  GraphSchedulerBase(), replaying_(false),
+  renumber_(FLAGS_renumber_message_pool), trace_ahead_(false), rows_begin_(-1),
+  policy_(policy ? policy : new LevelBatchingPolicy()), graph_hash_(0),
+  cache_bytes_(0), cache_budget_((size_t)FLAGS_graph_schedule_cache_mb << 20),
+  cache_hits_(0), cache_misses_(0), prepared_hits_(0) {}
+
+void BatchGraphScheduler::Plan::Clear() {
+  graph.clear();
+  dims.clear();
+  total_length = 0;
+  sample_offsets.clear();
+  round2offset.clear();
+  tids_to_jobids.clear();
+  gather_init[0].clear();
+  gather_init[1].clear();
+  scatter.clear();
+  gather_offsets.clear();
+  gather.clear();
+  segment_offsets.clear();
+  segment_ids_offsets.clear();
+  segment_ids.clear();
+  leaf.clear();
+}
+
+size_t BatchGraphScheduler::Plan::bytes() const {
+  return sizeof(Plan) + Bytes(graph) + Bytes(dims) + Bytes(sample_offsets)
+       + Bytes(round2offset) + Bytes(tids_to_jobids)
+       + Bytes(gather_init[0]) + Bytes(gather_init[1])
+       + Bytes(scatter) + Bytes(gather_offsets) + Bytes(gather)
+       + Bytes(segment_offsets) + Bytes(segment_ids_offsets) + Bytes(segment_ids)
+       + Bytes(leaf);
+}
+
+float BatchGraphScheduler::Plan::GatherLocality() const {
+  int64_t rows = 0, sequential = 0;
+  for (int r = 0; r < rounds(); r++) {
+    const int n = round2offset[r+1] - round2offset[r];
+    for (int g = gather_offsets[r]; g < gather_offsets[r+1]; g += n) {
+      for (int k = 0; k < n; k++) {
+        if (gather[g+k] < 0)
+          continue;
+        rows++;
+        sequential += (k > 0 && gather[g+k] == gather[g+k-1]+1);
       }
     }
-  }else if (++sample_id_ < batch_size()) {
-    InitializeSample(sample_id_);
   }
-  tids_to_jobids_[gid] = gid;
-  pending_list_.pop_front();
-  if (Terminate()) return;
+  return (rows > 0) ? (float)sequential/rows : 0.f;
+}
 
-  int next_gid = pending_list_.front();
-  ready_to_execute_ids_[0] = next_gid;
-  if (rc_.IsForward()) {
-    for (auto& child : tids_for_scatter_)  child.clear();
-    for (auto& child : tids_for_gather_)  child.clear();
-    for (int i = 0; i < (*parents_)[next_gid].size(); i++) {
-      //only a count number
-      tids_for_scatter_[0].push_back(next_gid);
+//the rows loaded by LoadRows are a leaf round if they are all leaves,
+//which lead the rows of the plan
+bool BatchGraphScheduler::IsLeafRound() const {
+  CHECK(!Terminate());
+  if (rows_begin_ >= 0)
+    return plan_->leaf[0] && rows_begin_ + jobs_.size() <= leaf_rows();
+  return plan_->leaf[rc_()];
+}
+
+float BatchGraphScheduler::gather_locality() const {
+  CHECK(plan_);
+  return plan_->GatherLocality();
+}
+
+void BatchGraphScheduler::Replay(std::shared_ptr<Plan> plan) {
+  plan_ = std::move(plan);
+  replaying_ = true;
+  VLOG(V_DEBUG) << "Replaying the schedule of " << plan_->rounds() << " rounds";
+  total_length_ = plan_->total_length;
+  sample_offset_in_gid_ = plan_->sample_offsets;
+  tids_to_jobids_ = plan_->tids_to_jobids;
+  gather_init_[0] = plan_->gather_init[0];
+  gather_init_[1] = plan_->gather_init[1];
+  rc_.Reset();
+}
+
+void BatchGraphScheduler::Prepare(const Tensor& graph_struct) {
+  std::lock_guard<std::mutex> shadow_lock(shadow_mu_);
+  if (!shadow_) {
+    shadow_.reset(new BatchGraphScheduler(policy_->Clone()));
+    shadow_->cache_budget_ = 0;
+    shadow_->renumber_ = false;
+  }
+  {
+    std::lock_guard<std::mutex> lock(prepared_mu_);
+    shadow_->plan_ = std::move(spare_);
+  }
+  shadow_->LoadGraph(graph_struct);
+  Plan& p = *(shadow_->plan_);
+  p.graph.assign(graph_struct.data<int>(), graph_struct.data<int>() + GraphWords(graph_struct));
+  p.dims.resize(graph_struct.dims());
+  for (int i = 0; i < p.dims.size(); i++)
+    p.dims[i] = graph_struct.dims(i);
+  if (shadow_->BuildFirstRound() > 0) {
+    while (shadow_->BuildNextRound() > 0) {}
+  }
+  if (renumber_)
+    shadow_->RenumberPlan();
+  uint64_t hash = (cache_budget_ > 0) ? HashGraph(graph_struct) : 0;
+  std::lock_guard<std::mutex> lock(prepared_mu_);
+  prepared_.emplace_back(hash, std::move(shadow_->plan_));
+}
+
+//the batches are run in the order they are prepared,
+//the plans queued before the matching one are stale and dropped
+bool BatchGraphScheduler::AdoptPrepared(const Tensor& graph_struct) {
+  std::lock_guard<std::mutex> lock(prepared_mu_);
+  while (!prepared_.empty()) {
+    HashedPlan front = std::move(prepared_.front());
+    prepared_.pop_front();
+    const Plan& plan = *front.second;
+    if (!SameGraph(plan.dims, plan.graph, graph_struct)) {
+      VLOG(V_DEBUG) << "Dropping a stale prepared schedule";
+      spare_ = std::move(front.second);
+      continue;
     }
-    for (int i = 0; i < (*children_)[next_gid].size(); i++) {
-      tids_for_gather_[i].push_back((*children_)[next_gid][i]);
+    //the plan of the last batch is free unless the cache keeps it
+    if (plan_ && plan_.use_count() == 1)
+      spare_ = std::move(plan_);
+    graph_hash_ = front.first;
+    Replay(std::move(front.second));
+    return true;
+  }
+  return false;
+}
+
+int BatchGraphScheduler::LoadGraph(const Tensor& graph_struct) {
+  replaying_ = false;
+  if (AdoptPrepared(graph_struct)) {
+    ReserveFor(graph_struct);
+    prepared_hits_++;
+    CachePlan();
+    return total_length_;
+  }
+  if (cache_budget_ > 0) {
+    graph_hash_ = HashGraph(graph_struct);
+    auto it = cache_.find(graph_hash_);
+    if (it != cache_.end()) {
+      const Plan& plan = *(it->second->second);
+      //a hash collision is taken as a miss
+      if (SameGraph(plan.dims, plan.graph, graph_struct)) {
+        lru_.splice(lru_.begin(), lru_, it->second);
+        ReserveFor(graph_struct);
+        cache_hits_++;
+        Replay(it->second->second);
+        return total_length_;
+      }
     }
-    if (!HasChild(next_gid)) tids_for_gather_init_[0] = {next_gid};
-  }else {
-    for (auto& child : tids_for_gather_)  child.clear();
-    for (auto& child : tids_for_scatter_)  child.clear();
-    for (int i = 0; i < (*children_)[next_gid].size(); i++) {
-      //only a count number
-      tids_for_gather_[0].push_back(next_gid);
+    cache_misses_++;
+  }
+
+  //the previous plan is still referenced by the cache
+  if (!plan_ || plan_.use_count() > 1)
+    plan_.reset(new Plan());
+  else
+    plan_->Clear();
+  if (cache_budget_ > 0) {
+    plan_->graph.assign(graph_struct.data<int>(), graph_struct.data<int>() + GraphWords(graph_struct));
+    plan_->dims = GraphDims(graph_struct);
+  }
+  GraphSchedulerBase::LoadGraph(graph_struct);
+  jobids_to_tids_.resize(total_length_);
+  plan_->tids_to_jobids.assign(total_length_, 0);
+  plan_->scatter.assign(total_length_, -1);
+  plan_->total_length = total_length_;
+  plan_->sample_offsets = sample_offset_in_gid_;
+  tids_to_jobids_ = plan_->tids_to_jobids;
+  if (renumber_ || trace_ahead_) {
+    //the layout depends on all the rounds, so they are traced before any runs
+    if (BuildFirstRound() > 0) {
+      while (BuildNextRound() > 0) {}
     }
-    for (int i = 0; i < (*parents_)[next_gid].size(); i++) {
-      tids_for_scatter_[i].push_back((*parents_)[next_gid][i]);
+    if (renumber_)
+      RenumberPlan();
+    FinalizePlan();
+    Replay(plan_);
+  }
+  return total_length_;
+}
+
+void BatchGraphScheduler::LoadRows(int begin, int end) {
+  CHECK(trace_ahead_);
+  CHECK(0 <= begin && begin < end && end <= scheduled_rows())
+    << begin << "\t" << end << "\t" << scheduled_rows();
+  ClearRound();
+  jobs_ = IdRange(plan_->tids_to_jobids.data() + begin, end - begin);
+  rows_begin_ = begin;
+}
+
+//the round loaded before, if any, comes back
+void BatchGraphScheduler::ClearRows() {
+  rows_begin_ = -1;
+  if (rc_() >= 0 && rc_() < plan_->rounds())
+    LoadRound(rc_());
+  else
+    ClearRound();
+}
+
+//the forward pass is traced completely
+void BatchGraphScheduler::FinalizePlan() {
+  gather_init_[0] = plan_->gather_init[0];
+  gather_init_[1] = plan_->gather_init[1];
+  CachePlan();
+}
+
+void BatchGraphScheduler::CachePlan() {
+  if (cache_budget_ == 0)
+    return;
+  size_t bytes = plan_->bytes();
+  if (bytes > cache_budget_)
+    return;
+  auto it = cache_.find(graph_hash_);
+  if (it != cache_.end()) {
+    cache_bytes_ -= it->second->second->bytes();
+    lru_.erase(it->second);
+    cache_.erase(it);
+  }
+  lru_.emplace_front(graph_hash_, plan_);
+  cache_[graph_hash_] = lru_.begin();
+  cache_bytes_ += bytes;
+  while (cache_bytes_ > cache_budget_) {
+    cache_bytes_ -= lru_.back().second->bytes();
+    cache_.erase(lru_.back().first);
+    lru_.pop_back();
+  }
+}
+
+//the jobs of every round are reordered so that the children one slot
+//of a later round gathers sit in consecutive rows, in the order of their parents.
+//the rounds are visited from the last one down, the ones a vertex is gathered
+//by first decide its row, and the plan is rebuilt in the new order
+void BatchGraphScheduler::RenumberPlan() {
+  Plan& p = *plan_;
+  const int rounds = p.rounds();
+  if (rounds == 0)
+    return;
+  const float before = VLOG_IS_ON(V_DEBUG) ? p.GatherLocality() : 0.f;
+  bounds_.assign(p.round2offset.begin(), p.round2offset.end());
+  order_.assign(p.tids_to_jobids.begin(), p.tids_to_jobids.begin() + bounds_[rounds]);
+  rank_.assign(total_length_, INT_MAX);
+  int next = 0;
+  for (int r = rounds-1; r >= 0; r--) {
+    auto begin = order_.begin() + bounds_[r];
+    auto end = order_.begin() + bounds_[r+1];
+    std::stable_sort(begin, end, [this](int a, int b) { return rank_[a] < rank_[b]; });
+    int slots = 0;
+    for (auto it = begin; it != end; it++)
+      slots = std::max(slots, (*children_)[*it].size());
+    for (int i = 0; i < slots; i++) {
+      for (auto it = begin; it != end; it++) {
+        IdRange children = (*children_)[*it];
+        if (i < children.size() && rank_[children[i]] == INT_MAX)
+          rank_[children[i]] = next++;
+      }
+    }
+  }
+
+  p.round2offset.assign(1, 0);
+  p.gather_offsets.assign(1, 0);
+  p.segment_ids_offsets.assign(1, 0);
+  p.gather.clear();
+  p.segment_offsets.clear();
+  p.segment_ids.clear();
+  p.leaf.clear();
+  p.gather_init[1].clear();
+  std::fill(p.scatter.begin(), p.scatter.end(), -1);
+  for (int r = 0; r < rounds; r++) {
+    round_jobs_.assign(order_.begin() + bounds_[r], order_.begin() + bounds_[r+1]);
+    AppendRound(round_jobs_);
+  }
+  VLOG(V_DEBUG) << "Gather locality " << before << " -> " << p.GatherLocality();
+}
+
+//the leaves
+int BatchGraphScheduler::BuildFirstRound() {
+  Plan& p = *plan_;
+  activated_times_.assign(total_length_, 0);
+  ready_jobs_.clear();
+  p.round2offset.assign(1, 0);
+  p.gather_offsets.assign(1, 0);
+  p.segment_ids_offsets.assign(1, 0);
+  p.leaf.clear();
+  int tid = 0;
+  for (int gid = 0; gid < total_length_; gid++) {
+    if ((*children_)[gid].empty() && !(*parents_)[gid].empty()) {
+      p.tids_to_jobids[tid] = gid;
+      jobids_to_tids_[gid] = tid;
+      p.scatter[tid] = tid;
+      p.gather_init[0].push_back(gid);
+      VLOG(V_DEBUG) << "Pushing back " << gid;
+      tid++;
+    }
+  }
+  if (tid == 0)
+    return 0;
+  gather_init_[0] = p.gather_init[0];
+  p.round2offset.push_back(tid);
+  p.gather_offsets.push_back(p.gather.size());
+  p.segment_offsets.resize(tid+1, 0);
+  p.segment_ids_offsets.push_back(p.segment_ids.size());
+  p.leaf.push_back(1);
+  return tid;
+}
+
+//the parents whose children are all done in the last round become ready,
+//the policy picks the ones to run out of all the ready vertices
+int BatchGraphScheduler::BuildNextRound() {
+  Plan& p = *plan_;
+  const int r = p.rounds();
+  const int begin = p.round2offset[r-1];
+  const int end = p.round2offset[r];
+  for (int t = begin; t < end; t++) {
+    for (int pid : (*parents_)[p.tids_to_jobids[t]]) {
+      if (++activated_times_[pid] == (*children_)[pid].size())
+        ready_jobs_.push_back(pid);
+    }
+  }
+  if (ready_jobs_.empty())
+    return 0;
+  round_jobs_.clear();
+  policy_->Pick(&ready_jobs_, *children_, &round_jobs_);
+  CHECK(!round_jobs_.empty()) << policy_->name();
+  AppendRound(round_jobs_);
+  return round_jobs_.size();
+}
+
+//a round running the jobs after all the rounds of the plan,
+//the children of every job must be in the plan already
+void BatchGraphScheduler::AppendRound(const vector<int>& jobs) {
+  Plan& p = *plan_;
+  const int r = p.rounds();
+  const int end = p.round2offset[r];
+  const int n = jobs.size();
+  int slots = 0;
+  for (int k = 0; k < n; k++) {
+    p.tids_to_jobids[end+k] = jobs[k];
+    jobids_to_tids_[jobs[k]] = end+k;
+    slots = std::max(slots, (*children_)[jobs[k]].size());
+  }
+
+  //every slot keeps one entry per job so that the rows line up,
+  //a missing child is gathered as zero
+  const int gather_base = p.gather.size();
+  p.gather.resize(gather_base + slots*n, -1);
+  p.segment_offsets.push_back(0);
+  for (int k = 0; k < n; k++) {
+    const int t = end + k;
+    const int pid = jobs[k];
+    IdRange children = (*children_)[pid];
+    for (int i = 0; i < children.size(); i++) {
+      const int ctid = jobids_to_tids_[children[i]];
+      p.gather[gather_base + i*n + k] = ctid;
+      p.segment_ids.push_back(ctid);
+    }
+    p.segment_offsets.push_back(p.segment_ids.size() - p.segment_ids_offsets[r]);
+    //the message is scattered once and read by every parent,
+    //a root has nothing to scatter
+    if ((*parents_)[pid].empty()) {
+      p.gather_init[1].push_back(t);
+    }else {
+      p.scatter[t] = t;
     }
-    if (!HasChild(next_gid)) tids_for_gather_init_[1] = {next_gid};
   }
+  p.round2offset.push_back(end + n);
+  p.gather_offsets.push_back(p.gather.size());
+  p.segment_ids_offsets.push_back(p.segment_ids.size());
+  p.leaf.push_back(slots == 0);
+}
+
+//the views of one round of the plan,
+//the backward pass reads the forward lists the other way round
+void BatchGraphScheduler::LoadRound(int round) {
+  const Plan& p = *plan_;
+  const int begin = p.round2offset[round];
+  const int n = p.round2offset[round+1] - begin;
+  const int slots = (p.gather_offsets[round+1] - p.gather_offsets[round]) / n;
+  jobs_ = IdRange(p.tids_to_jobids.data() + begin, n);
+  vector<IdRange>& gather = rc_.IsForward() ? gather_slots_ : scatter_slots_;
+  vector<IdRange>& scatter = rc_.IsForward() ? scatter_slots_ : gather_slots_;
+  gather.resize(slots);
+  for (int i = 0; i < slots; i++)
+    gather[i] = IdRange(p.gather.data() + p.gather_offsets[round] + i*n, n);
+  scatter.resize(1);
+  scatter[0] = IdRange(p.scatter.data() + begin, n);
+  segment_offsets_ = IdRange(p.segment_offsets.data() + begin + round, n+1);
+  segment_tids_ = IdRange(p.segment_ids.data() + p.segment_ids_offsets[round],
+                          p.segment_ids_offsets[round+1] - p.segment_ids_offsets[round]);
 }
 
 void BatchGraphScheduler::Initialize() {
   ++rc_;
   CHECK(Terminate());
-  std::fill(activated_times_.begin(), activated_times_.end(), 0);
-  //jobids_to_tids_.resize(activated_times_.size(), 0);
-  //tids_to_jobids_.resize(activated_times_.size(), 0);
-  if (round2offset_.empty())  round2offset_.push_back(0);
-  if (rc_.IsForward()) {
-    //for (int sid = 0; sid < batch_size(); sid++) {
-      //for (int i = 0; i < max_seq_length_; i++) {
-    for (int gid = 0; gid < total_length(); gid++) {
-      if ((*children_)[gid].empty() && !(*parents_)[gid].empty()) {
-        int tensor_id = GetCurrentRoundOffset() + ready_to_execute_ids_.size();
-        tids_to_jobids_[tensor_id] = gid;
-        jobids_to_tids_[gid] = tensor_id;
-        tids_for_scatter_[0].push_back(jobids_to_tids_[gid]);
-        ready_to_execute_ids_.push_back(gid);
-        VLOG(V_DEBUG) << "Pushing back " << gid;
-      }
-    }
-    tids_for_gather_init_[0] = ready_to_execute_ids_;
-    tids_for_gather_init_[1].clear();
-    execution_tracer_.clear();
-    gather_tracer_.clear();
-    scatter_tracer_.clear();
+  if (rc_.IsForward() && !replaying_ && BuildFirstRound() == 0)
+    FinalizePlan();
+  if (rc_() >= 0 && rc_() < plan_->rounds()) {
+    LoadRound(rc_());
+    VLOG(V_DEBUG) << "ready_to_execute_ids_" << jobs_[0];
   }else {
-    ready_to_execute_ids_ = std::move(execution_tracer_[rc_()]);
-    tids_for_gather_ = std::move(scatter_tracer_[rc_()]);
-    tids_for_scatter_ = std::move(gather_tracer_[rc_()]);
-    VLOG(V_DEBUG) << "ready_to_execute_ids_" << ready_to_execute_ids_[0];
+    ClearRound();
   }
 }
 
 void BatchGraphScheduler::ActivateNext() {
-  if (round2offset_.size() <= (++rc_)())
-    round2offset_.push_back(round2offset_.back() + GetJobId().size());
-
+  ++rc_;
   VLOG(V_DEBUG) << "activation next " << rc_();
-  if (rc_.IsForward()) {
-    vector<int> jobs_next_round;
-    jobs_next_round.reserve(1<<20);
-    vector<vector<int>> gather_ids_next_round(2);
-    gather_ids_next_round[0].reserve(1<<20);
-    gather_ids_next_round[1].reserve(1<<20);
-    vector<vector<int>> scatter_ids_next_round(1);
-    scatter_ids_next_round[0].reserve(1<<20);
-    for (int gid : ready_to_execute_ids_) {
-      for (int pid : (*parents_)[gid]) {
-        if (++activated_times_[pid] == (*children_)[pid].size()) {
-          //activated_times[pid]++;
-          int tensor_id = GetCurrentRoundOffset() + jobs_next_round.size();
-          tids_to_jobids_[tensor_id] = pid;
-          jobids_to_tids_[pid] = tensor_id;
-          jobs_next_round.push_back(pid);
-          CHECK(gather_ids_next_round.size() >= (*children_)[pid].size());
-          for (int i = 0; i < (*children_)[pid].size(); i++) {
-            int cid = (*children_)[pid][i];
-            gather_ids_next_round[i].push_back(jobids_to_tids_[cid]);
-          }
-          if ((*parents_)[pid].empty()) {
-            tids_for_gather_init_[1].push_back(tensor_id);
-          }else {
-            for (int i = 0; i < (*parents_)[pid].size(); i++) {
-              //just for counting(may be zero)
-              scatter_ids_next_round[0].push_back(tensor_id);
-            }
-          }
-        }
-      }
+  if (rc_.IsForward() && !replaying_ && rc_() == plan_->rounds() &&
+      BuildNextRound() == 0) {
+    FinalizePlan();
+  }
+  if (rc_() >= 0 && rc_() < plan_->rounds()) {
+    LoadRound(rc_());
+    VLOG(V_DEBUG) << "ready_to_execute_ids_" << jobs_[0];
+  }else {
+    ClearRound();
+  }
+}
+
+DataflowGraphScheduler::DataflowGraphScheduler()
+  : DataflowGraphScheduler(FLAGS_dataflow_workers, FLAGS_dataflow_min_batch) {}
+
+DataflowGraphScheduler::DataflowGraphScheduler(int workers, int min_batch)
+  : BatchGraphScheduler(), min_batch_(min_batch),
+    schedulable_(0), dispatched_(0), in_flight_(0),
+    vertex_func_(NULL), generation_(0), working_(0), stopping_(false) {
+  //the rows are numbered as the mini-batches start
+  renumber_ = false;
+  if (workers <= 0)
+    workers = std::max(1u, std::thread::hardware_concurrency());
+  CHECK(min_batch_ > 0) << min_batch_;
+  queues_.resize(workers);
+}
+
+DataflowGraphScheduler::~DataflowGraphScheduler() {
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    stopping_ = true;
+  }
+  start_cv_.notify_all();
+  for (auto& t : threads_)
+    t.join();
+}
+
+int DataflowGraphScheduler::LoadGraph(const Tensor& graph_struct) {
+  BatchGraphScheduler::LoadGraph(graph_struct);
+  if (replaying_)
+    return total_length_;
+  //the running round keeps views into the plan while the others
+  //are appended, so the lists are sized for the whole graph up front
+  Plan& p = *plan_;
+  int max_fanin = 0;
+  for (int gid = 0; gid < total_length_; gid++)
+    max_fanin = std::max(max_fanin, (*children_)[gid].size());
+  p.gather.reserve(total_length_*max_fanin);
+  p.segment_ids.reserve(children_->ids.size());
+  p.segment_offsets.reserve(2*total_length_+1);
+  for (auto* v : {&p.round2offset, &p.gather_offsets, &p.segment_ids_offsets}) {
+    v->reserve(total_length_+2);
+    v->assign(1, 0);
+  }
+  p.gather_init[1].reserve(total_length_);
+  p.leaf.reserve(total_length_+1);
+  p.leaf.clear();
+
+  //the leaves are spread over the workers and run in the first batches
+  activated_times_.assign(total_length_, 0);
+  for (auto& q : queues_)
+    q.clear();
+  schedulable_ = 0;
+  for (int gid = 0; gid < total_length_; gid++) {
+    if ((*children_)[gid].empty() && (*parents_)[gid].empty())
+      continue;
+    if ((*children_)[gid].empty()) {
+      queues_[p.gather_init[0].size() % queues_.size()].push_back(gid);
+      p.gather_init[0].push_back(gid);
     }
-    execution_tracer_.push_back(std::move(ready_to_execute_ids_));
-    gather_tracer_.push_back(std::move(tids_for_gather_));
-    scatter_tracer_.push_back(std::move(tids_for_scatter_));
+    schedulable_++;
+  }
+  gather_init_[0] = p.gather_init[0];
+  dispatched_ = 0;
+  in_flight_ = 0;
+  return total_length_;
+}
 
-    ready_to_execute_ids_ = std::move(jobs_next_round);
-    tids_for_gather_      = std::move(gather_ids_next_round);
-    tids_for_scatter_     = std::move(scatter_ids_next_round);
+//the rounds of the forward pass are started by Execute
+void DataflowGraphScheduler::Initialize() {
+  if (rc_.IsForward() && !replaying_) {
+    ++rc_;
+    ClearRound();
   }else {
-    if (rc_() >= 0) {
-      ready_to_execute_ids_ = std::move(execution_tracer_[rc_()]);
-      tids_for_gather_      = std::move(scatter_tracer_[rc_()]);
-      tids_for_scatter_     = std::move(gather_tracer_[rc_()]);
-      VLOG(V_DEBUG) << "ready_to_execute_ids_" << ready_to_execute_ids_[0];
-    }else {
-      ready_to_execute_ids_.clear();
-      for (auto& ctidg : tids_for_gather_)  { ctidg.clear(); }
-      for (auto& ctids : tids_for_scatter_) { ctids.clear(); }
+    BatchGraphScheduler::Initialize();
+  }
+}
+
+//the caller is worker 0, the others are started on the first call
+void DataflowGraphScheduler::Execute(
+    const std::function<void(int, int)>& vertex_func) {
+  if (replaying_)
+    return;
+  for (int w = threads_.size()+1; w < workers(); w++)
+    threads_.emplace_back(&DataflowGraphScheduler::Serve, this, w);
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    vertex_func_ = &vertex_func;
+    working_ = workers()-1;
+    generation_++;
+  }
+  start_cv_.notify_all();
+  Work(0);
+  {
+    std::unique_lock<std::mutex> lock(mu_);
+    done_cv_.wait(lock, [this]() { return working_ == 0; });
+    vertex_func_ = NULL;
+  }
+  CHECK(dispatched_ == schedulable_) << dispatched_ << "\t" << schedulable_;
+  VLOG(V_DEBUG) << schedulable_ << " vertices in " << plan_->rounds() << " mini-batches";
+  rc_.Set(plan_->rounds());
+  ClearRound();
+  FinalizePlan();
+}
+
+void DataflowGraphScheduler::Serve(int worker) {
+  int seen = 0;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mu_);
+      start_cv_.wait(lock, [this, seen]() { return stopping_ || generation_ != seen; });
+      if (stopping_)
+        return;
+      seen = generation_;
+    }
+    Work(worker);
+    bool last;
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      last = (--working_ == 0);
+    }
+    if (last)
+      done_cv_.notify_all();
+  }
+}
+
+void DataflowGraphScheduler::Work(int worker) {
+  int round;
+  while (Dispatch(worker, &round)) {
+    (*vertex_func_)(worker, round);
+    Complete(worker, round);
+  }
+}
+
+//the plan is sized for the whole graph in LoadGraph,
+//so the views of a round stay put while others are appended
+IdRange DataflowGraphScheduler::RoundJobs(int round) const {
+  const Plan& p = *plan_;
+  return IdRange(p.tids_to_jobids.data() + p.round2offset[round],
+                 p.round2offset[round+1] - p.round2offset[round]);
+}
+
+int DataflowGraphScheduler::RoundOffset(int round) const {
+  return plan_->round2offset[round];
+}
+
+IdRange DataflowGraphScheduler::RoundTensorIdsForGather(int round,
+    int child_offset) const {
+  const Plan& p = *plan_;
+  const int n = p.round2offset[round+1] - p.round2offset[round];
+  const int slots = (p.gather_offsets[round+1] - p.gather_offsets[round]) / n;
+  return (child_offset < slots) ?
+         IdRange(p.gather.data() + p.gather_offsets[round] + child_offset*n, n) :
+         IdRange();
+}
+
+IdRange DataflowGraphScheduler::RoundTensorIdsForScatter(int round) const {
+  const Plan& p = *plan_;
+  return IdRange(p.scatter.data() + p.round2offset[round],
+                 p.round2offset[round+1] - p.round2offset[round]);
+}
+
+//the own queue is taken from the back, the others are stolen from the front.
+//a batch short of min_batch waits unless nothing else can make vertices ready
+bool DataflowGraphScheduler::Dispatch(int worker, int* round) {
+  std::unique_lock<std::mutex> lock(mu_);
+  while (dispatched_ < schedulable_) {
+    std::deque<int>& own = queues_[worker];
+    batch_.assign(own.rbegin(), own.rend());
+    own.clear();
+    for (int i = 1; i < workers() && batch_.size() < min_batch_; i++) {
+      std::deque<int>& victim = queues_[(worker+i) % workers()];
+      while (!victim.empty() && batch_.size() < min_batch_) {
+        batch_.push_back(victim.front());
+        victim.pop_front();
+      }
+    }
+    if (batch_.size() >= min_batch_ || (in_flight_ == 0 && !batch_.empty())) {
+      *round = plan_->rounds();
+      AppendRound(batch_);
+      dispatched_ += batch_.size();
+      in_flight_++;
+      return true;
+    }
+    own.insert(own.end(), batch_.rbegin(), batch_.rend());
+    CHECK(in_flight_ > 0) << "no vertex is ready: "
+                          << dispatched_ << "\t" << schedulable_;
+    cv_.wait(lock);
+  }
+  return false;
+}
+
+//the parents whose children are all done go to the queue of the worker
+void DataflowGraphScheduler::Complete(int worker, int round) {
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    const Plan& p = *plan_;
+    for (int t = p.round2offset[round]; t < p.round2offset[round+1]; t++) {
+      for (int pid : (*parents_)[p.tids_to_jobids[t]]) {
+        if (++activated_times_[pid] == (*children_)[pid].size())
+          queues_[worker].push_back(pid);
+      }
     }
+    in_flight_--;
   }
+  cv_.notify_all();
 }
 
 } //namespace midend
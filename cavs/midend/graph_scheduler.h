@@ -6,156 +6,516 @@
 
 #include <vector>
 #include <list>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <unordered_map>
 
 namespace midend {
 
+//a read-only view of consecutive ids owned by the scheduler,
+//valid until the scheduler moves to the next round
+class IdRange {
+ public:
+  IdRange() : data_(NULL), size_(0) {}
+  IdRange(const int* data, int size) : data_(data), size_(size) {}
+  IdRange(const std::vector<int>& v) : data_(v.data()), size_(v.size()) {}
+  inline const int* data() const { return data_; }
+  inline int size() const { return size_; }
+  inline bool empty() const { return size_ == 0; }
+  inline const int* begin() const { return data_; }
+  inline const int* end() const { return data_ + size_; }
+  inline int operator[](int i) const { return data_[i]; }
+  //the ids are data[0], data[0]+1, ... without a gap or a -1
+  inline bool IsContiguous() const {
+    if (empty() || data_[0] < 0)
+      return false;
+    for (int i = 1; i < size_; i++) {
+      if (data_[i] != data_[i-1]+1)
+        return false;
+    }
+    return true;
+  }
+
+ private:
+  const int* data_;
+  int size_;
+};
+
+//compressed adjacency lists,
+//the neighbours of vertex v are ids[offsets[v], offsets[v+1])
+struct Adjacency {
+  std::vector<int> offsets;
+  std::vector<int> ids;
+  inline IdRange operator[](int v) const {
+    return IdRange(ids.data() + offsets[v], offsets[v+1] - offsets[v]);
+  }
+};
+
+//All the per-graph and per-round state lives in flat arrays
+//whose capacity is kept from one batch to the next,
+//so a steady-state step does not touch the heap.
 class GraphSchedulerBase {
  public:
   GraphSchedulerBase() :
-    batch_size_(0), max_seq_length_(0), total_length_(0), gpu_idx_buf_(NULL) {
-      tids_for_gather_init_.resize(2);
-      tids_for_gather_.resize(2);
-      tids_for_scatter_.resize(2);
-  }
+    batch_size_(0), max_seq_length_(0), total_length_(0), capacity_(0),
+    gpu_idx_buf_(NULL), gpu_idx_capacity_(0), forward_only_(false) {}
   virtual void Initialize() = 0;
   virtual bool Terminate() const = 0;
   virtual void ActivateNext() = 0;
   virtual int GetCurrentRoundOffset() const = 0;
 
-  int LoadGraph(const Tensor& parent_ids);
+  //two layouts of the graph structure are accepted:
+  //1) parent-idx form, [batch, max_length]:
+  //   the j-th entry is the parent of vertex j, the root is marked
+  //   with -1 and ends the sample. Only trees and chains fit in it.
+  //2) edge-list form, [batch, max_edges, 2]:
+  //   each row is a (child, parent) pair of local vertex ids
+  //   and a row starting with -1 ends the sample.
+  //   A sample has the vertices up to its largest id, each of which must
+  //   be in an edge, so a single vertex can not be written in this form.
+  //   A vertex may have several parents, so any DAG fits in it.
+  //   The children of a vertex keep the order of their edges,
+  //   which decides the Gather slot each of them goes to.
+  //3) ragged parent-idx form, [capacity]:
+  //   {batch, offsets[0..batch], parents...}, sample i owns the parents
+  //   [offsets[i], offsets[i+1]) and every -1 among them marks a root.
+  //   The words after the last sample are not read, so the batch size
+  //   and the lengths may change from call to call within the capacity,
+  //   and the vertex inputs are read packed in the same order.
+  //The buffers only grow when a batch has more vertices than any before.
+  virtual int LoadGraph(const Tensor& graph_struct);
+  //called ahead of LoadGraph with the graph of a coming batch,
+  //possibly from another thread, so that a scheduler can do
+  //the parsing work before the batch is run
+  virtual void Prepare(const Tensor& graph_struct) {}
   int ReverseGraph();
+  //set for inference, whose activations are not kept for the backward pass
+  inline void SetForwardOnly() { forward_only_ = true; }
+  inline bool forward_only() const { return forward_only_; }
   inline int batch_size() const { return batch_size_; }
   inline int total_length() const { return total_length_; }
-  inline int* gpu_idx_buf() const { return gpu_idx_buf_; }
+  //allocated on first use, so that host-only graphs never touch the device
+  int* gpu_idx_buf();
   inline bool HasChild(int job_id) const {
-    CHECK(job_id < (*children_).size());
+    CHECK(job_id < total_length_);
     return !(*children_)[job_id].empty();
   }
-  inline const std::vector<int>& GetJobId() const {
+  //no job of the round has a child in the forward graph,
+  //so the round may run the leaf function in either direction
+  virtual bool IsLeafRound() const;
+  inline IdRange GetJobId() const {
     CHECK(!Terminate());
-    return ready_to_execute_ids_;
+    return jobs_;
   }
-  inline const std::vector<int>& CurrentRoundTensorIdsForGatherInitialization() const {
+  inline IdRange CurrentRoundTensorIdsForGatherInitialization() const {
     if (rc_.IsForward())
-      return tids_for_gather_init_[0];
+      return gather_init_[0];
     else
-      return tids_for_gather_init_[1];
+      return gather_init_[1];
+  }
+  //the ids are aligned with the jobs of this round,
+  //-1 means the job has no such child(gather a zero row)
+  //or no parent(nothing to scatter).
+  //there are as many slots as the largest fan-in of the round,
+  //an empty list means no job of this round has that child
+  inline IdRange CurrentRoundTensorIdsForGather(int child_offset) const {
+    return (child_offset < gather_slots_.size()) ?
+           gather_slots_[child_offset] : IdRange();
+  }
+  inline IdRange CurrentRoundTensorIdsForScatter(int child_offset) const {
+    return (child_offset < scatter_slots_.size()) ?
+           scatter_slots_[child_offset] : IdRange();
   }
-  inline const std::vector<int>& CurrentRoundTensorIdsForGather(int child_offset) const {
-    return tids_for_gather_[child_offset];
+  //all the children of the jobs of this round in CSR form:
+  //the children of the i-th job are
+  //SegmentTensorIds[SegmentOffsets[i], SegmentOffsets[i+1]).
+  //it is the same in both directions, the backward pass
+  //scatters the gradient of job i to each of these rows
+  inline IdRange CurrentRoundSegmentOffsets() const {
+    return segment_offsets_;
   }
-  inline const std::vector<int>& CurrentRoundTensorIdsForScatter(int child_offset) const {
-    return tids_for_scatter_[child_offset]; 
+  inline IdRange CurrentRoundSegmentTensorIds() const {
+    return segment_tids_;
   }
-  inline const std::vector<int>& TensorIdsToJobIds() const {
-    return tids_to_jobids_; 
+  inline IdRange TensorIdsToJobIds() const {
+    return tids_to_jobids_;
   }
 
   inline void SetMessagePasser(const Tensor& t) {
     CHECK(!t.IsFullShape());
-    message_passer_ = t; 
+    message_passer_ = t;
   }
   inline const Tensor& GetMessagePasser(int id) {
     message_passer_.SetOffsetWithId(id);
-    return message_passer_; 
+    return message_passer_;
   }
-  inline void SetFuncArg(const Tensor t) { 
+  inline void SetFuncArg(const Tensor t) {
     //we loose this constraint because of the label reshape
     //CHECK(t.IsFullShape());
     func_arg_ = t;
   }
   inline const Tensor& GetFuncArg() {
-    return func_arg_; 
+    return func_arg_;
   }
-  inline void SetFuncRet(const Tensor t) { 
+  inline void SetFuncRet(const Tensor t) {
     CHECK(!t.IsFullShape());
     func_ret_ = t;
   }
   inline const Tensor& GetFuncRet() {
     func_ret_.SetOffsetWithId(0);
-    return func_ret_; 
+    return func_ret_;
   }
 
  protected:
   inline int toGlobalId(int sample_id, int local_id) const {
     return sample_offset_in_gid_[sample_id]+local_id;
   }
+  //takes the batch size and the longest sample of the graph
+  //and grows the buffers to fit it
+  void ReserveFor(const Tensor& graph_struct);
+  inline void ClearRound() {
+    jobs_ = IdRange();
+    gather_slots_.clear();
+    scatter_slots_.clear();
+    segment_offsets_ = IdRange();
+    segment_tids_ = IdRange();
+  }
   std::vector<int>  sample_offset_in_gid_;
-  std::vector<int>  ready_to_execute_ids_;
   std::vector<int>  activated_times_;
-  std::vector<std::vector<int>> tids_for_gather_init_;
-  std::vector<std::vector<int>> tids_for_gather_;
-  std::vector<std::vector<int>> tids_for_scatter_;
-  std::vector<int> jobids_to_tids_;
-  std::vector<int> tids_to_jobids_;
-  std::vector<int> round2offset_;
+  //the views of the current round, set by the schedulers
+  IdRange jobs_;
+  IdRange gather_init_[2];
+  std::vector<IdRange> gather_slots_;
+  std::vector<IdRange> scatter_slots_;
+  IdRange segment_offsets_;
+  IdRange segment_tids_;
+  IdRange tids_to_jobids_;
 
   Tensor message_passer_;
   Tensor func_arg_;
   Tensor func_ret_;
-  std::vector<std::vector<int>> *parents_;
-  std::vector<std::vector<int>> *children_;
+  const Adjacency *parents_;
+  const Adjacency *children_;
   struct RoundCounter {
    public:
     RoundCounter() : round_(-1), isforward_(true) {}
     void Reset() { round_ = -1; isforward_ = true; }
+    void Set(int round) { round_ = round; }
     void SetBackward() { isforward_ = false; }
     bool IsForward() const { return isforward_; }
     int operator()() const { return round_; }
     RoundCounter& operator ++() {
-      if (isforward_) round_++; 
-      else round_--; 
+      if (isforward_) round_++;
+      else round_--;
       return *this;
     }
 
-   private: 
+   private:
     int round_;
     bool isforward_;
   };
   RoundCounter rc_;
-
- private:
   int max_seq_length_;
   int batch_size_;
   int total_length_;
-  std::vector<std::vector<int>> __forward_parents_ids_;
-  std::vector<std::vector<int>> __forward_children_ids_;
+  //the vertices the buffers are sized for
+  int capacity_;
+
+ private:
+  void ParseParentIds(const Tensor& graph_struct);
+  void ParseRaggedParentIds(const Tensor& graph_struct);
+  void AddParentIds(int sample, const int* parents, int length);
+  void ParseEdgeList(const Tensor& graph_struct);
+  void BuildAdjacency(int key, Adjacency* adj);
+  void CheckAcyclic();
+  //the backward Scatters accumulate the gradients of all the parents,
+  //so the forward messages are wiped before the backward pass
+  void ClearMessagePasser();
+  //(child, parent) pairs of global ids
+  std::vector<int> edges_;
+  std::vector<int> ready_;
+  Adjacency __forward_parents_ids_;
+  Adjacency __forward_children_ids_;
   int* gpu_idx_buf_;
+  int gpu_idx_capacity_;
+  bool forward_only_;
 };
 
 class SerialGraphScheduler : public GraphSchedulerBase {
  public:
-  SerialGraphScheduler() : GraphSchedulerBase() {
-    ready_to_execute_ids_.resize(1);
-  }
+  SerialGraphScheduler() :
+    GraphSchedulerBase(), sample_id_(-1), pending_head_(0), job_(1) {}
+  int LoadGraph(const Tensor& graph_struct) override;
   void Initialize() override;
   void ActivateNext() override;
-  inline bool Terminate() const override { return pending_list_.empty(); }
+  inline bool Terminate() const override { return pending_head_ == pending_.size(); }
   inline int GetCurrentRoundOffset() const override { return GetJobId()[0]; }
 
  private:
   int sample_id_;
+  void NextSample();
   void InitializeSample(int id);
-  std::list<int> pending_list_;
+  void PrepareJob(int gid);
+  //a fifo, every vertex is pushed at most once per pass
+  std::vector<int> pending_;
+  int pending_head_;
+  std::vector<int> job_;
+  std::vector<int> gather_init_ids_[2];
+  std::vector<std::vector<int>> gather_ids_;
+  std::vector<std::vector<int>> scatter_ids_;
+  std::vector<int> segment_offsets_buf_;
+  std::vector<int> segment_ids_buf_;
+  std::vector<int> tids_to_jobids_buf_;
+};
+
+//A batching policy decides which of the ready vertices,
+//the ones whose children are all done, run in the next round.
+//The vertices left out stay ready for the later rounds.
+class BatchingPolicy {
+ public:
+  virtual ~BatchingPolicy() {}
+  virtual const char* name() const = 0;
+  //every scheduler owns its own copy
+  virtual BatchingPolicy* Clone() const = 0;
+  //moves the chosen vertices from ready to round, keeping their order
+  virtual void Pick(std::vector<int>* ready, const Adjacency& children,
+                    std::vector<int>* round) = 0;
+};
+
+//all the ready vertices, i.e. one round per level from the leaves
+class LevelBatchingPolicy : public BatchingPolicy {
+ public:
+  const char* name() const override { return "level"; }
+  BatchingPolicy* Clone() const override { return new LevelBatchingPolicy(); }
+  void Pick(std::vector<int>* ready, const Adjacency& children,
+            std::vector<int>* round) override;
 };
 
+//the largest group of ready vertices with the same number of children,
+//so that no Gather of the round reads a padded zero row
+class AgendaBatchingPolicy : public BatchingPolicy {
+ public:
+  const char* name() const override { return "agenda"; }
+  BatchingPolicy* Clone() const override { return new AgendaBatchingPolicy(); }
+  void Pick(std::vector<int>* ready, const Adjacency& children,
+            std::vector<int>* round) override;
+
+ private:
+  std::vector<int> count_;
+};
+
+//agenda rounds while the ready set is large, once it falls below
+//the threshold the tail is not split any more and all of it is
+//fused into one round, as the level policy does
+class HybridBatchingPolicy : public BatchingPolicy {
+ public:
+  explicit HybridBatchingPolicy(int threshold) : threshold_(threshold) {}
+  const char* name() const override { return "hybrid"; }
+  BatchingPolicy* Clone() const override { return new HybridBatchingPolicy(threshold_); }
+  void Pick(std::vector<int>* ready, const Adjacency& children,
+            std::vector<int>* round) override;
+
+ private:
+  int threshold_;
+  LevelBatchingPolicy level_;
+  AgendaBatchingPolicy agenda_;
+};
+
+//the policy selected by the opt flags of a session
+BatchingPolicy* NewBatchingPolicy(int opt);
+
+//The rounds of a batch are decided by the graph structure only,
+//so the schedule of a batch seen before(the same samples fed every epoch)
+//is replayed from an LRU cache, bounded by --graph_schedule_cache_mb,
+//instead of being rebuilt from the raw graph.
+//A replayed schedule does not restore the parent/children lists,
+//which are never read by the batch scheduler after the forward pass is traced,
+//everything a round needs to know about its jobs is kept in the plan.
+//
+//Prepare traces the whole forward schedule of a coming batch
+//on a shadow scheduler. The plan is handed over to the LoadGraph
+//of the same graph, and the plan it replaces goes back to the shadow,
+//so two plans take turns between the running batch and the next one.
 class BatchGraphScheduler : public GraphSchedulerBase {
  public:
-  BatchGraphScheduler() :
-    GraphSchedulerBase(), execution_tracer_(0) {}
+  //takes the policy, the level one by default
+  explicit BatchGraphScheduler(BatchingPolicy* policy = NULL);
+  int LoadGraph(const Tensor& graph_struct) override;
+  void Prepare(const Tensor& graph_struct) override;
   void Initialize() override;
   void ActivateNext() override;
-  inline bool Terminate() const override { return ready_to_execute_ids_.empty(); }
-  inline int GetCurrentRoundOffset() const override { return round2offset_[rc_()]; }
+  inline bool Terminate() const override { return jobs_.empty(); }
+  inline int GetCurrentRoundOffset() const override {
+    return (rows_begin_ >= 0) ? rows_begin_ : plan_->round2offset[rc_()];
+  }
+  //read from the plan, a replayed one comes without the children lists
+  bool IsLeafRound() const override;
+  //LoadGraph traces the whole forward schedule,
+  //so that the rows of all the rounds are known before the first one runs
+  inline void SetTraceAhead() { trace_ahead_ = true; }
+  //the rows of the scheduled vertices, the leaves lead them
+  //as they all run in the first round
+  inline int scheduled_rows() const { return plan_->round2offset.back(); }
+  inline int leaf_rows() const {
+    return (plan_->rounds() > 0) ? plan_->round2offset[1] : 0;
+  }
+  //the rows [begin, end) of the traced schedule as one round with nothing
+  //to gather or scatter, for the work hoisted out of the rounds.
+  //ClearRows brings back the round loaded before
+  void LoadRows(int begin, int end);
+  void ClearRows();
+  inline int64_t cache_hits() const { return cache_hits_; }
+  inline int64_t cache_misses() const { return cache_misses_; }
+  inline int64_t prepared_hits() const { return prepared_hits_; }
+  //the share of the gathered rows that directly follow
+  //the row gathered before them in the same slot
+  float gather_locality() const;
+
+ protected:
+  //everything the forward pass derives from one graph.
+  //the tensor ids are given in execution order,
+  //so round r runs the jobs tids_to_jobids[round2offset[r], round2offset[r+1])
+  struct Plan {
+    std::vector<int> graph;
+    std::vector<int> dims;
+    int total_length;
+    //the global id of the first vertex of each sample
+    std::vector<int> sample_offsets;
+    std::vector<int> round2offset;
+    std::vector<int> tids_to_jobids;
+    std::vector<int> gather_init[2];
+    //the forward scatter list, indexed by tensor id
+    std::vector<int> scatter;
+    //the gather slots of round r are laid out one after another
+    //from gather[gather_offsets[r]], each of them has a row per job
+    std::vector<int> gather_offsets;
+    std::vector<int> gather;
+    //the n+1 segment offsets of round r start at round2offset[r]+r
+    //and index into segment_ids from segment_ids_offsets[r]
+    std::vector<int> segment_offsets;
+    std::vector<int> segment_ids_offsets;
+    std::vector<int> segment_ids;
+    //1 if no job of round r has a child
+    std::vector<char> leaf;
+    inline int rounds() const { return round2offset.size()-1; }
+    void Clear();
+    size_t bytes() const;
+    float GatherLocality() const;
+  };
+  void AppendRound(const std::vector<int>& jobs);
+  void LoadRound(int round);
+  void FinalizePlan();
+  std::shared_ptr<Plan> plan_;
+  bool replaying_;
+  //lays the rows of every round out in the order they are gathered,
+  //the whole plan is then traced in LoadGraph
+  bool renumber_;
+  bool trace_ahead_;
+  //the first of the rows loaded by LoadRows, -1 for a round
+  int rows_begin_;
+
+ private:
+  typedef std::pair<uint64_t, std::shared_ptr<Plan>> HashedPlan;
+  typedef std::list<HashedPlan> LRUList;
+
+  int BuildFirstRound();
+  int BuildNextRound();
+  void RenumberPlan();
+  std::unique_ptr<BatchingPolicy> policy_;
+  //the ready vertices and the ones picked for the round being built
+  std::vector<int> ready_jobs_;
+  std::vector<int> round_jobs_;
+  //the order the renumbering visits the vertices in and the new job order
+  std::vector<int> rank_;
+  std::vector<int> order_;
+  std::vector<int> bounds_;
+  void CachePlan();
+  void Replay(std::shared_ptr<Plan> plan);
+  bool AdoptPrepared(const Tensor& graph_struct);
+  std::vector<int> jobids_to_tids_;
+  uint64_t graph_hash_;
+  LRUList lru_;
+  std::unordered_map<uint64_t, LRUList::iterator> cache_;
+  size_t cache_bytes_;
+  size_t cache_budget_;
+  int64_t cache_hits_;
+  int64_t cache_misses_;
+  //the shadow is only touched by Prepare
+  std::unique_ptr<BatchGraphScheduler> shadow_;
+  std::mutex shadow_mu_;
+  //the plans prepared ahead and the spare one for the shadow
+  std::mutex prepared_mu_;
+  std::deque<HashedPlan> prepared_;
+  std::shared_ptr<Plan> spare_;
+  int64_t prepared_hits_;
+};
+
+//The forward pass has no round barrier: a vertex is ready as soon as
+//its children are done, and a worker runs a mini-batch of ready vertices
+//once it has at least --dataflow_min_batch of them, or nothing else is running.
+//Every worker keeps the vertices it makes ready in its own queue
+//and steals from the queues of the others when it is short of them.
+//The mini-batches are appended to the plan as rounds in the order they
+//are started, so the backward pass replays them the other way round.
+//
+//The workers live as long as the scheduler and run the mini-batches
+//concurrently, each reads its own round with the Round* accessors.
+//A compiled graph statement has a single instance of the node function,
+//whose tensors carry the offset of the running round, so it can not run
+//the mini-batches concurrently and the graph sessions do not use this scheduler.
+class DataflowGraphScheduler : public BatchGraphScheduler {
+ public:
+  //the sizes are taken from --dataflow_workers and --dataflow_min_batch
+  DataflowGraphScheduler();
+  DataflowGraphScheduler(int workers, int min_batch);
+  ~DataflowGraphScheduler();
+  int LoadGraph(const Tensor& graph_struct) override;
+  void Initialize() override;
+  //runs the forward pass after LoadGraph,
+  //vertex_func(worker, round) is called for every mini-batch.
+  //a replayed or prepared plan is left to the usual round loop
+  void Execute(const std::function<void(int, int)>& vertex_func);
+  //the views of a started round, which do not change
+  //while the other rounds are dispatched
+  IdRange RoundJobs(int round) const;
+  int RoundOffset(int round) const;
+  IdRange RoundTensorIdsForGather(int round, int child_offset) const;
+  IdRange RoundTensorIdsForScatter(int round) const;
+  inline int workers() const { return queues_.size(); }
+  inline int min_batch() const { return min_batch_; }
 
  private:
-  std::vector<std::vector<int>> execution_tracer_;
-  std::vector<std::vector<std::vector<int>>> gather_tracer_;
-  std::vector<std::vector<std::vector<int>>> scatter_tracer_;
+  bool Dispatch(int worker, int* round);
+  void Complete(int worker, int round);
+  void Work(int worker);
+  //the loop of the workers other than the caller of Execute
+  void Serve(int worker);
+  int min_batch_;
+  std::vector<std::deque<int>> queues_;
+  std::vector<int> batch_;
+  //the vertices to run, the ones started and the mini-batches running
+  int schedulable_;
+  int dispatched_;
+  int in_flight_;
+  //the function of the running Execute, the number of them
+  //and the workers still in it
+  const std::function<void(int, int)>* vertex_func_;
+  int generation_;
+  int working_;
+  bool stopping_;
+  std::vector<std::thread> threads_;
+  //mu_ guards the queues, the plan and the workers
+  std::mutex mu_;
+  std::condition_variable cv_;
+  std::condition_variable start_cv_;
+  std::condition_variable done_cv_;
 };
 
 
 } //namespace midend
 
 #endif
-
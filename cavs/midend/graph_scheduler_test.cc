@@ -0,0 +1,884 @@
+#include "cavs/midend/graph_scheduler.h"
+#include "cavs/midend/allocator.h"
+#include "cavs/backend/functor_batched_memcpy.h"
+#include "cavs/util/logging.h"
+
+#include <gflags/gflags.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <thread>
+#include <mutex>
+#include <map>
+
+DECLARE_int32(graph_schedule_cache_mb);
+DECLARE_bool(renumber_message_pool);
+
+using namespace midend;
+using std::vector;
+
+//the heap allocations of the process, to check the steady state
+static int64_t allocations = 0;
+void* operator new(size_t n) {
+  allocations++;
+  void* p = malloc(n);
+  if (!p) throw std::bad_alloc();
+  return p;
+}
+void operator delete(void* p) noexcept { free(p); }
+
+//sample 0 is a diamond whose bottom vertex is shared by two parents:
+//  0 -> 1, 0 -> 2, 1 -> 3, 2 -> 3
+//sample 1 is a chain with two roots reading the same vertex:
+//  0 -> 1, 0 -> 2
+void LoadEdgeList(GraphSchedulerBase* gs) {
+  const int MAX_EDGES = 5;
+  Tensor graph("graph", GetAllocator("CPU"), DT_INT32, TensorShape({2, MAX_EDGES, 2}));
+  vector<int> edges = { 0, 1,  0, 2,  1, 3,  2, 3, -1, -1,
+                        0, 1,  0, 2, -1, -1, -1, -1, -1, -1 };
+  memcpy(graph.mutable_data<int>(), edges.data(), edges.size()*sizeof(int));
+  CHECK(gs->LoadGraph(graph) == 7);
+}
+
+//loads a single sample of the edge-list form in a child process,
+//which exits normally unless a CHECK fails
+bool LoadsEdgeList(const vector<int>& edges) {
+  pid_t pid = fork();
+  CHECK(pid >= 0);
+  if (pid == 0) {
+    Tensor graph("graph", GetAllocator("CPU"), DT_INT32,
+                 TensorShape({1, (int)edges.size()/2, 2}));
+    memcpy(graph.mutable_data<int>(), edges.data(), edges.size()*sizeof(int));
+    BatchGraphScheduler gs;
+    gs.LoadGraph(graph);
+    _exit(0);
+  }
+  int status;
+  CHECK(waitpid(pid, &status, 0) == pid);
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+//every vertex of a sample must be in an edge
+void TestEdgeListVertices() {
+  CHECK(LoadsEdgeList({0, 1,  1, 2, -1, -1}));
+  CHECK(!LoadsEdgeList({-1, -1, -1, -1}));       //an empty sample
+  CHECK(!LoadsEdgeList({0, 2, -1, -1}));         //vertex 1 is in no edge
+  CHECK(!LoadsEdgeList({0, 1,  3, 1, -1, -1}));  //nor is vertex 2
+}
+
+vector<int> V(IdRange r) {
+  return vector<int>(r.begin(), r.end());
+}
+
+void ExpectEq(IdRange a, const vector<int>& b) {
+  CHECK(V(a) == b) << "size: " << a.size() << " vs " << b.size();
+}
+
+void TestBatchForwardBackward() {
+  BatchGraphScheduler gs;
+  LoadEdgeList(&gs);
+  //the rounds are the topological levels
+  vector<vector<int>> jobs, gather0, gather1, scatter;
+  gs.Initialize();
+  while (!gs.Terminate()) {
+    //only the first level is made of leaves
+    CHECK(gs.IsLeafRound() == jobs.empty());
+    jobs.push_back(V(gs.GetJobId()));
+    gather0.push_back(V(gs.CurrentRoundTensorIdsForGather(0)));
+    gather1.push_back(V(gs.CurrentRoundTensorIdsForGather(1)));
+    scatter.push_back(V(gs.CurrentRoundTensorIdsForScatter(0)));
+    gs.ActivateNext();
+  }
+  CHECK(jobs.size() == 3) << jobs.size();
+  ExpectEq(jobs[0], {0, 4});
+  ExpectEq(jobs[1], {1, 2, 5, 6});
+  ExpectEq(jobs[2], {3});
+  //every list has one entry per job, -1 marks a missing child or parent
+  ExpectEq(scatter[0], {0, 1});
+  ExpectEq(gather0[1], {0, 0, 1, 1});
+  //no job of this round has a second child
+  ExpectEq(gather1[1], {});
+  ExpectEq(scatter[1], {2, 3, -1, -1});
+  ExpectEq(gather0[2], {2});
+  ExpectEq(gather1[2], {3});
+  ExpectEq(scatter[2], {-1});
+
+  //the backward pass replays the rounds in reverse,
+  //a vertex with several parents receives one gradient from each of them
+  gs.ReverseGraph();
+  gs.Initialize();
+  int round = 2;
+  while (!gs.Terminate()) {
+    ExpectEq(gs.GetJobId(), jobs[round]);
+    CHECK(gs.IsLeafRound() == (round == 0));
+    ExpectEq(gs.CurrentRoundTensorIdsForGather(0), scatter[round]);
+    ExpectEq(gs.CurrentRoundTensorIdsForScatter(0), gather0[round]);
+    ExpectEq(gs.CurrentRoundTensorIdsForScatter(1), gather1[round]);
+    gs.ActivateNext();
+    round--;
+  }
+  CHECK(round == -1);
+}
+
+//one vertex with three children and one with two:
+//  0 -> 3, 1 -> 3, 2 -> 3, 3 -> 5, 4 -> 5
+void TestBatchFanIn() {
+  BatchGraphScheduler gs;
+  const int MAX_EDGES = 5;
+  Tensor graph("graph", GetAllocator("CPU"), DT_INT32, TensorShape({1, MAX_EDGES, 2}));
+  vector<int> edges = { 0, 3,  1, 3,  2, 3,  3, 5,  4, 5 };
+  memcpy(graph.mutable_data<int>(), edges.data(), edges.size()*sizeof(int));
+  CHECK(gs.LoadGraph(graph) == 6);
+
+  vector<vector<int>> offsets, segments, gather2;
+  gs.Initialize();
+  while (!gs.Terminate()) {
+    offsets.push_back(V(gs.CurrentRoundSegmentOffsets()));
+    segments.push_back(V(gs.CurrentRoundSegmentTensorIds()));
+    gather2.push_back(V(gs.CurrentRoundTensorIdsForGather(2)));
+    CHECK(offsets.back().size() == gs.GetJobId().size()+1);
+    gs.ActivateNext();
+  }
+  CHECK(offsets.size() == 3) << offsets.size();
+  ExpectEq(offsets[0], {0, 0, 0, 0, 0});
+  ExpectEq(segments[0], {});
+  ExpectEq(offsets[1], {0, 3});
+  ExpectEq(segments[1], {0, 1, 2});
+  ExpectEq(gather2[1], {2});
+  ExpectEq(offsets[2], {0, 2});
+  ExpectEq(segments[2], {4, 3});
+  //the slots beyond the fan-in of the second job are padded
+  ExpectEq(gather2[2], {});
+
+  gs.ReverseGraph();
+  gs.Initialize();
+  int round = 2;
+  while (!gs.Terminate()) {
+    ExpectEq(gs.CurrentRoundSegmentOffsets(), offsets[round]);
+    ExpectEq(gs.CurrentRoundSegmentTensorIds(), segments[round]);
+    ExpectEq(gs.CurrentRoundTensorIdsForScatter(2), gather2[round]);
+    gs.ActivateNext();
+    round--;
+  }
+  CHECK(round == -1);
+}
+
+//the rounds a policy picks for
+//  0 -> 2, 1 -> 2, 3 -> 4, 2 -> 5, 4 -> 5
+//and the number of zero rows its Gathers read
+vector<vector<int>> PolicyRounds(BatchingPolicy* policy, int* padded) {
+  BatchGraphScheduler gs(policy);
+  const int MAX_EDGES = 5;
+  Tensor graph("graph", GetAllocator("CPU"), DT_INT32, TensorShape({1, MAX_EDGES, 2}));
+  vector<int> edges = { 0, 2,  1, 2,  3, 4,  2, 5,  4, 5 };
+  memcpy(graph.mutable_data<int>(), edges.data(), edges.size()*sizeof(int));
+  CHECK(gs.LoadGraph(graph) == 6);
+  vector<vector<int>> rounds;
+  *padded = 0;
+  gs.Initialize();
+  while (!gs.Terminate()) {
+    rounds.push_back(V(gs.GetJobId()));
+    for (int slot = 0; !gs.CurrentRoundTensorIdsForGather(slot).empty(); slot++) {
+      for (int tid : gs.CurrentRoundTensorIdsForGather(slot))
+        *padded += (tid < 0);
+    }
+    gs.ActivateNext();
+  }
+  //the backward pass runs the same rounds the other way round
+  gs.ReverseGraph();
+  gs.Initialize();
+  for (int r = rounds.size()-1; r >= 0; r--) {
+    ExpectEq(gs.GetJobId(), rounds[r]);
+    gs.ActivateNext();
+  }
+  CHECK(gs.Terminate());
+  return rounds;
+}
+
+void TestBatchPolicies() {
+  int padded;
+  vector<vector<int>> level = PolicyRounds(new LevelBatchingPolicy(), &padded);
+  CHECK(level == vector<vector<int>>({{0, 1, 3}, {2, 4}, {5}}));
+  CHECK(padded == 1) << padded;
+  //vertex 4 has one child and vertex 2 two, they are run apart
+  vector<vector<int>> agenda = PolicyRounds(new AgendaBatchingPolicy(), &padded);
+  CHECK(agenda == vector<vector<int>>({{0, 1, 3}, {4}, {2}, {5}}));
+  CHECK(padded == 0) << padded;
+  CHECK(PolicyRounds(new HybridBatchingPolicy(2), &padded) == agenda);
+  CHECK(PolicyRounds(new HybridBatchingPolicy(3), &padded) == level);
+}
+
+//the mini-batches of the dataflow scheduler on a batch of random trees,
+//a vertex runs after all its children and the backward pass mirrors them
+void TestDataflow() {
+  const int TREES = 16, MAX_LENGTH = 24;
+  Tensor graph("graph", GetAllocator("CPU"), DT_INT32, TensorShape({TREES, MAX_LENGTH}));
+  int* parents = graph.mutable_data<int>();
+  srand(3);
+  for (int i = 0; i < TREES; i++) {
+    int n = 1 + rand() % MAX_LENGTH;
+    for (int v = 0; v < MAX_LENGTH; v++)
+      parents[i*MAX_LENGTH + v] = (v < n-1) ? v+1 + rand() % (n-1-v) : -1;
+  }
+  vector<int> parent_of;
+  for (int i = 0; i < TREES; i++) {
+    const int base = parent_of.size();
+    for (int v = 0; v < MAX_LENGTH; v++) {
+      int p = parents[i*MAX_LENGTH + v];
+      parent_of.push_back((p < 0) ? -1 : base + p);
+      if (p < 0) break;
+    }
+  }
+  vector<vector<int>> level;
+  BatchGraphScheduler bs;
+  bs.LoadGraph(graph);
+  bs.Initialize();
+  while (!bs.Terminate()) {
+    level.push_back(V(bs.GetJobId()));
+    std::sort(level.back().begin(), level.back().end());
+    bs.ActivateNext();
+  }
+
+  FLAGS_graph_schedule_cache_mb = 0;
+  for (int workers : {1, 4}) {
+    for (int min_batch : {1, 4, 1000}) {
+      DataflowGraphScheduler gs(workers, min_batch);
+      //the workers are kept for the next batch
+      for (int batch = 0; batch < 2; batch++) {
+        const int total = gs.LoadGraph(graph);
+        gs.Initialize();
+        std::mutex mu;
+        vector<bool> done(total, false);
+        vector<vector<int>> rounds(total);
+        int short_batches = 0, running = 0, overlapped = 0;
+        gs.Execute([&](int worker, int round) {
+          IdRange jobs = gs.RoundJobs(round);
+          const int offset = gs.RoundOffset(round);
+          const bool short_batch = (jobs.size() < min_batch);
+          {
+            std::lock_guard<std::mutex> lock(mu);
+            //a mini-batch short of min_batch takes every ready vertex
+            //and is only started when no other one runs
+            CHECK(!short_batch || running == 0) << round;
+            overlapped += (running++ > 0);
+            rounds[round] = V(jobs);
+            short_batches += short_batch;
+            //the children are done and gathered from the rows they wrote
+            for (int slot = 0; !gs.RoundTensorIdsForGather(round, slot).empty(); slot++) {
+              IdRange tids = gs.RoundTensorIdsForGather(round, slot);
+              for (int k = 0; k < jobs.size(); k++) {
+                if (tids[k] < 0) continue;
+                CHECK(tids[k] < offset);
+                const int child = gs.TensorIdsToJobIds()[tids[k]];
+                CHECK(parent_of[child] == jobs[k] && done[child]);
+              }
+            }
+            IdRange scatter = gs.RoundTensorIdsForScatter(round);
+            for (int k = 0; k < jobs.size(); k++)
+              CHECK(scatter[k] < 0 || scatter[k] == offset + k);
+          }
+          std::this_thread::sleep_for(std::chrono::microseconds(100));
+          std::lock_guard<std::mutex> lock(mu);
+          CHECK(!short_batch || running == 1) << round;
+          running--;
+          for (int job : jobs) {
+            CHECK(!done[job]);
+            done[job] = true;
+          }
+        });
+        CHECK(gs.Terminate());
+        while (!rounds.empty() && rounds.back().empty())
+          rounds.pop_back();
+        int vertices = 0;
+        for (auto& r : rounds)
+          vertices += r.size();
+        CHECK(vertices == std::count(done.begin(), done.end(), true));
+        //every vertex with a parent or a child is run once
+        vector<bool> has_child(parent_of.size(), false);
+        for (int p : parent_of)
+          if (p >= 0) has_child[p] = true;
+        for (int v = 0; v < parent_of.size(); v++)
+          CHECK(done[v] == (parent_of[v] >= 0 || has_child[v])) << v;
+        //one worker waiting for every ready vertex is the level schedule
+        if (workers == 1 && min_batch == 1000) {
+          vector<vector<int>> sorted = rounds;
+          for (auto& r : sorted)
+            std::sort(r.begin(), r.end());
+          CHECK(sorted == level);
+        }
+        if (min_batch == 1)
+          CHECK(short_batches == 0);
+        gs.ReverseGraph();
+        gs.Initialize();
+        for (int r = rounds.size()-1; r >= 0; r--) {
+          ExpectEq(gs.GetJobId(), rounds[r]);
+          gs.ActivateNext();
+        }
+        CHECK(gs.Terminate());
+        if (batch == 0) {
+          LOG(INFO) << workers << " workers, at least " << min_batch << ":\t"
+                    << rounds.size() << " mini-batches, " << short_batches << " short, "
+                    << overlapped << " overlapped";
+        }
+      }
+    }
+  }
+  FLAGS_graph_schedule_cache_mb = 64;
+}
+
+//a binary parse tree over the given leaves in the parent-idx form,
+//adjacent spans are merged at random and the root comes last
+vector<int> RandomParseTree(int leaves) {
+  vector<int> parents(2*leaves-1, -1);
+  vector<int> spans(leaves);
+  for (int i = 0; i < leaves; i++)
+    spans[i] = i;
+  for (int next = leaves; spans.size() > 1; next++) {
+    int i = rand() % (spans.size()-1);
+    parents[spans[i]] = parents[spans[i+1]] = next;
+    spans[i] = next;
+    spans.erase(spans.begin()+i+1);
+  }
+  return parents;
+}
+
+Tensor RandomParseTrees(int trees, int max_leaves) {
+  const int L = 2*max_leaves-1;
+  Tensor graph("graph", GetAllocator("CPU"), DT_INT32, TensorShape({trees, L}));
+  int* parents = graph.mutable_data<int>();
+  std::fill(parents, parents + trees*L, -1);
+  for (int t = 0; t < trees; t++) {
+    vector<int> tree = RandomParseTree(1 + rand() % max_leaves);
+    std::copy(tree.begin(), tree.end(), parents + t*L);
+  }
+  return graph;
+}
+
+//the children every job gathers through each slot, in job ids,
+//and the rounds as sets of jobs
+void GatheredChildren(BatchGraphScheduler* gs, const Tensor& graph,
+    std::map<int, vector<int>>* gathered, vector<vector<int>>* rounds) {
+  gs->LoadGraph(graph);
+  gs->Initialize();
+  while (!gs->Terminate()) {
+    IdRange jobs = gs->GetJobId();
+    rounds->push_back(V(jobs));
+    std::sort(rounds->back().begin(), rounds->back().end());
+    for (int slot = 0; !gs->CurrentRoundTensorIdsForGather(slot).empty(); slot++) {
+      IdRange tids = gs->CurrentRoundTensorIdsForGather(slot);
+      for (int k = 0; k < jobs.size(); k++) {
+        CHECK(tids[k] < gs->GetCurrentRoundOffset());
+        (*gathered)[jobs[k]].push_back(
+            (tids[k] < 0) ? -1 : gs->TensorIdsToJobIds()[tids[k]]);
+      }
+    }
+    //the messages of a round are written to its own rows
+    IdRange scatter = gs->CurrentRoundTensorIdsForScatter(0);
+    for (int k = 0; k < scatter.size(); k++)
+      CHECK(scatter[k] < 0 || scatter[k] == gs->GetCurrentRoundOffset() + k);
+    gs->ActivateNext();
+  }
+}
+
+struct Trace {
+  vector<vector<int>> jobs, gather0, scatter0, offsets;
+  vector<int> round_offsets, leaf;
+  bool operator==(const Trace& o) const {
+    return jobs == o.jobs && gather0 == o.gather0 && scatter0 == o.scatter0 &&
+           offsets == o.offsets && round_offsets == o.round_offsets && leaf == o.leaf;
+  }
+};
+
+Trace RunForwardBackward(GraphSchedulerBase* gs, const Tensor& graph) {
+  Trace t;
+  gs->LoadGraph(graph);
+  for (bool forward : {true, false}) {
+    if (!forward) gs->ReverseGraph();
+    gs->Initialize();
+    while (!gs->Terminate()) {
+      t.jobs.push_back(V(gs->GetJobId()));
+      t.gather0.push_back(V(gs->CurrentRoundTensorIdsForGather(0)));
+      t.scatter0.push_back(V(gs->CurrentRoundTensorIdsForScatter(0)));
+      t.offsets.push_back(V(gs->CurrentRoundSegmentOffsets()));
+      t.round_offsets.push_back(gs->GetCurrentRoundOffset());
+      t.leaf.push_back(gs->IsLeafRound());
+      gs->ActivateNext();
+    }
+  }
+  return t;
+}
+
+//the same batches fed again are replayed from the schedule cache,
+//whose leaf rounds do not depend on the graph parsed last
+void TestBatchCache() {
+  Tensor tree("tree", GetAllocator("CPU"), DT_INT32, TensorShape({2, 4}));
+  vector<int> parents = { 2, 2, 3, -1,
+                          1, -1, 0, 0 };
+  memcpy(tree.mutable_data<int>(), parents.data(), parents.size()*sizeof(int));
+  Tensor chain("chain", GetAllocator("CPU"), DT_INT32, TensorShape({2, 4}));
+  parents = { 1, 2, 3, -1,
+              1, 2, -1, 0 };
+  memcpy(chain.mutable_data<int>(), parents.data(), parents.size()*sizeof(int));
+
+  //a batch of another size, the hits take the sizes of their own graph
+  Tensor forest("forest", GetAllocator("CPU"), DT_INT32, TensorShape({3, 4}));
+  parents = { 1, -1, 0, 0,
+              2, 2, -1, 0,
+              1, 2, -1, 0 };
+  memcpy(forest.mutable_data<int>(), parents.data(), parents.size()*sizeof(int));
+
+  BatchGraphScheduler gs;
+  Trace tree_trace = RunForwardBackward(&gs, tree);
+  Trace chain_trace = RunForwardBackward(&gs, chain);
+  Trace forest_trace = RunForwardBackward(&gs, forest);
+  CHECK(gs.cache_hits() == 0 && gs.cache_misses() == 3);
+  CHECK(!(tree_trace == chain_trace));
+  CHECK(tree_trace.leaf == vector<int>({1, 0, 0, 0, 0, 1}));
+  for (int epoch = 0; epoch < 3; epoch++) {
+    CHECK(RunForwardBackward(&gs, tree) == tree_trace);
+    CHECK(gs.batch_size() == 2) << gs.batch_size();
+    CHECK(RunForwardBackward(&gs, forest) == forest_trace);
+    CHECK(gs.batch_size() == 3) << gs.batch_size();
+    CHECK(RunForwardBackward(&gs, chain) == chain_trace);
+    CHECK(gs.batch_size() == 2) << gs.batch_size();
+  }
+  CHECK(gs.cache_hits() == 9 && gs.cache_misses() == 3)
+    << gs.cache_hits() << "\t" << gs.cache_misses();
+}
+
+//the schedules prepared on another thread are taken over by LoadGraph,
+//in the order the batches are run
+void TestBatchPrepare() {
+  Tensor tree("tree", GetAllocator("CPU"), DT_INT32, TensorShape({2, 4}));
+  vector<int> parents = { 2, 2, 3, -1,
+                          1, -1, 0, 0 };
+  memcpy(tree.mutable_data<int>(), parents.data(), parents.size()*sizeof(int));
+  Tensor chain("chain", GetAllocator("CPU"), DT_INT32, TensorShape({2, 4}));
+  parents = { 1, 2, 3, -1,
+              1, 2, -1, 0 };
+  memcpy(chain.mutable_data<int>(), parents.data(), parents.size()*sizeof(int));
+
+  for (int cache_mb : {0, 64}) {
+    FLAGS_graph_schedule_cache_mb = cache_mb;
+    BatchGraphScheduler plain;
+    Trace tree_trace = RunForwardBackward(&plain, tree);
+    Trace chain_trace = RunForwardBackward(&plain, chain);
+
+    BatchGraphScheduler gs;
+    std::thread preparer([&gs, &tree, &chain]() {
+      gs.Prepare(tree);
+      gs.Prepare(chain);
+    });
+    preparer.join();
+    CHECK(RunForwardBackward(&gs, tree) == tree_trace);
+    CHECK(RunForwardBackward(&gs, chain) == chain_trace);
+    CHECK(gs.prepared_hits() == 2) << gs.prepared_hits();
+    //a stale plan is dropped on the way to the matching one
+    gs.Prepare(chain);
+    gs.Prepare(tree);
+    CHECK(RunForwardBackward(&gs, tree) == tree_trace);
+    CHECK(gs.prepared_hits() == 3) << gs.prepared_hits();
+  }
+  FLAGS_graph_schedule_cache_mb = 64;
+}
+
+//the renumbered plan gathers the same children in the same rounds,
+//from rows that follow each other more often
+void TestRenumber() {
+  srand(5);
+  Tensor graph = RandomParseTrees(16, 12);
+  FLAGS_renumber_message_pool = false;
+  BatchGraphScheduler plain;
+  std::map<int, vector<int>> plain_gathered, gathered;
+  vector<vector<int>> plain_rounds, rounds;
+  GatheredChildren(&plain, graph, &plain_gathered, &plain_rounds);
+
+  FLAGS_renumber_message_pool = true;
+  BatchGraphScheduler gs;
+  GatheredChildren(&gs, graph, &gathered, &rounds);
+  CHECK(gathered == plain_gathered);
+  CHECK(rounds == plain_rounds);
+  CHECK(gs.gather_locality() > plain.gather_locality())
+    << gs.gather_locality() << "\t" << plain.gather_locality();
+  Trace trace = RunForwardBackward(&gs, graph);
+  CHECK(gs.cache_hits() == 1);
+
+  //a prepared plan is renumbered the same way
+  BatchGraphScheduler prepared;
+  prepared.Prepare(graph);
+  CHECK(RunForwardBackward(&prepared, graph) == trace);
+  CHECK(prepared.prepared_hits() == 1);
+  FLAGS_renumber_message_pool = false;
+}
+
+//the rows of a schedule traced ahead are loaded as one round
+//for the work hoisted out of the rounds, without changing the rounds
+void TestTraceAhead() {
+  srand(5);
+  Tensor graph = RandomParseTrees(16, 10);
+  BatchGraphScheduler plain;
+  Trace expected = RunForwardBackward(&plain, graph);
+
+  BatchGraphScheduler gs;
+  gs.SetTraceAhead();
+  gs.LoadGraph(graph);
+  vector<int> rows;
+  for (auto& jobs : expected.jobs) {
+    if (rows.size() < gs.scheduled_rows())
+      rows.insert(rows.end(), jobs.begin(), jobs.end());
+  }
+  CHECK(rows.size() == gs.scheduled_rows());
+  CHECK(gs.leaf_rows() == expected.jobs[0].size());
+  //the leaves first, the inner vertices after them
+  const int leaf_rows = gs.leaf_rows();
+  for (int begin : {0, leaf_rows}) {
+    const int end = begin ? gs.scheduled_rows() : leaf_rows;
+    gs.LoadRows(begin, end);
+    CHECK(gs.GetCurrentRoundOffset() == begin);
+    CHECK(gs.CurrentRoundTensorIdsForGather(0).empty());
+    ExpectEq(gs.GetJobId(), vector<int>(rows.begin() + begin, rows.begin() + end));
+    gs.ClearRows();
+    CHECK(gs.Terminate());
+  }
+  //a round loaded before is brought back
+  gs.Initialize();
+  gs.LoadRows(0, gs.scheduled_rows());
+  gs.ClearRows();
+  ExpectEq(gs.GetJobId(), expected.jobs[0]);
+  CHECK(gs.GetCurrentRoundOffset() == 0);
+
+  BatchGraphScheduler traced;
+  traced.SetTraceAhead();
+  CHECK(RunForwardBackward(&traced, graph) == expected);
+}
+
+void TestSerial() {
+  SerialGraphScheduler gs;
+  LoadEdgeList(&gs);
+  vector<int> order;
+  gs.Initialize();
+  while (!gs.Terminate()) {
+    int gid = gs.GetJobId()[0];
+    order.push_back(gid);
+    //one message per vertex, however many parents read it
+    CHECK(gs.CurrentRoundTensorIdsForScatter(0).size() <= 1);
+    gs.ActivateNext();
+  }
+  //both roots of sample 1 are run before the scheduler terminates
+  ExpectEq(order, {0, 1, 2, 3, 4, 5, 6});
+}
+
+//one forward and backward pass, the way GraphStatement drives it
+int RunStep(GraphSchedulerBase* gs, const Tensor& graph) {
+  int rounds = 0;
+  gs->LoadGraph(graph);
+  for (bool forward : {true, false}) {
+    if (!forward) gs->ReverseGraph();
+    gs->Initialize();
+    while (!gs->Terminate()) {
+      rounds++;
+      gs->ActivateNext();
+    }
+  }
+  return rounds;
+}
+
+//the padded parent-idx rows of a graph packed into the ragged form
+void ToRagged(const Tensor& padded, Tensor* ragged) {
+  const int batch = padded.dims(0), L = padded.dims(1);
+  int* data = ragged->mutable_data<int>();
+  std::fill(data, data + ragged->count(), 12345);
+  data[0] = batch;
+  data[1] = 0;
+  int* parents = data + batch + 2;
+  for (int i = 0; i < batch; i++) {
+    const int* row = padded.data<int>() + i*L;
+    int n = std::find(row, row+L, -1) + 1 - row;
+    std::copy(row, row+n, parents + data[i+1]);
+    data[i+2] = data[i+1] + n;
+  }
+  CHECK(batch + 2 + data[batch+1] <= ragged->count());
+}
+
+//batches of changing sizes in the ragged form are scheduled
+//the same as their padded forms, and the buffers stop growing
+void TestRagged() {
+  const int CAPACITY = 2048;
+  Tensor ragged("ragged", GetAllocator("CPU"), DT_INT32, TensorShape({CAPACITY}));
+  srand(7);
+  vector<Tensor> batches = { RandomParseTrees(16, 12), RandomParseTrees(3, 30),
+                             RandomParseTrees(40, 5), RandomParseTrees(1, 1) };
+  for (int cache_mb : {0, 64}) {
+    FLAGS_graph_schedule_cache_mb = cache_mb;
+    BatchGraphScheduler gs;
+    for (const Tensor& padded : batches) {
+      BatchGraphScheduler plain;
+      Trace expected = RunForwardBackward(&plain, padded);
+      ToRagged(padded, &ragged);
+      CHECK(RunForwardBackward(&gs, ragged) == expected);
+      CHECK(gs.batch_size() == padded.dims(0));
+    }
+    int64_t steady_allocations = 0;
+    for (const Tensor& padded : batches) {
+      ToRagged(padded, &ragged);
+      int64_t allocations_before = allocations;
+      RunStep(&gs, ragged);
+      steady_allocations += allocations - allocations_before;
+    }
+    CHECK(steady_allocations == 0) << steady_allocations;
+    if (cache_mb > 0)
+      CHECK(gs.cache_hits() == batches.size()) << gs.cache_hits();
+  }
+  FLAGS_graph_schedule_cache_mb = 64;
+
+  //every -1 of a ragged sample is a root
+  vector<int> forest = { 1, 0, 4,  3, 2, -1, -1 };
+  memcpy(ragged.mutable_data<int>(), forest.data(), forest.size()*sizeof(int));
+  SerialGraphScheduler ss;
+  CHECK(ss.LoadGraph(ragged) == 4);
+  vector<int> order;
+  ss.Initialize();
+  while (!ss.Terminate()) {
+    order.push_back(ss.GetJobId()[0]);
+    ss.ActivateNext();
+  }
+  ExpectEq(order, {0, 1, 3, 2});
+}
+
+//a batch of complete binary trees in the parent-idx form,
+//the vertices of a tree are numbered bottom up so that the root comes last
+//an inference activation only holds the rows of one round
+void TestInference() {
+  const int HIDDEN = 8;
+  srand(11);
+  Tensor graph = RandomParseTrees(32, 20);
+  Tensor h("h", GetAllocator("CPU"), DT_FLOAT, TensorShape({2, HIDDEN}));
+  h.Resize(TensorShape({1, HIDDEN}));
+  h.SetAsDynamic();
+  h.SetAsRoundLocal();
+  BatchGraphScheduler gs;
+  gs.SetForwardOnly();
+  CHECK(gs.forward_only());
+  int vertices = gs.LoadGraph(graph);
+  gs.Initialize();
+  int widest = 0;
+  for (; !gs.Terminate(); gs.ActivateNext()) {
+    int jobs = gs.GetJobId().size();
+    widest = std::max(widest, jobs);
+    h.ScaleDynamicDimension(jobs);
+    CHECK(h.dims(0) == jobs && !h.IsFullShape());
+    std::fill(h.mutable_data<float>(), h.mutable_data<float>() + h.count(), 1.f);
+  }
+  CHECK(h.debug_size() <= 2*widest*HIDDEN*sizeof(float));
+  CHECK(widest < vertices) << widest << "\t" << vertices;
+  LOG(INFO) << "Inference activation:\t" << widest << " of "
+            << vertices << " rows";
+}
+
+void BenchmarkBatch(int cache_mb) {
+  const int TREES = 400;
+  const int LEVELS = 8;
+  const int L = (1 << LEVELS) - 1;
+  Tensor graph("graph", GetAllocator("CPU"), DT_INT32, TensorShape({TREES, L}));
+  int* parents = graph.mutable_data<int>();
+  for (int t = 0; t < TREES; t++) {
+    for (int h = 0; h < L; h++)
+      parents[t*L + L-1-h] = (h == 0) ? -1 : L-1-(h-1)/2;
+  }
+
+  FLAGS_graph_schedule_cache_mb = cache_mb;
+  BatchGraphScheduler gs;
+  RunStep(&gs, graph);
+  const int ITERS = 20;
+  int rounds = 0;
+  int64_t allocations_before = allocations;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < ITERS; i++)
+    rounds += RunStep(&gs, graph);
+  std::chrono::duration<double, std::micro> d = std::chrono::steady_clock::now() - start;
+  int64_t steady_allocations = allocations - allocations_before;
+  LOG(INFO) << TREES*L << " vertices, cache " << cache_mb << "MB:\t"
+            << d.count()/ITERS << "us/step\t"
+            << d.count()/rounds << "us/round\t"
+            << steady_allocations << " allocations in " << ITERS << " steps";
+  CHECK(steady_allocations == 0) << steady_allocations;
+}
+
+//the parsing left on the critical path
+//when the schedule of every batch is prepared ahead
+void BenchmarkPrepared() {
+  const int TREES = 400;
+  const int LEVELS = 8;
+  const int L = (1 << LEVELS) - 1;
+  Tensor graph("graph", GetAllocator("CPU"), DT_INT32, TensorShape({TREES, L}));
+  int* parents = graph.mutable_data<int>();
+  for (int t = 0; t < TREES; t++) {
+    for (int h = 0; h < L; h++)
+      parents[t*L + L-1-h] = (h == 0) ? -1 : L-1-(h-1)/2;
+  }
+
+  FLAGS_graph_schedule_cache_mb = 0;
+  const int ITERS = 20;
+  for (bool prepare : {false, true}) {
+    BatchGraphScheduler gs;
+    RunStep(&gs, graph);
+    double parsing = 0;
+    for (int i = 0; i < ITERS; i++) {
+      if (prepare)
+        gs.Prepare(graph);
+      auto start = std::chrono::steady_clock::now();
+      gs.LoadGraph(graph);
+      gs.Initialize();
+      std::chrono::duration<double, std::micro> d = std::chrono::steady_clock::now() - start;
+      parsing += d.count();
+      while (!gs.Terminate())
+        gs.ActivateNext();
+      gs.ReverseGraph();
+      gs.Initialize();
+      while (!gs.Terminate())
+        gs.ActivateNext();
+    }
+    LOG(INFO) << TREES*L << " vertices, " << (prepare ? "prepared" : "not prepared")
+              << ":	" << parsing/ITERS << "us of parsing per step";
+  }
+  FLAGS_graph_schedule_cache_mb = 64;
+}
+
+//the host Gathers of the forward pass over a message pool
+//of SST-sized parse trees, with and without the renumbering
+void BenchmarkRenumber() {
+  const int TREES = 256;
+  const int MAX_LEAVES = 48;
+  const int STRIDE = 1024;
+  srand(11);
+  Tensor graph = RandomParseTrees(TREES, MAX_LEAVES);
+  const int ITERS = 10;
+  double elapsed[2];
+  for (bool renumber : {false, true}) {
+    FLAGS_renumber_message_pool = renumber;
+    BatchGraphScheduler gs;
+    const int total = gs.LoadGraph(graph);
+    vector<float> pool((size_t)total*STRIDE, 1.f), out((size_t)total*STRIDE);
+    std::chrono::duration<double, std::micro> d(0);
+    for (int i = 0; i < ITERS; i++) {
+      gs.LoadGraph(graph);
+      gs.Initialize();
+      while (!gs.Terminate()) {
+        auto start = std::chrono::steady_clock::now();
+        for (int slot = 0; !gs.CurrentRoundTensorIdsForGather(slot).empty(); slot++) {
+          IdRange tids = gs.CurrentRoundTensorIdsForGather(slot);
+          backend::BatchedDynamicSelectedInputSliceCopy<float>(
+              out.data(), STRIDE, pool.data(), STRIDE, tids.data(), tids.size(), STRIDE);
+        }
+        d += std::chrono::steady_clock::now() - start;
+        gs.ActivateNext();
+      }
+    }
+    elapsed[renumber] = d.count()/ITERS;
+    LOG(INFO) << total << " vertices, " << (renumber ? "renumbered" : "in activation order")
+              << ":\tgather locality " << gs.gather_locality()
+              << "\t" << elapsed[renumber] << "us of Gather per step";
+  }
+  LOG(INFO) << "Gather speedup of the renumbering: " << elapsed[0]/elapsed[1];
+  FLAGS_renumber_message_pool = false;
+}
+
+//a mini-batch pays a fixed latency(the launch and the sync of its kernels)
+//and a compute per vertex
+void RunMiniBatch(int vertices) {
+  std::this_thread::sleep_for(std::chrono::microseconds(100));
+  volatile float seed = 0.9999f;
+  float a = seed, x = 1.f;
+  for (int i = 0; i < vertices*2000; i++)
+    x = x*a + 0.0001f;
+  seed = x;
+}
+
+//skewed trees: a chain among small parse trees, the level schedule
+//runs the tail of the chain one vertex a round while the workers of
+//the dataflow scheduler run it along with the parse trees.
+//the workers compute at the same time, which takes as many cores
+void BenchmarkDataflow() {
+  const int TREES = 64;
+  const int CHAIN = 32;
+  const int MAX_LEAVES = 32;
+  const int L = std::max(CHAIN, 2*MAX_LEAVES-1);
+  srand(5);
+  Tensor graph("graph", GetAllocator("CPU"), DT_INT32, TensorShape({TREES, L}));
+  int* parents = graph.mutable_data<int>();
+  std::fill(parents, parents + TREES*L, -1);
+  for (int v = 0; v < CHAIN-1; v++)
+    parents[v] = v+1;
+  for (int t = 1; t < TREES; t++) {
+    vector<int> tree = RandomParseTree(2 + rand() % (MAX_LEAVES-1));
+    std::copy(tree.begin(), tree.end(), parents + t*L);
+  }
+
+  FLAGS_graph_schedule_cache_mb = 0;
+  const int ITERS = 5;
+  BatchGraphScheduler level;
+  int level_rounds = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < ITERS; i++) {
+    level.LoadGraph(graph);
+    for (level.Initialize(); !level.Terminate(); level.ActivateNext()) {
+      RunMiniBatch(level.GetJobId().size());
+      level_rounds++;
+    }
+  }
+  std::chrono::duration<double, std::micro> level_us = std::chrono::steady_clock::now() - start;
+  LOG(INFO) << "Level policy:\t" << level_us.count()/ITERS << "us/step\t"
+            << level_rounds/ITERS << " rounds";
+
+  double best = 0;
+  for (int min_batch : {1, 8}) {
+    DataflowGraphScheduler dataflow(4, min_batch);
+    std::atomic<int> mini_batches(0);
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < ITERS; i++) {
+      dataflow.LoadGraph(graph);
+      dataflow.Initialize();
+      dataflow.Execute([&dataflow, &mini_batches](int worker, int round) {
+        RunMiniBatch(dataflow.RoundJobs(round).size());
+        mini_batches++;
+      });
+    }
+    std::chrono::duration<double, std::micro> d = std::chrono::steady_clock::now() - start;
+    LOG(INFO) << "Dataflow, 4 workers, at least " << min_batch << ":\t"
+              << d.count()/ITERS << "us/step\t" << mini_batches/ITERS << " mini-batches\t"
+              << level_us.count()/d.count() << "x the level policy";
+    best = std::max(best, level_us.count()/d.count());
+  }
+  LOG(INFO) << "Best dataflow speedup on " << std::thread::hardware_concurrency()
+            << " cores: " << best << "x";
+  FLAGS_graph_schedule_cache_mb = 64;
+}
+
+int main() {
+  TestEdgeListVertices();
+  TestBatchForwardBackward();
+  TestBatchFanIn();
+  TestBatchCache();
+  TestBatchPrepare();
+  TestBatchPolicies();
+  TestRenumber();
+  TestTraceAhead();
+  LOG(INFO) << "BatchGraphScheduler passed";
+  TestDataflow();
+  LOG(INFO) << "DataflowGraphScheduler passed";
+  TestRagged();
+  TestInference();
+  TestSerial();
+  LOG(INFO) << "SerialGraphScheduler passed";
+  BenchmarkBatch(0);
+  BenchmarkBatch(64);
+  BenchmarkPrepared();
+  BenchmarkRenumber();
+  BenchmarkDataflow();
+  return 0;
+}
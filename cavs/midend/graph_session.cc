@@ -42,6 +42,16 @@ void DynamicShapeFormat(TensorShape* full_shape,
   partial_shape->SetDim(0, 1);
 }
 
+namespace {
+
+inline std::pair<bool, int> PushPoolKey(const Node* node,
+    const TensorShape& partial_shape) {
+  return std::make_pair(node->input(0)->isGradient(),
+                        partial_shape.n_elements());
+}
+
+} //namespace
+
 OpContext* GraphSession::GetContext(const Node* node) {
   //This context assign the full tensor for each operator
   //But for each function call, it may work on a specific range
@@ -71,6 +81,11 @@ OpContext* GraphSession::GetContext(const Node* node) {
     //And therefore these two dCs should be accumulated.
     const Tensor* t = GetTensor(TensorNameInFunctionContext(output));
     bool dynamic_shape = true;
+    if (t && output->isGradient() && !t->IsDynamicShape()) {
+      auto writer = gradient_writers_.find(t->name());
+      if (writer != gradient_writers_.end() && writer->second != node->scope())
+        t = PartialGradient(t, node, op_def);
+    }
 
     //all the tensors can be categoried into 3 classes
     //1) external tensor. For example, the placeholder/variable defined out of the node function
@@ -129,6 +144,8 @@ OpContext* GraphSession::GetContext(const Node* node) {
         dynamic_shape = rt->IsDynamicShape();
         Tensor out(TensorNameInFunctionContext(output), *rt);
         out.Reshape(output->shape());
+        if (rt->IsRoundLocal())
+          out.SetAsRoundLocal();
         VLOG(V_DEBUG) << "[In Graph Session]: Share Memory Tensor" << out.debug_info();
 
         if (dynamic_shape) {
@@ -155,10 +172,21 @@ OpContext* GraphSession::GetContext(const Node* node) {
         }
         VLOG(V_DEBUG) << "IsDynamicShape: " << dynamic_shape;
 
+        //for inference, no later round reads the activations of a round
+        //except through the message pool or the pushed outputs,
+        //so the other batched tensors only hold one round,
+        //but the hoisted ones are written for all the rounds ahead.
+        //With checkpointing, so do the ones the backward rounds recompute
+        bool round_local = dynamic_shape &&
+                           ((opt_type() & OPT_INFERENCE) ||
+                            recomputed_.find(node) != recomputed_.end()) &&
+                           node->name() != "Push" && node->name() != "Scatter" &&
+                           hoisted_.find(node) == hoisted_.end();
         TensorShape full_shape;
         TensorShape partial_shape;
         if (dynamic_shape) {
-          DynamicShapeFormat(&full_shape, &partial_shape, output->shape(), MAX_NODE_);
+          DynamicShapeFormat(&full_shape, &partial_shape, output->shape(),
+                             round_local ? 2 : MAX_NODE_);
         }else {
           full_shape = std::move(TensorShape(output->shape()));
           partial_shape = full_shape;
@@ -183,21 +211,42 @@ OpContext* GraphSession::GetContext(const Node* node) {
           Tensor out(TensorNameInFunctionContext(output), *internal_message_pool_);
           out.Resize(partial_shape);
           InsertTensor(out);
+        }else if (node->name() == "Push" &&
+                  push_pools_.count(PushPoolKey(node, partial_shape))) {
+          Tensor out(TensorNameInFunctionContext(output),
+                     *push_pools_.at(PushPoolKey(node, partial_shape)));
+          out.Resize(partial_shape);
+          InsertTensor(out);
         }else {
+          const int rows = full_shape.dim(0);
           Tensor out(TensorNameInFunctionContext(output), alloc, op_def.dtype(), std::move(full_shape));
           out.Resize(partial_shape);
+          if (round_local)
+            out.SetAsRoundLocal();
+          if (dynamic_shape && !output->isGradient()) {
+            forward_row_bytes_ += out.debug_size()/rows;
+            if (recomputed_.find(node) != recomputed_.end())
+              recomputed_row_bytes_ += out.debug_size()/rows;
+          }
           InsertTensor(out);
+          if (node->name() == "Push") {
+            push_pools_[PushPoolKey(node, partial_shape)] =
+              GetTensor(TensorNameInFunctionContext(output));
+          }
         }
         CHECK_NOTNULL(t = GetTensor(TensorNameInFunctionContext(output)));
       }
       CHECK_NOTNULL(t = GetTensor(TensorNameInFunctionContext(output)));
       if (output->isGradient() && !can_share_memory)
         const_cast<Tensor*>(t)->SetZeroInitEnforced(); 
+      if (output->isGradient())
+        gradient_writers_.emplace(t->name(), node->scope());
     }else {
       dynamic_shape = false;
     }
 
     if (dynamic_shape) const_cast<Tensor*>(t)->SetAsDynamic();
+    TrackRowSparse(op_def, ctxt->OutputSize(), const_cast<Tensor*>(t));
     VLOG(V_DEBUG) << "[In Graph Session]: the addr of " << TensorNameInFunctionContext(output)
                   << " is " << t;
     ctxt->AppendOutput(const_cast<Tensor*>(t));
@@ -205,6 +254,29 @@ OpContext* GraphSession::GetContext(const Node* node) {
   return ctxt;
 }
 
+//a variable used by both the leaf and the inner vertex functions
+//gets a gradient from each of them, the later one is kept aside
+const Tensor* GraphSession::PartialGradient(const Tensor* t,
+    const Node* node, const OpDef& op_def) {
+  const string name = t->name() + ":" + node->scope()->name();
+  const Tensor* partial = GetTensor(name);
+  if (!partial) {
+    TensorShape shape;
+    for (int i = 0; i < t->dims(); i++)
+      shape.AddDim(t->dims(i));
+    Allocator* alloc = GetAllocator(op_def);
+    CHECK_NOTNULL(alloc);
+    Tensor out(name, alloc, op_def.dtype(), std::move(shape));
+    InsertTensor(out);
+    CHECK_NOTNULL(partial = GetTensor(name));
+    const_cast<Tensor*>(partial)->SetZeroInitEnforced();
+    partial_gradients_.emplace_back(const_cast<Tensor*>(t), partial);
+    VLOG(V_DEBUG) << "[In Graph Session]: " << name
+                  << " is added to " << t->name() << " after the backward pass";
+  }
+  return partial;
+}
+
 namespace __internal {
   static unordered_map<string, GraphSession*> graph_sess_pool;
 }
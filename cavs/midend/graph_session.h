@@ -6,6 +6,9 @@
 #include "cavs/midend/graph_scheduler.h"
 #include "cavs/proto/opt.pb.h"
 
+#include <map>
+#include <unordered_set>
+
 namespace midend {
 
 class SessionBase;
@@ -14,14 +17,23 @@ class GraphSession : public SessionBase {
  public:
   GraphSession(SessionBase* sb, const std::string& name, int max_graph_node_count)
     : SessionBase(sb->opt_type()), internal_message_pool_(NULL),
-      global_sess_(sb),name_(name), MAX_NODE_(max_graph_node_count) {
+      global_sess_(sb),name_(name), MAX_NODE_(max_graph_node_count),
+      forward_row_bytes_(0), recomputed_row_bytes_(0) {
     CHECK(name_.length());
     scope_ = main_scope();
+    CHECK(!(opt_type() & OPT_BATCHING_DATAFLOW))
+      << "the compiled node function runs one round at a time, "
+      << "the dataflow scheduler is only run through DataflowGraphScheduler::Execute";
     if (opt_type() & OPT_BATCHING) {
-      gscheduler_ = new BatchGraphScheduler();
+      gscheduler_ = new BatchGraphScheduler(NewBatchingPolicy(opt_type()));
     }else {
       gscheduler_ = new SerialGraphScheduler();
     }
+    if (opt_type() & OPT_INFERENCE)
+      gscheduler_->SetForwardOnly();
+    if (hoisting()) {
+      dynamic_cast<BatchGraphScheduler*>(gscheduler_)->SetTraceAhead();
+    }
   }
   const Tensor* GetTensor(const std::string& name, bool recursive = false) const override;
   OpContext* GetContext(const Node* node) override;
@@ -33,12 +45,52 @@ class GraphSession : public SessionBase {
   std::string TensorNameInFunctionContext(const Edge* e) const;
   GraphSchedulerBase* graph_scheduler() { return gscheduler_; }
   int session_type() const { return SessionBase::GRAPH; }
+  inline bool hoisting() const {
+    return (opt_type() & OPT_HOISTING) && (opt_type() & OPT_BATCHING);
+  }
+  //the forward nodes run out of the rounds, their outputs keep all the rows
+  inline void Hoist(const Node* node) { hoisted_.insert(node); }
+  inline const std::unordered_set<const Node*>& hoisted() const {
+    return hoisted_;
+  }
+  inline bool checkpointing() const {
+    return opt_type() & OPT_CHECKPOINTING;
+  }
+  //the forward nodes whose outputs hold one round,
+  //the backward rounds run them again before their gradients
+  inline void Recompute(const Node* node) { recomputed_.insert(node); }
+  inline const std::unordered_set<const Node*>& recomputed() const {
+    return recomputed_;
+  }
+  //the bytes per vertex of the batched activations of the forward functions,
+  //and of those the recomputed nodes write
+  inline size_t forward_row_bytes() const { return forward_row_bytes_; }
+  inline size_t recomputed_row_bytes() const { return recomputed_row_bytes_; }
+  //(gradient, partial) pairs, the partial gradient of a variable
+  //computed by a second vertex function is added to the first one's
+  //after the backward pass
+  inline const std::vector<std::pair<Tensor*, const Tensor*>>&
+      partial_gradients() const {
+    return partial_gradients_;
+  }
 
  private:
+  const Tensor* PartialGradient(const Tensor* t, const Node* node,
+                                const OpDef& op_def);
   SessionBase* global_sess_;
   const Scope* scope_;
   GraphSchedulerBase* gscheduler_;
   const Tensor *internal_message_pool_;
+  //the leaf and inner vertex functions push into the same rows,
+  //keyed by (backward, elements of one row)
+  std::map<std::pair<bool, int>, const Tensor*> push_pools_;
+  //the scope of the function that first wrote a gradient
+  std::unordered_map<std::string, const Scope*> gradient_writers_;
+  std::vector<std::pair<Tensor*, const Tensor*>> partial_gradients_;
+  std::unordered_set<const Node*> hoisted_;
+  std::unordered_set<const Node*> recomputed_;
+  size_t forward_row_bytes_;
+  size_t recomputed_row_bytes_;
   const int MAX_NODE_;
   std::string name_;
 };
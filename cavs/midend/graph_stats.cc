@@ -0,0 +1,59 @@
+#include "cavs/midend/graph_stats.h"
+#include "cavs/util/logging.h"
+
+#include <sstream>
+
+using std::string;
+
+namespace midend {
+
+void GraphStats::Reset() {
+  batches = rounds = vertices = statements = 0;
+  for (int i = 0; i < HISTOGRAM_BUCKETS; i++)
+    round_histogram[i] = 0;
+  schedule_ms = compute_ms = 0;
+}
+
+void GraphStats::Merge(const GraphStats& s) {
+  batches    += s.batches;
+  rounds     += s.rounds;
+  vertices   += s.vertices;
+  statements += s.statements;
+  for (int i = 0; i < HISTOGRAM_BUCKETS; i++)
+    round_histogram[i] += s.round_histogram[i];
+  schedule_ms += s.schedule_ms;
+  compute_ms  += s.compute_ms;
+}
+
+void GraphStats::AddRound(int jobs, int stmts) {
+  CHECK(jobs > 0) << jobs;
+  int bucket = 0;
+  while (bucket+1 < HISTOGRAM_BUCKETS && (jobs >> (bucket+1)))
+    bucket++;
+  round_histogram[bucket]++;
+  rounds++;
+  statements += stmts;
+}
+
+string GraphStats::DebugString() const {
+  std::ostringstream out;
+  out << batches << " batches\t" << rounds << " rounds\t"
+      << vertices << " vertices\t";
+  if (batches > 0) {
+    out << (float)rounds/batches << " rounds and "
+        << (float)vertices/batches << " vertices per batch\t";
+  }
+  if (rounds > 0)
+    out << (float)vertices/rounds << " jobs per round\t";
+  if (vertices > 0)
+    out << (float)statements/vertices << " statements per vertex\t";
+  out << "scheduling " << schedule_ms << "ms, computing " << compute_ms << "ms\t"
+      << "rounds by jobs:";
+  for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+    if (round_histogram[i] > 0)
+      out << " [" << (int64_t(1) << i) << "," << (int64_t(2) << i) << "):" << round_histogram[i];
+  }
+  return out.str();
+}
+
+} //namespace midend
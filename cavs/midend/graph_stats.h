@@ -0,0 +1,37 @@
+#ifndef CAVS_MIDEND_GRAPH_STATS_H_
+#define CAVS_MIDEND_GRAPH_STATS_H_
+
+#include <string>
+#include <stdint.h>
+
+namespace midend {
+
+//How well the rounds of a graph statement batch the vertices,
+//summed over the batches it ran since the last reset.
+//The times are taken on the host, so for the device ops
+//the compute time is the time to launch them.
+struct GraphStats {
+  //bucket k counts the rounds of [2^k, 2^(k+1)) jobs
+  static const int HISTOGRAM_BUCKETS = 32;
+
+  GraphStats() { Reset(); }
+  void Reset();
+  void Merge(const GraphStats& s);
+  //a round ran statements over jobs vertices
+  void AddRound(int jobs, int statements);
+  std::string DebugString() const;
+
+  int64_t batches;
+  int64_t rounds;
+  int64_t vertices;
+  //the vertex-function statements run, each over all the jobs of its round
+  int64_t statements;
+  int64_t round_histogram[HISTOGRAM_BUCKETS];
+  //the scheduler calls, and the rest of the runs
+  double schedule_ms;
+  double compute_ms;
+};
+
+} //namespace midend
+
+#endif
@@ -137,10 +137,12 @@ void GraphUtil::GenGradient(Scope* loss_scope,
         CHECK_NOTNULL(grad_node);
         //CHECK(gnode_map.find(i) != gnode_map.end());
         //dynamic_cast<GraphGradNode*>(grad_node)->SetGraphForwardNode(gnode_map[i]);
-        for (auto&& func_name : {"Node"}) {
+        for (auto&& func_name : {"Node", "Leaf"}) {
           //find the childscope of father or ancestor(optimizer case)
           VLOG(V_DEBUG) << "Compute Gradient for " << func_name << "...";
           const Scope* func_scope = s_->FindChildScope(func_name);
+          if (!func_scope && string(func_name) == "Leaf")
+            continue;
           Scope* func_grad_scope = new Scope(func_scope, GetGradientName(func_name));
           CHECK(func_scope);
           CHECK(func_grad_scope);
@@ -0,0 +1,221 @@
+#include "cavs/midend/inter_op_executor.h"
+#include "cavs/util/logging.h"
+#include "cavs/util/op_util.h"
+
+#include <set>
+#include <algorithm>
+
+DEFINE_int32(inter_op_threads, 0,
+    "threads running the independent statements of an executor with OPT_INTER_OP, "
+    "0 uses one per core");
+
+using std::string;
+using std::vector;
+using std::list;
+using std::set;
+using std::unordered_map;
+
+namespace midend {
+
+namespace {
+
+//whether the statement has to keep its order among the others of its kind
+bool IsSerial(const Node* node, Statement* stmt) {
+  if (node->IsStatefulOp())
+    return true;
+  OpContext* ctxt = dynamic_cast<ExprStatement*>(stmt)->GetContext();
+  CHECK_NOTNULL(ctxt);
+  for (int i = 0; i < ctxt->InputSize(); i++) {
+    const Tensor& t = ctxt->Input(i);
+    if (!t.empty() && (t.device_type() == GPU || t.IsDynamicShape()))
+      return true;
+  }
+  for (int i = 0; i < ctxt->OutputSize(); i++) {
+    const Tensor* t = ctxt->Output(i);
+    if (!t->empty() && (t->device_type() == GPU || t->IsDynamicShape()))
+      return true;
+  }
+  return false;
+}
+
+inline bool IsShareMemory(const Node* node) {
+  return node->IsSingleNode() && node->input_size() > 0 && node->output_size() == 1 &&
+         GetSingleArg<bool>(dynamic_cast<const SingleNode*>(node)->op_def(),
+                            "ShareMemory", false);
+}
+
+} //namespace
+
+InterOpExecutor::InterOpExecutor()
+    : running_(NULL), remaining_(0), stopping_(false) {
+  int threads = FLAGS_inter_op_threads;
+  if (threads <= 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  for (int i = 1; i < threads; i++)
+    workers_.emplace_back(&InterOpExecutor::WorkerLoop, this);
+}
+
+InterOpExecutor::~InterOpExecutor() {
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    stopping_ = true;
+  }
+  cv_.notify_all();
+  for (auto& t : workers_)
+    t.join();
+}
+
+//the tensors are told apart by their raw names, the scopes see the same
+//buffer under one raw name, and a view is the tensor it shares
+void InterOpExecutor::Plan(const list<Node*>& nodes,
+    const vector<Statement*>& executor) {
+  CHECK(nodes.size() == executor.size());
+  unordered_map<const Node*, int> index;
+  unordered_map<string, string> alias;
+  unordered_map<string, int> writer;
+  unordered_map<string, vector<int>> readers;
+  vector<vector<int>> deps(executor.size());
+  vector<int> since_barrier;
+  int barrier = -1;
+  int serial = -1;
+  auto Key = [&alias](const Edge* edge) {
+    auto it = alias.find(edge->name());
+    return (it == alias.end()) ? edge->name() : it->second;
+  };
+
+  int i = 0;
+  for (const Node* node : nodes) {
+    Statement* stmt = executor[i];
+    set<int> d;
+    if (stmt->type() != Statement::EXPR) {
+      d.insert(since_barrier.begin(), since_barrier.end());
+      if (barrier >= 0)
+        d.insert(barrier);
+      since_barrier.clear();
+      writer.clear();
+      readers.clear();
+      barrier = i;
+      serial = -1;
+    }else {
+      if (barrier >= 0)
+        d.insert(barrier);
+      if (IsSerial(node, stmt)) {
+        if (serial >= 0)
+          d.insert(serial);
+        serial = i;
+      }
+      for (auto* edge : node->control_dependency()) {
+        for (auto* src : edge->src(true)) {
+          if (index.find(src) != index.end())
+            d.insert(index.at(src));
+        }
+      }
+      for (auto* edge : node->input()) {
+        const string key = Key(edge);
+        if (writer.find(key) != writer.end())
+          d.insert(writer.at(key));
+        readers[key].push_back(i);
+      }
+      if (IsShareMemory(node)) {
+        alias[node->output(0)->name()] = Key(node->input(0));
+      }else {
+        for (auto* edge : node->output()) {
+          const string key = Key(edge);
+          if (writer.find(key) != writer.end())
+            d.insert(writer.at(key));
+          for (int r : readers[key]) {
+            if (r != i)
+              d.insert(r);
+          }
+          writer[key] = i;
+          readers[key].clear();
+        }
+      }
+      since_barrier.push_back(i);
+    }
+    deps[i].assign(d.begin(), d.end());
+    index[node] = i++;
+  }
+  Plan(executor, std::move(deps));
+}
+
+void InterOpExecutor::Plan(const vector<Statement*>& executor,
+    vector<vector<int>>&& deps) {
+  CHECK(deps.size() == executor.size());
+  CHECK(dags_.find(&executor) == dags_.end());
+  Dag& dag = dags_[&executor];
+  dag.stmts = executor;
+  dag.succ.resize(executor.size());
+  dag.preds.resize(executor.size());
+  //the longest chain of dependencies, in statements
+  vector<int> depth(executor.size(), 1);
+  int critical = 0;
+  for (int i = 0; i < deps.size(); i++) {
+    for (int j : deps[i]) {
+      CHECK(j >= 0 && j < i) << "statement " << i << " depends on " << j;
+      dag.succ[j].push_back(i);
+      depth[i] = std::max(depth[i], depth[j]+1);
+    }
+    dag.preds[i] = deps[i].size();
+    critical = std::max(critical, depth[i]);
+  }
+  LOG(INFO) << "Inter-op executor:\t" << executor.size() << " statements, "
+            << critical << " on the longest chain, "
+            << threads() << " threads";
+}
+
+void InterOpExecutor::Run(const vector<Statement*>& executor) {
+  CHECK(dags_.find(&executor) != dags_.end()) << "The executor is not planned";
+  const Dag& dag = dags_.at(&executor);
+  if (dag.stmts.empty())
+    return;
+  std::unique_lock<std::mutex> lock(mu_);
+  CHECK(!running_) << "Only one run at a time";
+  running_ = &dag;
+  pending_ = dag.preds;
+  remaining_ = dag.stmts.size();
+  for (int i = 0; i < dag.preds.size(); i++) {
+    if (dag.preds[i] == 0)
+      ready_.push_back(i);
+  }
+  cv_.notify_all();
+  while (remaining_ > 0) {
+    if (!ready_.empty())
+      RunReady(&lock);
+    else
+      cv_.wait(lock, [this] { return remaining_ == 0 || !ready_.empty(); });
+  }
+  running_ = NULL;
+}
+
+void InterOpExecutor::WorkerLoop() {
+  std::unique_lock<std::mutex> lock(mu_);
+  while (true) {
+    cv_.wait(lock, [this] { return stopping_ || !ready_.empty(); });
+    if (stopping_)
+      return;
+    RunReady(&lock);
+  }
+}
+
+//runs the oldest ready statement with the lock released,
+//then hands out the statements it was the last dependency of
+void InterOpExecutor::RunReady(std::unique_lock<std::mutex>* lock) {
+  const int i = ready_.front();
+  ready_.pop_front();
+  const Dag* dag = running_;
+  lock->unlock();
+  dag->stmts[i]->Run();
+  lock->lock();
+  bool released = false;
+  for (int s : dag->succ[i]) {
+    if (--pending_[s] == 0) {
+      ready_.push_back(s);
+      released = true;
+    }
+  }
+  if (--remaining_ == 0 || released)
+    cv_.notify_all();
+}
+
+} //namespace midend
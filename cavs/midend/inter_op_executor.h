@@ -0,0 +1,64 @@
+#ifndef CAVS_MIDEND_INTER_OP_EXECUTOR_H_
+#define CAVS_MIDEND_INTER_OP_EXECUTOR_H_
+
+#include "cavs/midend/statement.h"
+#include "cavs/midend/node.h"
+
+#include <list>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
+
+namespace midend {
+
+//Runs the statements of an executor on a pool of threads(--inter_op_threads),
+//each one once the statements it depends on are done.
+//A statement depends on the producers of the tensors it reads,
+//on the readers and the writers before it of the tensors it writes,
+//and on its control dependencies.
+//The rest keep the order of the executor:
+//the stateful ops, the device ops(they share the stream and the library handles)
+//and the ops on dynamically shaped tensors(they share the dynamic dimension)
+//run one after another, and the loops and the graph statements,
+//whose bodies reach tensors out of their edges, wait for everything before them
+//and are waited for by everything after them.
+class InterOpExecutor {
+ public:
+  InterOpExecutor();
+  ~InterOpExecutor();
+  //the executor is compiled from the nodes, in the same order
+  void Plan(const std::list<Node*>& nodes, const std::vector<Statement*>& executor);
+  //statement i of the executor runs after the statements deps[i], all before it
+  void Plan(const std::vector<Statement*>& executor,
+            std::vector<std::vector<int>>&& deps);
+  //the calling thread runs statements as well, it returns when all are done
+  void Run(const std::vector<Statement*>& executor);
+  inline int threads() const { return workers_.size()+1; }
+
+ private:
+  struct Dag {
+    std::vector<Statement*> stmts;
+    std::vector<std::vector<int>> succ;
+    std::vector<int> preds;
+  };
+  void WorkerLoop();
+  void RunReady(std::unique_lock<std::mutex>* lock);
+
+  std::unordered_map<const std::vector<Statement*>*, Dag> dags_;
+  std::vector<std::thread> workers_;
+  std::mutex mu_;
+  std::condition_variable cv_;
+  //the run in flight, guarded by mu_
+  const Dag* running_;
+  std::vector<int> pending_;
+  std::deque<int> ready_;
+  int remaining_;
+  bool stopping_;
+};
+
+} //namespace midend
+
+#endif
@@ -0,0 +1,88 @@
+#include "cavs/midend/inter_op_executor.h"
+#include "cavs/util/logging.h"
+
+#include <gflags/gflags.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+DECLARE_int32(inter_op_threads);
+
+using namespace midend;
+using std::vector;
+
+//sleeps, and records when it began and ended on a shared clock
+class SleepStatement : public Statement {
+ public:
+  SleepStatement(int ms, std::atomic<int>* clock)
+    : ms_(ms), clock_(clock), begin_(-1), end_(-1) {}
+  void Run() override {
+    begin_ = (*clock_)++;
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms_));
+    end_ = (*clock_)++;
+  }
+  SType type() const override { return EXPR; }
+  int begin_;
+  int end_;
+
+ private:
+  int ms_;
+  std::atomic<int>* clock_;
+};
+
+//  0 -> 1, 0 -> 2, 0 -> 3, 0 -> 4, {1, 2, 3, 4} -> 5
+void TestFanOutFanIn() {
+  std::atomic<int> clock(0);
+  vector<SleepStatement> sleeps;
+  for (int i = 0; i < 6; i++)
+    sleeps.emplace_back(50, &clock);
+  vector<Statement*> executor;
+  for (auto& s : sleeps)
+    executor.push_back(&s);
+  InterOpExecutor exe;
+  CHECK(exe.threads() == 4) << exe.threads();
+  exe.Plan(executor, {{}, {0}, {0}, {0}, {0}, {1, 2, 3, 4}});
+
+  for (int run = 0; run < 3; run++) {
+    clock = 0;
+    auto begin = std::chrono::steady_clock::now();
+    exe.Run(executor);
+    int ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - begin).count();
+    for (int i = 1; i < 5; i++) {
+      CHECK(sleeps[i].begin_ > sleeps[0].end_);
+      CHECK(sleeps[5].begin_ > sleeps[i].end_);
+    }
+    //the four in the middle overlap, sequentially it takes 300ms
+    CHECK(ms < 250) << ms;
+  }
+}
+
+//a chain keeps its order whatever the threads
+void TestChain() {
+  std::atomic<int> clock(0);
+  vector<SleepStatement> sleeps;
+  for (int i = 0; i < 8; i++)
+    sleeps.emplace_back(1, &clock);
+  vector<Statement*> executor;
+  vector<vector<int>> deps;
+  for (int i = 0; i < 8; i++) {
+    executor.push_back(&sleeps[i]);
+    deps.push_back(i == 0 ? vector<int>() : vector<int>({i-1}));
+  }
+  InterOpExecutor exe;
+  exe.Plan(executor, std::move(deps));
+  exe.Run(executor);
+  for (int i = 0; i < 8; i++) {
+    CHECK(sleeps[i].begin_ == 2*i && sleeps[i].end_ == 2*i+1)
+        << i << "\t" << sleeps[i].begin_ << "\t" << sleeps[i].end_;
+  }
+}
+
+int main() {
+  FLAGS_inter_op_threads = 4;
+  TestFanOutFanIn();
+  TestChain();
+  LOG(INFO) << "InterOpExecutor passed";
+  return 0;
+}
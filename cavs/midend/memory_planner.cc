@@ -0,0 +1,270 @@
+#include "cavs/midend/memory_planner.h"
+#include "cavs/midend/allocator.h"
+#include "cavs/util/logging.h"
+#include "cavs/util/op_util.h"
+
+#include <algorithm>
+
+using std::vector;
+using std::set;
+using std::shared_ptr;
+using std::unordered_map;
+
+namespace midend {
+
+namespace {
+
+const size_t SLAB_ALIGNMENT = 256;
+
+inline size_t AlignUp(size_t size) {
+  return (size + SLAB_ALIGNMENT - 1) / SLAB_ALIGNMENT * SLAB_ALIGNMENT;
+}
+
+inline float MB(size_t bytes) {
+  return bytes / (1024.f*1024.f);
+}
+
+} //namespace
+
+struct MemoryPlanner::Slab {
+  Slab(Allocator* a, size_t n)
+    : alloc(a), size(n), data(a->AllocateRaw(n)) {}
+  ~Slab() { alloc->DeallocateRaw(data); }
+  Allocator* const alloc;
+  const size_t size;
+  void* const data;
+
+  DISALLOW_COPY_AND_ASSIGN(Slab);
+};
+
+//a fixed range of a slab,
+//the planned tensors are static shaped and never resized
+class MemoryPlanner::SlabViewBuffer : public TensorBufferBase {
+ public:
+  SlabViewBuffer(shared_ptr<Slab> slab, size_t offset, size_t size)
+    : TensorBufferBase(slab->alloc), slab_(slab),
+      offset_(offset), size_(size) {
+    CHECK(offset_ + size_ <= slab_->size);
+  }
+  FORCE_INLINE void* data() const override {
+    return (char*)slab_->data + offset_;
+  }
+  FORCE_INLINE size_t size() const override { return size_; }
+  FORCE_INLINE void InitWithZero() override {
+    alloc_->InitWithZero(data(), size());
+  }
+  void* Resize(size_t size) override {
+    LOG(FATAL) << "A planned buffer can not be resized: "
+               << size_ << " -> " << size;
+    return NULL;
+  }
+
+ private:
+  shared_ptr<Slab> slab_;
+  size_t offset_;
+  size_t size_;
+
+  DISALLOW_COPY_AND_ASSIGN(SlabViewBuffer);
+};
+
+void MemoryPlanner::Snapshot() {
+  existing_.clear();
+  for (auto* m : {&sess_->raw_tensor_map_, &sess_->scoped_tensor_map_}) {
+    for (auto& one_pair : *m) {
+      if (!one_pair.second.empty())
+        existing_.insert(one_pair.second.buf_.get());
+    }
+  }
+}
+
+vector<Tensor*> MemoryPlanner::Aliases(TensorBufferBase* buf) {
+  vector<Tensor*> ret;
+  for (auto* m : {&sess_->raw_tensor_map_, &sess_->scoped_tensor_map_}) {
+    for (auto& one_pair : *m) {
+      if (one_pair.second.buf_.get() == buf)
+        ret.push_back(&one_pair.second);
+    }
+  }
+  return ret;
+}
+
+void MemoryPlanner::Rebind(TensorBufferBase* buf,
+    shared_ptr<TensorBufferBase> view) {
+  //the contexts hold pointers to the tensors in the map,
+  //so replacing the buffer in place is visible to every statement
+  for (auto* t : Aliases(buf))
+    t->buf_ = view;
+}
+
+void MemoryPlanner::Unplan(TensorBufferBase* buf) {
+  CHECK(views_.find(buf) != views_.end());
+  Allocator* alloc = GetAllocator(DeviceTypeToString(buf->device_type()));
+  shared_ptr<Slab> slab(new Slab(alloc, buf->size()));
+  shared_ptr<TensorBufferBase> view(new SlabViewBuffer(slab, 0, buf->size()));
+  views_.erase(buf);
+  Rebind(buf, view);
+}
+
+void MemoryPlanner::Touch(const Tensor* t, int step, bool write, bool pin) {
+  if (!t || t->empty())
+    return;
+  Lifetime& l = lifetimes_[t->buf_.get()];
+  if (l.first < 0) {
+    l.first = step;
+    l.first_is_write = write;
+  }
+  l.last = std::max(l.last, step);
+  l.pinned |= pin;
+}
+
+void MemoryPlanner::PinContext(OpContext* ctxt) {
+  if (!ctxt)
+    return;
+  for (int i = 0; i < ctxt->InputSize(); i++)
+    Touch(&ctxt->Input(i), 0, false, true);
+  for (int i = 0; i < ctxt->OutputSize(); i++)
+    Touch(ctxt->Output(i), 0, true, true);
+}
+
+int MemoryPlanner::Visit(Statement* stmt, int step, bool pin) {
+  CHECK_NOTNULL(stmt);
+  if (stmt->type() == Statement::EXPR) {
+    OpContext* ctxt = dynamic_cast<ExprStatement*>(stmt)->GetContext();
+    CHECK_NOTNULL(ctxt);
+    //the outputs of placeholders/variables/data are fed from outside
+    bool source = (ctxt->InputSize() == 0);
+    for (int i = 0; i < ctxt->InputSize(); i++)
+      Touch(&ctxt->Input(i), step, false, pin);
+    for (int i = 0; i < ctxt->OutputSize(); i++)
+      Touch(ctxt->Output(i), step, true, pin || source);
+    return step+1;
+  }else if (stmt->type() == Statement::BASICBLOCK) {
+    BasicBlock* bb = dynamic_cast<BasicBlock*>(stmt);
+    //the tensors of a loop body are carried across iterations
+    for (auto* s : bb->stmts_)
+      step = Visit(s, step, pin || bb->iter_ > 1);
+    return step;
+  }else {
+    CHECK(stmt->type() == Statement::FUNCCALL);
+    //the node function is run by the graph scheduler with its own session,
+    //every tensor of the global session it can reach stays where it is
+    FunctionCallStatement* fc = dynamic_cast<FunctionCallStatement*>(stmt);
+    PinContext(fc->global_ctxt_);
+    if (fc->push_arg_stmt_)
+      Visit(fc->push_arg_stmt_, step, true);
+    if (fc->pop_ret_stmt_)
+      Visit(fc->pop_ret_stmt_, step, true);
+    if (GraphStatement* gs = dynamic_cast<GraphStatement*>(stmt)) {
+      if (gs->node_func_)
+        Visit(gs->node_func_, step, true);
+      if (gs->leaf_func_)
+        Visit(gs->leaf_func_, step, true);
+      for (auto* s : gs->node_hoisted_)
+        Visit(s, step, true);
+      for (auto* s : gs->leaf_hoisted_)
+        Visit(s, step, true);
+    }
+    if (GraphGradStatement* ggs = dynamic_cast<GraphGradStatement*>(stmt)) {
+      for (auto* s : ggs->batch_weight_updates_)
+        Visit(s, step, true);
+      for (auto* s : ggs->node_recomputed_)
+        Visit(s, step, true);
+      for (auto* s : ggs->leaf_recomputed_)
+        Visit(s, step, true);
+    }
+    return step+1;
+  }
+}
+
+void MemoryPlanner::Plan(const vector<Statement*>& executor,
+    const set<const Tensor*>& pinned) {
+  lifetimes_.clear();
+  for (auto* t : pinned) {
+    if (t && !t->empty())
+      lifetimes_[t->buf_.get()].pinned = true;
+  }
+  int step = 0;
+  for (auto* stmt : executor)
+    step = Visit(stmt, step, false);
+
+  //a buffer planned for another executor is used here as well,
+  //the two plans can not share one slab, it moves to a private one
+  for (auto& one_pair : lifetimes_) {
+    if (views_.find(one_pair.first) != views_.end())
+      Unplan(one_pair.first);
+  }
+
+  unordered_map<int, vector<Candidate>> candidates;
+  for (auto& one_pair : lifetimes_) {
+    TensorBufferBase* buf = one_pair.first;
+    const Lifetime& l = one_pair.second;
+    if (l.pinned || l.first < 0 || !l.first_is_write ||
+        existing_.find(buf) != existing_.end() ||
+        buf->size() == 0) {
+      continue;
+    }
+    //all the tensors sharing the buffer(ShareMemory outputs,
+    //gradient slices) must be static and owned only by the session maps
+    vector<Tensor*> aliases = Aliases(buf);
+    if (aliases.empty() ||
+        aliases[0]->buf_.use_count() != aliases.size()) {
+      continue;
+    }
+    bool plannable = true;
+    for (auto* t : aliases)
+      plannable &= !t->IsDynamicShape() && !t->ZeroInitEnforced();
+    if (!plannable)
+      continue;
+    Candidate c = {buf, AlignUp(buf->size()), 0, l};
+    candidates[buf->device_type()].push_back(c);
+  }
+
+  for (auto& one_pair : candidates) {
+    vector<Candidate>& cands = one_pair.second;
+    std::sort(cands.begin(), cands.end(),
+        [](const Candidate& a, const Candidate& b) {
+          return a.size > b.size ||
+                 (a.size == b.size && a.life.first < b.life.first);
+        });
+    //greedy by size, the lowest offset that does not collide
+    //with any placed buffer whose lifetime overlaps
+    size_t total = 0;
+    size_t before = 0;
+    for (int i = 0; i < cands.size(); i++) {
+      Candidate& c = cands[i];
+      vector<std::pair<size_t, size_t>> busy;
+      for (int j = 0; j < i; j++) {
+        const Candidate& o = cands[j];
+        if (o.life.last >= c.life.first && c.life.last >= o.life.first)
+          busy.emplace_back(o.offset, o.offset + o.size);
+      }
+      std::sort(busy.begin(), busy.end());
+      size_t offset = 0;
+      for (auto& range : busy) {
+        if (offset + c.size <= range.first)
+          break;
+        offset = std::max(offset, range.second);
+      }
+      c.offset = offset;
+      total = std::max(total, offset + c.size);
+      before += c.buf->size();
+    }
+
+    DeviceType dev = (DeviceType)one_pair.first;
+    Allocator* alloc = GetAllocator(DeviceTypeToString(dev));
+    CHECK_NOTNULL(alloc);
+    shared_ptr<Slab> slab(new Slab(alloc, total));
+    for (auto& c : cands) {
+      shared_ptr<TensorBufferBase> view(
+          new SlabViewBuffer(slab, c.offset, c.buf->size()));
+      Rebind(c.buf, view);
+      views_.insert(view.get());
+    }
+    LOG(INFO) << "Memory planner placed " << cands.size()
+              << " tensors on " << DeviceTypeToString(dev) << ":\t"
+              << MB(before) << "MB -> " << MB(total) << "MB";
+  }
+  lifetimes_.clear();
+}
+
+} //namespace midend
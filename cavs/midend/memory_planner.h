@@ -0,0 +1,63 @@
+#ifndef CAVS_MIDEND_MEMORY_PLANNER_H_
+#define CAVS_MIDEND_MEMORY_PLANNER_H_
+
+#include "cavs/midend/session_base.h"
+#include "cavs/midend/statement.h"
+#include "cavs/midend/tensor.h"
+
+#include <memory>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+namespace midend {
+
+//The planner places the intermediate tensors of one executor
+//into a few pre-allocated slabs(one per device).
+//Two tensors share the same bytes of a slab
+//if their lifetimes over the executor do not overlap.
+//Only the statically shaped tensors which are written before being read,
+//and not referenced by anyone else(placeholders, variables, fetched outputs,
+//function contexts, stateful outputs) are planned.
+class MemoryPlanner {
+ public:
+  explicit MemoryPlanner(SessionBase* sess) : sess_(sess) {}
+  //records the buffers that exist before compiling an executor,
+  //they may be used by other executors and are never planned
+  void Snapshot();
+  void Plan(const std::vector<Statement*>& executor,
+            const std::set<const Tensor*>& pinned);
+
+ private:
+  struct Slab;
+  class SlabViewBuffer;
+  struct Lifetime {
+    Lifetime() : first(-1), last(-1), first_is_write(false), pinned(false) {}
+    int first;
+    int last;
+    bool first_is_write;
+    bool pinned;
+  };
+  struct Candidate {
+    TensorBufferBase* buf;
+    size_t size;
+    size_t offset;
+    Lifetime life;
+  };
+
+  int Visit(Statement* stmt, int step, bool pin);
+  void Touch(const Tensor* t, int step, bool write, bool pin);
+  void PinContext(OpContext* ctxt);
+  std::vector<Tensor*> Aliases(TensorBufferBase* buf);
+  void Rebind(TensorBufferBase* buf, std::shared_ptr<TensorBufferBase> view);
+  void Unplan(TensorBufferBase* buf);
+
+  SessionBase* sess_;
+  std::set<TensorBufferBase*> existing_;
+  std::set<TensorBufferBase*> views_;
+  std::unordered_map<TensorBufferBase*, Lifetime> lifetimes_;
+};
+
+} //namespace midend
+
+#endif
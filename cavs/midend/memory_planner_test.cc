@@ -0,0 +1,130 @@
+#include "cavs/midend/memory_planner.h"
+#include "cavs/midend/op_context.h"
+#include "cavs/midend/statement.h"
+#include "cavs/util/logging.h"
+
+#include <string.h>
+#include <map>
+
+using namespace midend;
+using std::string;
+using std::vector;
+
+const int kRows = 64;
+const int kCols = 32;
+
+class PlannerSession : public SessionBase {
+ public:
+  Tensor* Add(const string& name) {
+    {
+      Tensor t("test:" + name, GetAllocator("CPU"), DT_FLOAT,
+          TensorShape(vector<int>{kRows, kCols}));
+      InsertTensor(t);
+    }
+    return Get(name);
+  }
+  //a ShareMemory output, the view and the source share one buffer
+  Tensor* AddView(const string& name, const string& source) {
+    {
+      Tensor t("test:" + name, *Get(source));
+      t.Reshape(vector<int>{kRows*kCols});
+      InsertTensor(t);
+    }
+    return Get(name);
+  }
+  Tensor* Get(const string& name) {
+    return const_cast<Tensor*>(GetTensor("test:" + name));
+  }
+};
+
+//the statements are never run, the planner only reads their contexts
+Statement* Expr(const vector<Tensor*>& inputs, const vector<Tensor*>& outputs) {
+  OpContext* ctxt = new OpContext();
+  for (auto* t : inputs)  ctxt->AppendInput(t);
+  for (auto* t : outputs) ctxt->AppendOutput(t);
+  return new ExprStatement(NULL, ctxt);
+}
+
+struct Range {
+  const char* begin;
+  const char* end;
+  int first;
+  int last;
+};
+
+//  step 0: x -> a        (x is a placeholder)
+//  step 1: a -> b, p     (p is pinned)
+//  step 2: b -> c        (v is a ShareMemory view of c)
+//  step 3: b -> d
+//  step 4: v, d -> e
+//  step 5: e -> f        (f is fetched)
+void TestPlan() {
+  PlannerSession sess;
+  MemoryPlanner planner(&sess);
+  planner.Snapshot();
+  for (auto name : {"x", "a", "b", "p", "c", "d", "e", "f"})
+    sess.Add(name);
+  sess.AddView("v", "c");
+  auto T = [&sess](const string& name) { return sess.Get(name); };
+
+  vector<Statement*> executor = {
+    Expr({}, {T("x")}),
+    Expr({T("x")}, {T("a")}),
+    Expr({T("a")}, {T("b"), T("p")}),
+    Expr({T("b")}, {T("c")}),
+    Expr({T("b")}, {T("d")}),
+    Expr({T("v"), T("d")}, {T("e")}),
+    Expr({T("e")}, {T("f")}),
+  };
+  //the steps of the planner start at the placeholder
+  std::map<string, std::pair<int, int>> lifetimes = {
+    {"a", {1, 2}}, {"b", {2, 4}}, {"c", {3, 5}},
+    {"d", {4, 5}}, {"e", {5, 6}},
+  };
+  vector<string> pinned_names = {"x", "p", "f"};
+  std::map<string, const char*> pinned_data;
+  for (auto& name : pinned_names)
+    pinned_data[name] = T(name)->data<char>();
+
+  planner.Plan(executor, {T("p"), T("f")});
+
+  //the view is rebound together with its source
+  CHECK(T("v")->data<char>() == T("c")->data<char>());
+  //the pinned tensors keep their own buffers
+  for (auto& name : pinned_names) {
+    CHECK(T(name)->data<char>() == pinned_data[name]) << name;
+    for (auto& one_pair : lifetimes)
+      CHECK(T(name)->data<char>() != T(one_pair.first)->data<char>())
+        << name << "\t" << one_pair.first;
+  }
+  //no two live tensors overlap, and the buffers of disjoint lifetimes are reused
+  const size_t bytes = kRows*kCols*sizeof(float);
+  vector<std::pair<string, Range>> ranges;
+  for (auto& one_pair : lifetimes) {
+    const char* data = T(one_pair.first)->data<char>();
+    ranges.push_back({one_pair.first,
+        {data, data + bytes, one_pair.second.first, one_pair.second.second}});
+  }
+  int shared = 0;
+  for (int i = 0; i < ranges.size(); i++) {
+    for (int j = i+1; j < ranges.size(); j++) {
+      const Range& r0 = ranges[i].second;
+      const Range& r1 = ranges[j].second;
+      bool live = (r0.last >= r1.first && r1.last >= r0.first);
+      bool overlap = (r0.begin < r1.end && r1.begin < r0.end);
+      CHECK(!(live && overlap)) << ranges[i].first << "\t" << ranges[j].first;
+      shared += overlap;
+    }
+  }
+  CHECK(shared > 0);
+
+  //the planned buffers are usable
+  for (auto& one_pair : lifetimes)
+    memset(T(one_pair.first)->mutable_data<char>(), 0, bytes);
+  LOG(INFO) << "memory planner passed, " << shared << " pairs share bytes";
+}
+
+int main() {
+  TestPlan();
+  return 0;
+}
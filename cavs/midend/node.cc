@@ -3,6 +3,8 @@
 #include "cavs/midend/runtime_compiler/code_generator.h"
 #include "cavs/midend/stream_scheduler.h"
 #include "cavs/midend/batch_weight_updater.h"
+#include "cavs/midend/pull_path_hoister.h"
+#include "cavs/midend/activation_checkpointer.h"
 #include "cavs/util/op_def_builder.h"
 
 using std::string;
@@ -10,6 +12,57 @@ using std::vector;
 
 namespace midend {
 
+namespace {
+
+vector<Statement*> CompileEach(const std::list<Node*>& nodes, SessionBase* sess) {
+  vector<Statement*> stmts;
+  for (Node* n : nodes) {
+    Statement* stmt = n->Compile(sess);
+    CHECK(stmt) << n->debug_info();
+    stmts.push_back(stmt);
+  }
+  return stmts;
+}
+
+//the forward nodes hoisted out of the rounds are compiled
+//ahead of the function that reads them
+vector<Statement*> HoistForward(ScopedNode* sn, GraphSession* gsess) {
+  std::list<Node*> hoisted;
+  if (gsess->hoisting()) {
+    PullPathHoister hoister(&(sn->nodes_), &hoisted);
+  }
+  for (Node* n : hoisted)
+    gsess->Hoist(n);
+  return CompileEach(hoisted, gsess);
+}
+
+//marked ahead of the compilation of the forward function,
+//which allocates the tensors of the recomputed nodes round-local
+void CheckpointForward(ScopedNode* sn, GraphSession* gsess) {
+  if (!gsess->checkpointing())
+    return;
+  std::list<Node*> recomputed;
+  ActivationCheckpointer checkpointer(sn->nodes_, gsess->hoisted(), &recomputed);
+  for (Node* n : recomputed)
+    gsess->Recompute(n);
+}
+
+//the statements of the compiled forward function the backward rounds rerun
+vector<Statement*> RecomputedStatements(const string& func, GraphSession* gsess) {
+  vector<Statement*> stmts;
+  if (!gsess->checkpointing())
+    return stmts;
+  ScopedNode* sn = dynamic_cast<ScopedNode*>(main_scope()->FindNode(func));
+  CHECK_NOTNULL(sn);
+  for (Node* n : sn->nodes_) {
+    if (gsess->recomputed().find(n) != gsess->recomputed().end())
+      stmts.push_back(n->Compile(gsess));
+  }
+  return stmts;
+}
+
+} //namespace
+
 Node::Node(Scope* located) : 
   located_(located), inputs_(0), outputs_(0), stmt_(NULL) {
   located->AddNode(this);
@@ -124,13 +177,13 @@ Statement* GraphNode::Compile(
     OpDef push_arg_def;
     OpDefBuilder("FunctionPushArg")
       .Input(this->input(1)->name())
-      .Device("GPU")
+      .Device(op_def_)
       .Finalize(&push_arg_def);
     OpImpl *push_arg_op = CreateOp(push_arg_def);
     OpDef pop_ret_def;
     OpDefBuilder("FunctionPopRet")
       .Output(this->output(0)->name())
-      .Device("GPU")
+      .Device(op_def_)
       .Finalize(&pop_ret_def);
     OpImpl *pop_ret_op = CreateOp(pop_ret_def);
     OpContext* push_ctxt = ctxt->ExtractContext({1}, {});
@@ -161,11 +214,30 @@ Statement* GraphNode::Compile(
       }
     }
     CHECK_NOTNULL(gsess_);
+    vector<Statement*> node_hoisted = HoistForward(sn, gsess_);
+    CheckpointForward(sn, gsess_);
     Statement* node_func_stmt = sn->Compile(gsess_);
 
+    //the rounds of leaves run their own function once it is defined
+    Statement* leaf_func_stmt = NULL;
+    vector<Statement*> leaf_hoisted;
+    if (Scope* leaf_func = main_scope()->FindChildScope("Leaf")) {
+      ScopedNode* leaf_sn = dynamic_cast<ScopedNode*>(main_scope()->FindNode("Leaf"));
+      if (!leaf_sn) {
+        leaf_sn = new ScopedNode(main_scope(), "Leaf", 1);
+        leaf_sn->SetContainedScope(leaf_func);
+      }
+      leaf_hoisted = HoistForward(leaf_sn, gsess_);
+      CheckpointForward(leaf_sn, gsess_);
+      leaf_func_stmt = leaf_sn->Compile(gsess_);
+    }
+
     push_ctxt->SetGraphScheduler(gsess_->graph_scheduler());
     push_arg_stmt = new ExprStatement(push_arg_op, push_ctxt);
     stmt_ = new GraphStatement(node_func_stmt, gsess_->graph_scheduler());
+    dynamic_cast<GraphStatement*>(stmt_)->SetLeafFunction(leaf_func_stmt);
+    dynamic_cast<GraphStatement*>(stmt_)->SetHoistedStatements(
+        std::move(node_hoisted), std::move(leaf_hoisted));
     dynamic_cast<GraphStatement*>(stmt_)->SetGlobalContext(ctxt);
     dynamic_cast<GraphStatement*>(stmt_)->SetPushArgStatement(push_arg_stmt);
     if (pop_exist) {
@@ -191,13 +263,13 @@ Statement* GraphGradNode::Compile(
     OpDef push_arg_def;
     OpDefBuilder("FunctionPushArg")
       .Input(this->input(0)->name())
-      .Device("GPU")
+      .Device(op_def_)
       .Finalize(&push_arg_def);
     OpImpl *push_arg_op = CreateOp(push_arg_def);
     OpDef pop_ret_def;
     OpDefBuilder("FunctionPopRet")
       .Output(this->output(0)->name())
-      .Device("GPU")
+      .Device(op_def_)
       .Finalize(&pop_ret_def);
     OpImpl* pop_ret_op   = CreateOp(pop_ret_def);
     OpContext* push_ctxt = ctxt->ExtractContext({0}, {});
@@ -233,7 +305,15 @@ Statement* GraphGradNode::Compile(
       VLOG(V_DEBUG) << "Modifing the critical path done for Batching in ScopedNode";
     }
 
+    //the gradients of the hoisted forward nodes are computed after the rounds,
+    //ahead of the weight updates that read them
+    std::list<Node*> hoisted;
+    if (gsess_->hoisting()) {
+      PullPathHoister hoister(&(sn->nodes_), &hoisted, finalize_node, gsess_->hoisted());
+    }
+
     Statement* node_grad_stmt = sn->Compile(gsess_);
+    vector<Statement*> node_hoisted = CompileEach(hoisted, gsess_);
 
     if (sess->opt_type() & OPT_BATCHING) {
       for (Node* fn : finalize_node) {
@@ -243,9 +323,59 @@ Statement* GraphGradNode::Compile(
       }
     }
 
+    //the leaf function is compiled after the node function,
+    //the variables both of them use get partial gradients from the session
+    //which are added to the real ones once the backward pass is done
+    Statement* leaf_grad_stmt = NULL;
+    vector<Statement*> leaf_hoisted;
+    vector<Statement*> leaf_recomputed;
+    if (const Scope* leaf_func = main_scope()->FindChildScope("Leaf")) {
+      leaf_recomputed = RecomputedStatements("Leaf", gsess_);
+      ScopedNode* leaf_sn = dynamic_cast<ScopedNode*>(leaf_func->FindNode(GetGradientName("Leaf")));
+      if (!leaf_sn) {
+        Scope* leaf_grad_func = leaf_func->FindChildScope(GetGradientName("Leaf"));
+        CHECK_NOTNULL(leaf_grad_func);
+        leaf_sn = new ScopedNode(main_scope(), GetGradientName("Leaf"), 1);
+        leaf_sn->SetContainedScope(leaf_grad_func);
+      }
+      std::list<Node*> leaf_finalize_node;
+      if (sess->opt_type() & OPT_BATCHING)
+        BatchingWeightUpdater updater(&(leaf_sn->nodes_), &leaf_finalize_node);
+      std::list<Node*> hoisted;
+      if (gsess_->hoisting()) {
+        PullPathHoister hoister(&(leaf_sn->nodes_), &hoisted,
+                                leaf_finalize_node, gsess_->hoisted());
+      }
+      leaf_grad_stmt = leaf_sn->Compile(gsess_);
+      leaf_hoisted = CompileEach(hoisted, gsess_);
+      for (Node* fn : leaf_finalize_node) {
+        Statement* stmt = fn->Compile(gsess_);
+        CHECK(stmt) << fn->debug_info();
+        batch_weight_update.push_back(stmt);
+      }
+      for (auto& grads : gsess_->partial_gradients()) {
+        OpDef accu_def;
+        OpDefBuilder("Accumulate")
+          .Input(grads.second->name())
+          .Output(grads.first->name())
+          .Device(op_def_)
+          .Finalize(&accu_def);
+        OpContext* accu_ctxt = new OpContext();
+        accu_ctxt->AppendInput(grads.second);
+        accu_ctxt->AppendOutput(grads.first);
+        batch_weight_update.push_back(new ExprStatement(CreateOp(accu_def), accu_ctxt));
+      }
+    }
+
     push_ctxt->SetGraphScheduler(gsess_->graph_scheduler());
     push_arg_stmt = new ExprStatement(push_arg_op, push_ctxt);
     stmt_ = new GraphGradStatement(node_grad_stmt, gsess_->graph_scheduler());
+    dynamic_cast<GraphGradStatement*>(stmt_)->SetLeafFunction(leaf_grad_stmt);
+    dynamic_cast<GraphGradStatement*>(stmt_)->SetHoistedStatements(
+        std::move(node_hoisted), std::move(leaf_hoisted));
+    dynamic_cast<GraphGradStatement*>(stmt_)->SetRecomputedStatements(
+        RecomputedStatements("Node", gsess_), std::move(leaf_recomputed),
+        gsess_->forward_row_bytes(), gsess_->recomputed_row_bytes());
     dynamic_cast<GraphGradStatement*>(stmt_)->SetGlobalContext(ctxt);
     dynamic_cast<GraphGradStatement*>(stmt_)->SetPushArgStatement(push_arg_stmt);
     if (pop_exist) {
@@ -17,7 +17,9 @@ void OpContext::SetTensorOffset() {
     //just choose the right offset of the input tensor buffer
     for (auto* t : inputs_) {
       //if (!(t->IsFullShape())) {
-      if (t->IsDynamicShape()) {
+      if (t->IsRoundLocal()) {
+        VLOG(V_DEBUG) << t->name() << " is round-local and starts from row 0";
+      }else if (t->IsDynamicShape()) {
         VLOG(V_DEBUG) << "Setting offset for " << t->name() << "\t" << gs_->GetCurrentRoundOffset();
         const_cast<Tensor*>(t)->SetOffsetWithId(gs_->GetCurrentRoundOffset());
       }else {
@@ -27,7 +29,9 @@ void OpContext::SetTensorOffset() {
     }
     for (auto* t : outputs_) {
       //if (!(t->IsFullShape())) {
-      if (t->IsDynamicShape()) {
+      if (t->IsRoundLocal()) {
+        VLOG(V_DEBUG) << t->name() << " is round-local and starts from row 0";
+      }else if (t->IsDynamicShape()) {
         VLOG(V_DEBUG) << "Setting offset for " << t->name() << "\t" << gs_->GetCurrentRoundOffset();
         VLOG(V_DEBUG) << t->debug_info();
         t->SetOffsetWithId(gs_->GetCurrentRoundOffset());
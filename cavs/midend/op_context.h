@@ -4,6 +4,7 @@
 #include "cavs/midend/tensor.h"
 #include "cavs/midend/graph_scheduler.h"
 #include "cavs/proto/op_def.pb.h"
+#include "cavs/backend/cpu_thread_pool.h"
 #include "cavs/util/stream_event_handle_pool.h"
 
 #include <unordered_map>
@@ -26,6 +27,10 @@ class OpContext {
   inline int GetStreamID() const { return stream_id_; }
   inline void SetWaitForEventId(int eid) { wait_for_event_id_ = eid; }
   inline void SetEventRecord(int eid) { event_record_id_ = eid; }
+  //the threads of the process the CPU kernels split their loops over
+  inline ::backend::IntraOpThreadPool* intra_op_pool() const {
+    return ::backend::IntraOpThreadPool::Global();
+  }
 
   //the followings are all about optimizations
   inline void SetRound(int r) { round_ = r; }
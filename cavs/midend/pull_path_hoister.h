@@ -0,0 +1,123 @@
+#ifndef CAVS_MIDEND_PULL_PATH_HOISTER_H_
+#define CAVS_MIDEND_PULL_PATH_HOISTER_H_
+
+#include "cavs/midend/node.h"
+
+#include <list>
+#include <unordered_set>
+
+namespace midend {
+
+//The nodes of a vertex function that read nothing but the pulled inputs
+//and the variables do not depend on the rounds. They are moved out of
+//the round loop and run once over the rows of all the vertices,
+//so that the many small batches of the rounds become one large one.
+class PullPathHoister {
+ public:
+  //the forward function: Pull and whatever is computed from
+  //the pulled inputs and the tensors outside the function only
+  PullPathHoister(std::list<Node*>* nodes, std::list<Node*>* hoisted) {
+    CHECK(!nodes->empty());
+    CHECK(hoisted->empty());
+    Scope* s = nodes->front()->scope();
+    std::unordered_set<const Node*> moved;
+    for (auto iter = nodes->begin(); iter != nodes->end(); ) {
+      CHECK((*iter)->scope() == s);
+      bool invariant = ((*iter)->name() != "Gather" && (*iter)->name() != "Scatter");
+      for (Edge* e : (*iter)->input()) {
+        for (Node* src : e->src()) {
+          if (src->scope() == s && moved.find(src) == moved.end())
+            invariant = false;
+        }
+      }
+      if (invariant) {
+        VLOG(V_DEBUG) << "Hoisting " << (*iter)->debug_info();
+        moved.insert(*iter);
+        hoisted->push_back(*iter);
+        nodes->erase(iter++);
+      }else {
+        iter++;
+      }
+    }
+  }
+
+  //the backward function, after the BatchingWeightUpdater:
+  //the nodes computing the gradients of the batched edges
+  //the forward hoisting moved, and the Push of the gradients
+  //of the pulled inputs. They read the rows all the rounds have
+  //written, so they run once the rounds are done
+  PullPathHoister(std::list<Node*>* nodes, std::list<Node*>* hoisted,
+                  const std::list<Node*>& finalize_node,
+                  const std::unordered_set<const Node*>& forward_hoisted) {
+    CHECK(!nodes->empty());
+    CHECK(hoisted->empty());
+    Scope* s = nodes->front()->scope();
+    auto hoisted_forward_edge = [&](const Edge* e) -> const Edge* {
+      if (!e->isGradient())
+        return NULL;
+      const Edge* forward_e = s->FindEdge(GetOriginName(e->name()));
+      CHECK(forward_e);
+      for (Node* src : forward_e->src()) {
+        if (forward_hoisted.find(src) != forward_hoisted.end())
+          return forward_e;
+      }
+      return NULL;
+    };
+
+    std::unordered_set<const Node*> moved;
+    for (Node* n : *nodes) {
+      CHECK(n->scope() == s);
+      if (n->name() == "Gather" || n->name() == "Scatter" || n->name() == "Pull")
+        continue;
+      bool invariant = true;
+      bool batched = false;
+      if (n->name() == "Push") {
+        invariant = batched = (hoisted_forward_edge(n->input(0)) != NULL);
+      }else {
+        for (Edge* e : n->output()) {
+          const Edge* forward_e = hoisted_forward_edge(e);
+          if (!forward_e)
+            invariant = false;
+          else if (forward_e->IsDynamicEnabled())
+            batched = true;
+        }
+      }
+      if (invariant && batched)
+        moved.insert(n);
+    }
+
+    //a node read by the rounds stays in them
+    bool changed = true;
+    while (changed) {
+      changed = false;
+      for (Node* n : *nodes) {
+        if (moved.find(n) == moved.end())
+          continue;
+        for (Edge* e : n->output()) {
+          for (Node* dst : e->dst(true)) {
+            if (moved.find(dst) == moved.end() &&
+                std::find(finalize_node.begin(), finalize_node.end(), dst) ==
+                  finalize_node.end()) {
+              moved.erase(n);
+              changed = true;
+            }
+          }
+        }
+      }
+    }
+
+    for (auto iter = nodes->begin(); iter != nodes->end(); ) {
+      if (moved.find(*iter) != moved.end()) {
+        VLOG(V_DEBUG) << "Hoisting " << (*iter)->debug_info();
+        hoisted->push_back(*iter);
+        nodes->erase(iter++);
+      }else {
+        iter++;
+      }
+    }
+  }
+};
+
+} //namespace midend
+
+#endif
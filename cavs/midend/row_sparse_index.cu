@@ -0,0 +1,53 @@
+#include "cavs/midend/row_sparse_index.h"
+#include "cavs/util/logging.h"
+#include "cavs/util/macros_gpu.h"
+
+namespace midend {
+
+//one block per listed row, the blocks beyond the count exit
+__global__ void ZeroListedRowsKernel(float* data, int width,
+    const int* ids, const int* count, int* listed) {
+  if (blockIdx.x >= *count) return;
+  const int row = ids[blockIdx.x];
+  for (int i = threadIdx.x; i < width; i += blockDim.x)
+    data[row*width + i] = 0;
+  if (threadIdx.x == 0)
+    listed[row] = 0;
+}
+
+RowSparseIndex::RowSparseIndex(Allocator* alloc, int rows)
+    : alloc_(alloc), rows_(rows), bound_(0), overflow_(false) {
+  CHECK(alloc_->type() == GPU);
+  CHECK(rows_ > 0);
+  //the GPU allocator hands out zeroed memory
+  ids_    = alloc_->Allocate<int>(rows_);
+  count_  = alloc_->Allocate<int>(1);
+  listed_ = alloc_->Allocate<int>(rows_);
+}
+
+RowSparseIndex::~RowSparseIndex() {
+  alloc_->Deallocate<int>(ids_);
+  alloc_->Deallocate<int>(count_);
+  alloc_->Deallocate<int>(listed_);
+}
+
+void RowSparseIndex::Clear(void* data, size_t row_bytes) {
+  CHECK(row_bytes % sizeof(float) == 0) << row_bytes;
+  if (overflow_) {
+    checkCudaError(cudaMemsetAsync(data, 0, rows_*row_bytes, cudaStreamDefault));
+    if (bound_ > 0)
+      checkCudaError(cudaMemsetAsync(listed_, 0, rows_*sizeof(int), cudaStreamDefault));
+  }else if (bound_ > 0) {
+    const int width = row_bytes/sizeof(float);
+    const int threads = std::min(width, 512);
+    ZeroListedRowsKernel<<<bound_, threads, 0, cudaStreamDefault>>>(
+        reinterpret_cast<float*>(data), width, ids_, count_, listed_);
+    checkCudaError(cudaGetLastError());
+  }
+  if (bound_ > 0)
+    checkCudaError(cudaMemsetAsync(count_, 0, sizeof(int), cudaStreamDefault));
+  bound_ = 0;
+  overflow_ = false;
+}
+
+} //namespace midend
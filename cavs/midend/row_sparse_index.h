@@ -0,0 +1,53 @@
+#ifndef CAVS_MIDEND_ROW_SPARSE_INDEX_H_
+#define CAVS_MIDEND_ROW_SPARSE_INDEX_H_
+
+#include "cavs/midend/allocator.h"
+#include "cavs/util/macros.h"
+
+#include <algorithm>
+
+namespace midend {
+
+//The rows of a gradient written since it was last zeroed.
+//It is kept by the buffer of the gradient, so every scope sees the same rows.
+//A writer lists a row once however often it adds to it(see functor_row_sparse.cuh),
+//the listed rows are unique and their values are merged in the dense buffer.
+//The readers and the zeroing only touch the listed rows,
+//until a dense write overflows the index for the rest of the iteration.
+class RowSparseIndex {
+ public:
+  RowSparseIndex(Allocator* alloc, int rows);
+  ~RowSparseIndex();
+  //on the device: the listed rows, their number,
+  //and whether each row of the buffer is listed
+  FORCE_INLINE int* ids()    const { return ids_;    }
+  FORCE_INLINE int* count()  const { return count_;  }
+  FORCE_INLINE int* listed() const { return listed_; }
+  FORCE_INLINE int rows()    const { return rows_;   }
+  //an upper bound of *count() known on the host, the grids are sized by it
+  FORCE_INLINE int bound()   const { return bound_;  }
+  FORCE_INLINE void AddToBound(int rows) {
+    bound_ = std::min(rows_, bound_ + rows);
+  }
+  //any row may be nonzero until the next zeroing
+  FORCE_INLINE bool overflow() const { return overflow_; }
+  FORCE_INLINE void SetOverflow() { overflow_ = true; }
+  //zeroes the listed rows of data, or all of them after an overflow,
+  //and empties the index
+  void Clear(void* data, size_t row_bytes);
+
+ private:
+  Allocator* alloc_;
+  int* ids_;
+  int* count_;
+  int* listed_;
+  int rows_;
+  int bound_;
+  bool overflow_;
+
+  DISALLOW_COPY_AND_ASSIGN(RowSparseIndex);
+};
+
+} //namespace midend
+
+#endif
@@ -67,9 +67,11 @@ void Scope::AddGraphOpTransformation(OpDef* new_def, const OpDef& def) {
   set<string> inputs;
   for (auto& i : new_def->input())
     inputs.insert(i);
-  //for (auto&& func : {"Inode", "Leaf"}) {
-  for (auto&& func : {"Node"}) {
+  for (auto&& func : {"Node", "Leaf"}) {
     const Scope* func_scope = FindChildScope(func);
+    //the leaf function is optional
+    if (!func_scope && string(func) == "Leaf")
+      continue;
     //the function may defined in the current scope(current scope == main)
     //or the ancestor scope(current scope == optimizer)
     CHECK_NOTNULL(func_scope);
@@ -85,11 +85,22 @@ OpContext* SessionBase::GetContext(const Node* node) {
       CHECK(node->output_size() == 1);
       const_cast<Tensor*>(t)->SetZeroInitEnforced(); 
     }
+    TrackRowSparse(op_def, ctxt->OutputSize(), const_cast<Tensor*>(t));
     ctxt->AppendOutput(const_cast<Tensor*>(t));
   }
   return ctxt;
 }
 
+void SessionBase::TrackRowSparse(const OpDef& op_def, int output, Tensor* t) {
+  if ((op_def.name() == GetGradientName("EmbeddingLookup") && output == 0) ||
+      op_def.name() == "Accumulate") {
+    t->SetRowSparse(true);
+  }else if (op_def.name() != "Clip" &&
+            !GetSingleArg<bool>(op_def, "ShareMemory", false)) {
+    t->SetRowSparse(false);
+  }
+}
+
 string SessionBase::debug_info() const {
   string ret;
   for (auto& one_pair : scoped_tensor_map_)
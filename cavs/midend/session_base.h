@@ -10,6 +10,7 @@ namespace midend {
 
 class OpContext;
 class Node;
+struct GraphStats;
 class SessionBase {
  public:
   explicit SessionBase(int opt = 0) : opt_(opt) {}
@@ -21,6 +22,19 @@ class SessionBase {
                    const std::vector<Tensor>& input_tensors) {
     LOG(FATAL) << "Base Session";
   }
+  //stages the inputs of a coming Run, see OPT_PIPELINING
+  virtual void Prefetch(const std::vector<std::string>& input_names,
+                        const std::vector<Tensor>& input_tensors) {
+    LOG(FATAL) << "Prefetching is not supported by this session";
+  }
+  //the batching of the forward and the backward graph statements
+  //since the last reset, summed over the statements of each kind
+  virtual void GetGraphStats(GraphStats* forward, GraphStats* backward) const {
+    LOG(FATAL) << "Graph statistics are not supported by this session";
+  }
+  virtual void ResetGraphStats() {
+    LOG(FATAL) << "Graph statistics are not supported by this session";
+  }
 
   enum SessionType { SIMPLE=1, MPI=2, GRAPH=4 };
   virtual int session_type() const {}
@@ -29,7 +43,12 @@ class SessionBase {
 
   void InsertTensor(const Tensor& t);
   std::string debug_info() const ;
+  friend class MemoryPlanner;
+
  protected:
+  //the gradient of EmbeddingLookup lists the rows it writes,
+  //Accumulate and Clip keep the rows of their inputs
+  static void TrackRowSparse(const OpDef& op_def, int output, Tensor* t);
   std::unordered_map<std::string, Tensor> raw_tensor_map_;
   std::unordered_map<std::string, Tensor> scoped_tensor_map_;
   //int type_;
@@ -2,6 +2,7 @@
 #include "cavs/midend/statement.h"
 #include "cavs/backend/op_impl_mpi_functor.h"
 #include "cavs/util/op_def_builder.h"
+#include "cavs/proto/opt.pb.h"
 
 #include <mpi.h>
 #include <unordered_map>
@@ -81,6 +82,8 @@ void AddMPIOnPath(list<Node*>& critical_path) {
 
 MPISession::MPISession(int opt) : SimpleSession(opt) {
   //type_ = (int)MPI;
+  //the collectives have to be issued in the same order by every process
+  CHECK(!(opt & OPT_INTER_OP)) << "OPT_INTER_OP is not supported by MPISession";
   MPI_Init(NULL, NULL);
 }
 
@@ -3,7 +3,10 @@
 #include "cavs/util/logging.h"
 #include "cavs/util/macros_gpu.h"
 #include "cavs/util/op_def_builder.h"
+#include "cavs/util/tracer.h"
+#include "cavs/proto/opt.pb.h"
 
+#include <algorithm>
 #include <iterator>
 
 using std::string;
@@ -13,7 +16,33 @@ using std::set;
 
 namespace midend {
 
-SimpleSession::SimpleSession(int opt) : SessionBase(opt), s_(main_scope()) {}
+SimpleSession::SimpleSession(int opt)
+    : SessionBase(opt), s_(main_scope()), planner_(NULL), inter_op_(NULL),
+      staged_head_(0), staged_count_(0), stopping_(false) {
+  if (opt & OPT_MEMORY_PLANNING)
+    planner_ = new MemoryPlanner(this);
+  if (opt & OPT_INTER_OP) {
+    //the planned buffers are shared by the order of the executor
+    CHECK(!(opt & OPT_MEMORY_PLANNING))
+        << "OPT_INTER_OP does not work with OPT_MEMORY_PLANNING";
+    inter_op_ = new InterOpExecutor();
+  }
+  if (opt & OPT_PIPELINING)
+    preparer_ = std::thread(&SimpleSession::PrepareLoop, this);
+}
+
+SimpleSession::~SimpleSession() {
+  if (preparer_.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      stopping_ = true;
+    }
+    cv_.notify_all();
+    preparer_.join();
+  }
+  if (planner_) delete planner_;
+  if (inter_op_) delete inter_op_;
+}
 
 void SimpleSession::DepthSearch(Node* curr,
     list<Node*>* critical_path,
@@ -77,34 +106,166 @@ void SimpleSession::Compile(
 
   CHECK(executors_.find(HashString(output_names)) == executors_.end());
   vector<Statement*>* executor = &executors_[HashString(output_names)];
+  if (planner_)
+    planner_->Snapshot();
   for (auto* node : critical_path) {
     Statement* stmt = node->Compile(this);
     CHECK(stmt);
     executor->push_back(stmt);
   }
 
+  if (planner_) {
+    //the fetched outputs are handed to the user after the run
+    set<const Tensor*> pinned;
+    for (auto& output : output_names) {
+      const Edge* edge = s_->FindEdge(output);
+      if (edge && !edge->isVirtual() && GetTensor(edge->scoped_name()))
+        pinned.insert(GetTensor(edge->scoped_name()));
+    }
+    planner_->Plan(*executor, pinned);
+  }
+  if (inter_op_)
+    inter_op_->Plan(critical_path, *executor);
+
+  for (auto* stmt : *executor)
+    CollectGraphStatements(stmt);
   return;
 }
 
+//the graph tensors of the forward graph statements are
+//the ones worth preparing, the backward ones reuse their schedule
+void SimpleSession::CollectGraphStatements(Statement* stmt) {
+  if (stmt->type() == Statement::BASICBLOCK) {
+    for (auto* s : dynamic_cast<BasicBlock*>(stmt)->stmts_)
+      CollectGraphStatements(s);
+  }else if (stmt->type() == Statement::FUNCCALL) {
+    if (GraphGradStatement* ggs = dynamic_cast<GraphGradStatement*>(stmt)) {
+      if (std::find(graph_grad_stmts_.begin(), graph_grad_stmts_.end(), ggs)
+          == graph_grad_stmts_.end()) {
+        graph_grad_stmts_.push_back(ggs);
+      }
+    }else if (GraphStatement* gs = dynamic_cast<GraphStatement*>(stmt)) {
+      if (std::find(graph_stmts_.begin(), graph_stmts_.end(), gs) == graph_stmts_.end())
+        graph_stmts_.push_back(gs);
+    }
+  }
+}
+
+void SimpleSession::GetGraphStats(GraphStats* forward, GraphStats* backward) const {
+  if (forward) {
+    forward->Reset();
+    for (auto* gs : graph_stmts_)
+      forward->Merge(gs->stats());
+  }
+  if (backward) {
+    backward->Reset();
+    for (auto* ggs : graph_grad_stmts_)
+      backward->Merge(ggs->stats());
+  }
+}
+
+void SimpleSession::ResetGraphStats() {
+  for (auto* gs : graph_stmts_)
+    gs->ResetStats();
+  for (auto* ggs : graph_grad_stmts_)
+    ggs->ResetStats();
+}
+
+void SimpleSession::PrepareLoop() {
+  while (true) {
+    StagedBatch* batch;
+    {
+      std::unique_lock<std::mutex> lock(mu_);
+      cv_.wait(lock, [this] { return stopping_ || !to_prepare_.empty(); });
+      if (stopping_)
+        return;
+      batch = to_prepare_.front();
+    }
+    for (auto& g : batch->graphs)
+      g.first->Prepare(batch->tensors[g.second]);
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      to_prepare_.pop_front();
+      batch->prepared = true;
+    }
+    cv_.notify_all();
+  }
+}
+
+void SimpleSession::Prefetch(const vector<string>& input_names,
+    const vector<Tensor>& input_tensors) {
+  CHECK(opt_ & OPT_PIPELINING) << "Prefetching needs OPT_PIPELINING";
+  CHECK(input_names.size() == input_tensors.size());
+  CHECK(!input_names.empty());
+  CHECK(staged_count_ < 2) << "Only two batches can be staged ahead";
+  //a free slot is never read by the preparing thread
+  StagedBatch& batch = staged_[(staged_head_ + staged_count_) % 2];
+  batch.names = input_names;
+  batch.tensors.resize(input_tensors.size());
+  batch.graphs.clear();
+  Allocator* alloc = GetAllocator(DeviceTypeToString(CPU));
+  for (int i = 0; i < input_names.size(); i++) {
+    Tensor& t = batch.tensors[i];
+    const Tensor& in = input_tensors[i];
+    if (t.empty() || t.count() != in.count() || t.data_type() != in.data_type())
+      t.Rebase(alloc, in);
+    t.SyncWith(in);
+    const Edge* edge = s_->FindEdge(input_names[i]);
+    CHECK(edge) << "Edge: " << input_names[i];
+    const Tensor* fed = GetTensor(edge->scoped_name());
+    for (auto* gs : graph_stmts_) {
+      if (&gs->graph_struct() == fed)
+        batch.graphs.emplace_back(gs->graph_scheduler(), i);
+    }
+  }
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    batch.prepared = batch.graphs.empty();
+    if (!batch.prepared)
+      to_prepare_.push_back(&batch);
+  }
+  cv_.notify_all();
+  staged_count_++;
+}
+
 void SimpleSession::Run(const vector<string>& output_names,
     vector<Tensor>* output_tensors,
     const vector<string>& input_names,
     const vector<Tensor>& input_tensors) {
+  Tracer::BeginRun();
   VLOG(V_TIMING) << "Compiling for calculating the output ...";
   if (executors_.find(HashString(output_names)) == executors_.end()) {
     Compile(output_names);
   }
   VLOG(V_TIMING) << "Feeding inputs...";
-  FeedInput(input_names, input_tensors);
+  if (input_names.empty() && staged_count_ > 0) {
+    StagedBatch& batch = staged_[staged_head_];
+    {
+      std::unique_lock<std::mutex> lock(mu_);
+      cv_.wait(lock, [&batch] { return batch.prepared; });
+    }
+    FeedInput(batch.names, batch.tensors);
+    staged_head_ = (staged_head_ + 1) % 2;
+    staged_count_--;
+  }else {
+    //the prepared schedules would not match the batches run
+    CHECK(staged_count_ == 0) << "Inputs are fed while batches are staged";
+    FeedInput(input_names, input_tensors);
+  }
   VLOG(V_TIMING) << "Executing...";
-  for (auto* exe : executors_[HashString(output_names)]) {
-    exe->Run();
+  if (inter_op_) {
+    inter_op_->Run(executors_[HashString(output_names)]);
+  }else {
+    for (auto* exe : executors_[HashString(output_names)]) {
+      exe->Run();
+    }
   }
   VLOG(V_TIMING) << "Fetching output..";
   FetchOutput(output_names, output_tensors);
   VLOG(V_TIMING) << "Execution completed";
   Statement::IncRound();
   checkCudaError(cudaDeviceSynchronize());
+  Tracer::EndRun();
 }
 
 void SimpleSession::FeedInput(const vector<string>& input_names,
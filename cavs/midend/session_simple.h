@@ -4,19 +4,35 @@
 #include "cavs/midend/session_base.h"
 #include "cavs/midend/scope.h"
 #include "cavs/midend/statement.h"
+#include "cavs/midend/memory_planner.h"
+#include "cavs/midend/inter_op_executor.h"
 
 #include <set>
 #include <list>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
 
 namespace midend {
 
 class SimpleSession : public SessionBase {
  public:
   SimpleSession(int opt);
+  ~SimpleSession();
   void Run(const std::vector<std::string>& output_names, 
            std::vector<Tensor>* output_tensors,
            const std::vector<std::string>& input_names,
            const std::vector<Tensor>& input_tensors) override;
+  //With OPT_PIPELINING, the inputs of a coming Run are copied aside
+  //and the graphs among them are handed to their schedulers
+  //on a background thread, while the current batch is running.
+  //A Run without inputs consumes the oldest staged batch.
+  //At most two batches can be staged ahead.
+  void Prefetch(const std::vector<std::string>& input_names,
+                const std::vector<Tensor>& input_tensors) override;
+  void GetGraphStats(GraphStats* forward, GraphStats* backward) const override;
+  void ResetGraphStats() override;
   int session_type() const override { return SIMPLE; }
 
  protected:
@@ -33,6 +49,30 @@ class SimpleSession : public SessionBase {
 
  protected:
   const Scope* s_;
+  MemoryPlanner* planner_;
+  InterOpExecutor* inter_op_;
+
+ private:
+  struct StagedBatch {
+    StagedBatch() : prepared(true) {}
+    std::vector<std::string> names;
+    std::vector<Tensor> tensors;
+    //(scheduler, index of its graph in tensors)
+    std::vector<std::pair<GraphSchedulerBase*, int>> graphs;
+    bool prepared;
+  };
+  void CollectGraphStatements(Statement* stmt);
+  void PrepareLoop();
+  std::vector<GraphStatement*> graph_stmts_;
+  std::vector<GraphGradStatement*> graph_grad_stmts_;
+  StagedBatch staged_[2];
+  int staged_head_;
+  int staged_count_;
+  std::thread preparer_;
+  std::mutex mu_;
+  std::condition_variable cv_;
+  std::deque<StagedBatch*> to_prepare_;
+  bool stopping_;
 };
 
 } //namespace midend
@@ -1,13 +1,54 @@
 #include "cavs/midend/statement.h"
 #include "cavs/util/timing.h"
 
+#include <algorithm>
+
+DEFINE_int32(graph_stats_every_n_batches, 0,
+    "logs the batching statistics of each graph statement every n batches, 0 disables it");
+
+//a scheduler call, on the timeline and in the scheduling time of the run
+#define TRACE_SCHEDULER(name, call)             \
+  do {                                          \
+    TraceScope trace("scheduler", name);        \
+    const int64_t begin_ns = Tracer::NowNs();   \
+    call;                                       \
+    schedule_ns_ += Tracer::NowNs() - begin_ns; \
+  } while (0)
+
 namespace midend {
 
+namespace {
+
+//[2,150],[150,600]->[2,600]
+std::string TensorShapes(OpContext* ctxt) {
+  auto shape = [](const Tensor& t) {
+    std::string ret = "[";
+    for (int i = 0; i < t.dims(); i++)
+      ret += (i ? "," : "") + std::to_string(t.dims(i));
+    return ret + "]";
+  };
+  std::string ret;
+  for (int i = 0; i < ctxt->InputSize(); i++)
+    ret += (i ? "," : "") + shape(ctxt->Input(i));
+  ret += "->";
+  for (int i = 0; i < ctxt->OutputSize(); i++)
+    ret += (i ? "," : "") + shape(*ctxt->Output(i));
+  return ret;
+}
+
+inline int StatementCount(const Statement* stmt) {
+  const BasicBlock* bb = dynamic_cast<const BasicBlock*>(stmt);
+  return bb ? bb->size() : 1;
+}
+
+} //namespace
+
 int Statement::round_ = 0;
 
 void ExprStatement::Run() {
   CHECK(op_);
   CHECK(ctxt_);
+  TraceScope trace("op", "");
   VLOG(V_TIMING) << "======================================";
   VLOG(V_TIMING) << "Running Operator " << op_->DebugInfo(V_TIMING);
   VLOG(V_DEBUG)  << "Running Operator " << op_->DebugInfo(V_DEBUG);
@@ -33,6 +74,10 @@ void ExprStatement::Run() {
   ctxt_->WaitForEvent();
   VLOG(V_TIMING) << "Computing-----------------------------";
   op_->Compute(ctxt_);
+  if (trace.active()) {
+    trace.SetName(op_->name());
+    trace.AddArg("shapes", TensorShapes(ctxt_));
+  }
 
   VLOG(V_TIMING) << "Recording My Event if necessary-------";
   ctxt_->RecordMyEvent();
@@ -45,13 +90,16 @@ void GraphStatement::Run() {
   CHECK(node_func_);
   CHECK(gscheduler_);
 
+  const int64_t begin_ns = Tracer::NowNs();
+  schedule_ns_ = 0;
   if (push_arg_stmt_)
     push_arg_stmt_->Run();
 
   //checkCudaError(cudaDeviceSynchronize());
   //LOG(INFO) << "Loading graph...";
   Timing::TimingBegin("GraphParsing");
-  int output_length = gscheduler_->LoadGraph(global_ctxt_->Input(0));
+  int output_length;
+  TRACE_SCHEDULER("LoadGraph", output_length = gscheduler_->LoadGraph(global_ctxt_->Input(0)));
   //LOG(INFO) << "Load graph done...";
   CHECK(output_length > 0);
   //we must clear the dynamic size in case previous ops have changed it;
@@ -59,20 +107,21 @@ void GraphStatement::Run() {
   //the dynamic size to a size larger than the gather output capacity,
   //which can not happen
   //LOG(INFO) << "Initialzing 1st round"; 
-  gscheduler_->Initialize();
+  TRACE_SCHEDULER("Initialize", gscheduler_->Initialize());
   //checkCudaError(cudaDeviceSynchronize());
   //LOG(INFO) << "Initialzing 1st round done";
   Timing::TimingEnd("GraphParsing");
   int round = 0;
 
   Timing::TimingBegin("RNNForward");
+  RunHoisted();
   while (!gscheduler_->Terminate()) {
     //LOG(INFO) << "doing job_id: " << gscheduler_->GetJobId()[0];
-    VLOG(V_DEBUG) << "round: " << round++
+    VLOG(V_DEBUG) << "round: " << round
       << "\t job_counts:" << gscheduler_->GetJobId().size()
       << "\t job_id :" << gscheduler_->GetJobId()[0];
-    node_func_->Run();
-    gscheduler_->ActivateNext();
+    RunRound("ForwardRound", round++);
+    TRACE_SCHEDULER("ActivateNext", gscheduler_->ActivateNext());
   }
 
   //we must set dynamic size for graphoutput here
@@ -82,6 +131,59 @@ void GraphStatement::Run() {
     pop_ret_stmt_->Run();
   VLOG(V_DEBUG) << "GraphOutput done";
   Timing::TimingEnd("RNNForward");
+  FinishStats(output_length, begin_ns);
+}
+
+void GraphStatement::RunRound(const char* name, int round) {
+  const int jobs = gscheduler_->GetJobId().size();
+  TraceScope trace("round", name);
+  if (trace.active()) {
+    trace.AddArg("round", round);
+    trace.AddArg("jobs", jobs);
+  }
+  Statement* func = RoundFunction();
+  func->Run();
+  stats_.AddRound(jobs, StatementCount(func));
+}
+
+void GraphStatement::FinishStats(int vertices, int64_t begin_ns) {
+  const int64_t run_ns = Tracer::NowNs() - begin_ns;
+  stats_.batches++;
+  stats_.vertices += vertices;
+  stats_.schedule_ms += schedule_ns_/1e6;
+  stats_.compute_ms += (run_ns - schedule_ns_)/1e6;
+  if (FLAGS_graph_stats_every_n_batches > 0 &&
+      stats_.batches % FLAGS_graph_stats_every_n_batches == 0) {
+    LOG(INFO) << (dynamic_cast<GraphGradStatement*>(this) ? "Backward" : "Forward")
+              << " graph batching:\t" << stats_.DebugString();
+  }
+}
+
+//the leaves all run in the first round, so each function
+//takes one span of rows and its hoisted statements run over it
+void GraphStatement::RunHoisted() {
+  if (node_hoisted_.empty() && leaf_hoisted_.empty())
+    return;
+  BatchGraphScheduler* bs = dynamic_cast<BatchGraphScheduler*>(gscheduler_);
+  CHECK_NOTNULL(bs);
+  const int leaf_rows = leaf_func_ ? bs->leaf_rows() : 0;
+  const int rows[3] = {0, leaf_rows, bs->scheduled_rows()};
+  const std::vector<Statement*>* hoisted[2] = {&leaf_hoisted_, &node_hoisted_};
+  for (int i = 0; i < 2; i++) {
+    if (hoisted[i]->empty() || rows[i] == rows[i+1])
+      continue;
+    TRACE_SCHEDULER("LoadRows", bs->LoadRows(rows[i], rows[i+1]));
+    OpContext::SetDynDim(rows[i+1] - rows[i]);
+    {
+      TraceScope trace("round", "HoistedRows");
+      if (trace.active())
+        trace.AddArg("jobs", rows[i+1] - rows[i]);
+      for (auto* stmt : *hoisted[i])
+        stmt->Run();
+    }
+    stats_.statements += hoisted[i]->size();
+    TRACE_SCHEDULER("ClearRows", bs->ClearRows());
+  }
 }
 
 void GraphGradStatement::Run() {
@@ -89,37 +191,78 @@ void GraphGradStatement::Run() {
   CHECK(node_func_);
   CHECK(gscheduler_);
 
+  const int64_t begin_ns = Tracer::NowNs();
+  schedule_ns_ = 0;
   if (push_arg_stmt_)
     push_arg_stmt_->Run();
 
   VLOG(V_DEBUG) << "here123";
-  int input_length = gscheduler_->ReverseGraph();
+  int input_length;
+  TRACE_SCHEDULER("ReverseGraph", input_length = gscheduler_->ReverseGraph());
   //global_ctxt_->SetDynDim(-1);
-  gscheduler_->Initialize();
+  TRACE_SCHEDULER("Initialize", gscheduler_->Initialize());
   int round = 0;
 
   VLOG(V_DEBUG) << "here123";
   Timing::TimingBegin("RNNBackward");
+  int widest_round = 0;
   while (!gscheduler_->Terminate()) {
     //LOG(INFO) << "doing job_id: " << gscheduler_->GetJobId()[0];
-    VLOG(V_DEBUG) << "round: " << round++
+    VLOG(V_DEBUG) << "round: " << round
       << "\t job_counts:" << gscheduler_->GetJobId().size()
       << "\t job_id :" << gscheduler_->GetJobId()[0];
-    node_func_->Run();
-    gscheduler_->ActivateNext();
+    widest_round = std::max(widest_round, Recompute());
+    RunRound("BackwardRound", round++);
+    TRACE_SCHEDULER("ActivateNext", gscheduler_->ActivateNext());
   }
 
+  RunHoisted();
   OpContext::SetDynDim(input_length);
   for (auto* stmt : batch_weight_updates_) {
     dynamic_cast<ExprStatement*>(stmt)->GetContext()->ResetTensorOffset();
     dynamic_cast<ExprStatement*>(stmt)->GetContext()->ScaleInputTensor();
     stmt->Run();
   }
+  stats_.statements += batch_weight_updates_.size();
 
   if (pop_ret_stmt_)
     pop_ret_stmt_->Run();
   VLOG(V_DEBUG) << "GraphOutputGrad done";
   Timing::TimingEnd("RNNBackward");
+  FinishStats(input_length, begin_ns);
+  if (recomputed_row_bytes_ > 0)
+    LogCheckpointing(input_length, widest_round);
+}
+
+//the forward statements read the checkpointed rows of the round
+//and write the round-local activations its gradients read
+int GraphGradStatement::Recompute() {
+  const int rows = gscheduler_->GetJobId().size();
+  const std::vector<Statement*>& recomputed =
+    (leaf_func_ && gscheduler_->IsLeafRound()) ? leaf_recomputed_ : node_recomputed_;
+  if (recomputed.empty())
+    return rows;
+  TraceScope trace("round", "Recompute");
+  OpContext::SetDynDim(rows);
+  for (auto* stmt : recomputed)
+    stmt->Run();
+  stats_.statements += recomputed.size();
+  return rows;
+}
+
+//each vertex is computed twice by the recomputed statements,
+//the extra work is estimated by the bytes they write per vertex.
+//Without checkpointing, their tensors would hold the rows of all the vertices
+void GraphGradStatement::LogCheckpointing(int vertices, int widest_round) const {
+  const float MB = 1024.f*1024.f;
+  LOG(INFO) << "Checkpointing:\trecomputed "
+            << recomputed_row_bytes_ << " of " << forward_row_bytes_
+            << " bytes per vertex(~"
+            << 100.f*recomputed_row_bytes_/forward_row_bytes_
+            << "% more forward work)\tkept "
+            << widest_round*recomputed_row_bytes_/MB << "MB instead of "
+            << vertices*recomputed_row_bytes_/MB << "MB for "
+            << vertices << " vertices";
 }
 
 } //namespace midend
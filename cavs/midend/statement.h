@@ -3,8 +3,10 @@
 
 #include "cavs/midend/op_context.h"
 #include "cavs/midend/graph_scheduler.h"
+#include "cavs/midend/graph_stats.h"
 #include "cavs/backend/op_impl.h"
 #include "cavs/util/macros_gpu.h"
+#include "cavs/util/tracer.h"
 
 #include <string>
 #include <vector>
@@ -68,6 +70,11 @@ class BasicBlock : public Statement {
   inline void Run() override {
     VLOG(V_TIMING) << "This Basic Block Begins";
     for (int i = 0; i < iter_; i++) {
+      TraceScope trace("block", "BasicBlock");
+      if (trace.active()) {
+        trace.AddArg("iteration", i);
+        trace.AddArg("statements", stmts_.size());
+      }
       for (auto* stmt : stmts_) {
         stmt->Run();
       }
@@ -76,6 +83,8 @@ class BasicBlock : public Statement {
     VLOG(V_TIMING) << "This Basic Block Ends";
   }
   SType type() const override { return BASICBLOCK; }
+  //the statements a run executes
+  inline int size() const { return iter_*stmts_.size(); }
 
   inline Statement* AppendStmt(Statement* stmt) {
     CHECK(stmt);
@@ -84,6 +93,8 @@ class BasicBlock : public Statement {
   }
 
   friend class ScopedNode;
+  friend class MemoryPlanner;
+  friend class SimpleSession;
 
  protected:
   int iter_;
@@ -116,6 +127,8 @@ class FunctionCallStatement : public Statement {
   }
   SType type() const override { return FUNCCALL; }
 
+  friend class MemoryPlanner;
+
  protected:
   FunctionCallStatement()
     : push_arg_stmt_(NULL), pop_ret_stmt_(NULL), global_ctxt_(NULL) {}
@@ -129,25 +142,83 @@ class FunctionCallStatement : public Statement {
 class GraphStatement : public FunctionCallStatement {
  public:
   GraphStatement(Statement* node_func, GraphSchedulerBase* gs)
-    : node_func_(node_func), gscheduler_(gs) {}
+    : node_func_(node_func), leaf_func_(NULL), gscheduler_(gs), schedule_ns_(0) {}
   void Run() override;
+  inline void SetLeafFunction(Statement* leaf_func) {
+    leaf_func_ = leaf_func;
+  }
+  //the statements hoisted out of the rounds of each function,
+  //they run once over the rows of all the rounds running it
+  inline void SetHoistedStatements(std::vector<Statement*>&& node_hoisted,
+                                   std::vector<Statement*>&& leaf_hoisted) {
+    node_hoisted_ = std::move(node_hoisted);
+    leaf_hoisted_ = std::move(leaf_hoisted);
+  }
+  inline const Tensor& graph_struct() const {
+    CHECK_NOTNULL(global_ctxt_);
+    return global_ctxt_->Input(0);
+  }
+  inline GraphSchedulerBase* graph_scheduler() const { return gscheduler_; }
+  //the batching of the runs since the last reset
+  inline const GraphStats& stats() const { return stats_; }
+  inline void ResetStats() { stats_.Reset(); }
+
+  friend class MemoryPlanner;
 
  protected:
+  //the function the current round runs
+  inline Statement* RoundFunction() const {
+    return (leaf_func_ && gscheduler_->IsLeafRound()) ? leaf_func_ : node_func_;
+  }
+  void RunHoisted();
+  //runs the function of the current round
+  void RunRound(const char* name, int round);
+  //adds the run of vertices begun at begin_ns to the stats
+  void FinishStats(int vertices, int64_t begin_ns);
   Statement* node_func_;
+  Statement* leaf_func_;
+  std::vector<Statement*> node_hoisted_;
+  std::vector<Statement*> leaf_hoisted_;
   GraphSchedulerBase* gscheduler_;
+  GraphStats stats_;
+  //the host time of the scheduler calls of the run
+  int64_t schedule_ns_;
 };
 
 class GraphGradStatement : public GraphStatement {
  public:
   GraphGradStatement(Statement* node_func, GraphSchedulerBase* gs)
-    : GraphStatement(node_func, gs), batch_weight_updates_(0) {}
+    : GraphStatement(node_func, gs), batch_weight_updates_(0),
+      forward_row_bytes_(0), recomputed_row_bytes_(0) {}
   void Run() override;
   inline void SetBatchWeightUpdate(std::vector<Statement*>&& wu) {
     batch_weight_updates_ = std::move(wu);
   }
+  //the forward statements of each function whose activations hold one round,
+  //every backward round runs them again ahead of its gradients.
+  //The bytes per vertex they write, out of those of the forward functions,
+  //make the cost model reported for each run
+  inline void SetRecomputedStatements(std::vector<Statement*>&& node_recomputed,
+                                      std::vector<Statement*>&& leaf_recomputed,
+                                      size_t forward_row_bytes,
+                                      size_t recomputed_row_bytes) {
+    node_recomputed_ = std::move(node_recomputed);
+    leaf_recomputed_ = std::move(leaf_recomputed);
+    forward_row_bytes_ = forward_row_bytes;
+    recomputed_row_bytes_ = recomputed_row_bytes;
+  }
+
+  friend class MemoryPlanner;
 
  private:
+  //returns the rows of the round
+  int Recompute();
+  void LogCheckpointing(int vertices, int widest_round) const;
   std::vector<Statement*> batch_weight_updates_;
+  std::vector<Statement*> node_recomputed_;
+  std::vector<Statement*> leaf_recomputed_;
+  size_t forward_row_bytes_;
+  size_t recomputed_row_bytes_;
 };
 
 } //namespace midend
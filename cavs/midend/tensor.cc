@@ -47,6 +47,7 @@ class TensorBuffer : public TensorBufferBase {
     if (data_) { alloc_->Deallocate<T>(data_); }
     data_ = alloc_->Allocate<T>(size/sizeof(T));   
     elem_ = size/sizeof(T);
+    return data_;
   }
 
  private:
@@ -263,11 +264,19 @@ bool Tensor::ScaleDynamicDimension(int new_dim) {
   shape_.SetDim(0, new_dim);   
   size_t new_size = shape_.n_elements();
   CASES(params_->type, new_size *= sizeof(T));
-  if (old_dim < new_dim && buf_->size() < new_size) {
+  if (params_->round_local) {
+    //it keeps spare rows, so that it never looks like a full shape
+    if (buf_->size() <= new_size) {
+      buf_->Resize(2*new_size);
+      return true;
+    }
+  }else if (old_dim < new_dim && buf_->size() < new_size) {
     CHECK_NOTNULL(buf_.get());
     //VLOG(V_DEBUG) << "Resizing " << new_size << " Bytes";
     buf_->Resize(new_size);
+    return true;
   }
+  return false;
 }
 
 void Tensor::SetZeroInitEnforced() {
@@ -280,13 +289,32 @@ bool Tensor::ZeroInitEnforced() const {
   return params_->zero_init_enforced;
 }
 
+void Tensor::SetRowSparse(bool sparse_writer) {
+  CHECK_NOTNULL(buf_.get());
+  if (!sparse_writer) {
+    buf_->dense_writer_ = true;
+    buf_->row_sparse_.reset();
+  }else if (!buf_->dense_writer_ && !buf_->row_sparse_ &&
+            device_type() == GPU && !IsDynamicShape() && dims() > 0) {
+    buf_->row_sparse_.reset(new RowSparseIndex(buf_->alloc_, dims(0)));
+  }
+}
+
+RowSparseIndex* Tensor::row_sparse_index() const {
+  CHECK_NOTNULL(buf_.get());
+  return buf_->row_sparse_.get();
+}
+
 bool Tensor::InitWithZero(int iteration) {
   CHECK_NOTNULL(params_.get());
   CHECK(ZeroInitEnforced());
   size_t visable_size = count();
   CASES(params_->type, visable_size *= sizeof(T));
   if (params_->iteration == iteration-1) {
-    buf_->InitWithZero();
+    if (RowSparseIndex* index = row_sparse_index())
+      index->Clear(mutable_data<char>(), visable_size/dims(0));
+    else
+      buf_->InitWithZero();
     params_->iteration++;
     VLOG(V_DEBUG) << "Setting Zero for " << name() << " in round " << params_->iteration;
     return true;
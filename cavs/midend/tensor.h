@@ -4,6 +4,7 @@
 #include "cavs/proto/types.pb.h"
 #include "cavs/proto/devices.pb.h"
 #include "cavs/midend/allocator.h"
+#include "cavs/midend/row_sparse_index.h"
 #include "cavs/util/logging.h"
 #include "cavs/util/macros.h"
 
@@ -17,7 +18,7 @@ namespace midend {
 //data
 class TensorBufferBase {
  public:
-  TensorBufferBase(Allocator* alloc) : alloc_(alloc) {}
+  TensorBufferBase(Allocator* alloc) : alloc_(alloc), dense_writer_(false) {}
   FORCE_INLINE DeviceType device_type() const { return alloc_->type(); }
   virtual ~TensorBufferBase() {}
   virtual void* data()  const = 0;
@@ -27,6 +28,12 @@ class TensorBufferBase {
 
  protected:
   Allocator* const alloc_;
+
+ private:
+  //kept as long as no writer of the buffer adds dense values
+  std::unique_ptr<RowSparseIndex> row_sparse_;
+  bool dense_writer_;
+  friend class Tensor;
 };
 
 //metadata
@@ -75,6 +82,8 @@ class Tensor {
   inline bool IsDynamicShape()    const { return params_->dynamic;    }
   inline DataType data_type()     const { return params_->type;       }
   inline void SetAsDynamic()            { params_->dynamic = true;    }
+  inline bool IsRoundLocal()      const { return params_->round_local; }
+  inline void SetAsRoundLocal()         { params_->round_local = true; }
   //for opeators
   inline int count()         const { return shape_.n_elements(); }
   inline int dims()          const { return shape_.dim();        }
@@ -91,6 +100,7 @@ class Tensor {
   void Reshape(const Tensor& t);
   //void Resize(const TensorShapeDef& shape);
   void Resize(const TensorShape& shape);
+  //returns true when the buffer is reallocated
   bool ScaleDynamicDimension(int new_dim);
   template <typename T>
     T* mutable_data() const {
@@ -104,6 +114,12 @@ class Tensor {
   void SetZeroInitEnforced();
   bool ZeroInitEnforced() const;
   bool InitWithZero(int iteration);
+  //a writer listing the rows it adds to keeps the buffer row-sparse,
+  //any other writer makes it dense for good(see RowSparseIndex)
+  void SetRowSparse(bool sparse_writer);
+  //the rows written since the last zeroing, NULL for a dense buffer.
+  //the rows are only complete without an overflow
+  RowSparseIndex* row_sparse_index() const;
   void SetOffsetWithId(int id);
   bool IsFullShape() const;
 
@@ -116,10 +132,11 @@ class Tensor {
 
   friend class TensorCApi;
   friend class SessionBase;
+  friend class MemoryPlanner;
 
   struct Params {
     Params() : type(DataType(0)), offset(0), dynamic(false),
-               zero_init_enforced(false), iteration(0) {}
+               zero_init_enforced(false), round_local(false), iteration(0) {}
     DataType type;
     size_t offset;
     //dynamic is used in two cases:
@@ -129,6 +146,9 @@ class Tensor {
     //   which means the batch dimension changes frequently during runtime
     bool dynamic;
     bool zero_init_enforced;
+    //a round-local tensor only holds the rows of the current round,
+    //every round of the graph scheduler reuses it from row 0
+    bool round_local;
     int iteration;
   };
 
@@ -0,0 +1,170 @@
+#include "cavs/util/tracer.h"
+#include "cavs/util/logging.h"
+
+#include <stdio.h>
+#include <unistd.h>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+DEFINE_string(trace_file, "",
+    "writes a chrome trace of the sampled session runs to this file, empty disables tracing");
+DEFINE_int32(trace_every_n_runs, 100,
+    "traces one session run of every n");
+
+using std::string;
+using std::vector;
+using std::mutex;
+using std::lock_guard;
+
+std::atomic<bool> Tracer::sampling_(false);
+
+namespace {
+
+struct Event {
+  const char* category;
+  string name;
+  int64_t begin_ns;
+  int64_t end_ns;
+  string args;
+};
+
+struct ThreadEvents {
+  int tid;
+  mutex mu;
+  vector<Event> events;
+};
+
+//the buffers are never freed, the events of a thread
+//that is gone are still written with the run
+struct Timeline {
+  Timeline() : file(NULL), runs(0), sampled(0), run_begin_ns(0) {}
+  mutex mu;
+  vector<ThreadEvents*> threads;
+  FILE* file;
+  int64_t runs;
+  int64_t sampled;
+  int64_t run_begin_ns;
+};
+
+Timeline* GetTimeline() {
+  static Timeline* t = new Timeline();
+  return t;
+}
+
+ThreadEvents* LocalEvents() {
+  thread_local ThreadEvents* local = NULL;
+  if (!local) {
+    local = new ThreadEvents();
+    Timeline* t = GetTimeline();
+    lock_guard<mutex> lock(t->mu);
+    local->tid = t->threads.size();
+    t->threads.push_back(local);
+  }
+  return local;
+}
+
+string Escape(const string& s) {
+  string ret;
+  for (char c : s) {
+    if (c == '"' || c == '\\')
+      ret += '\\';
+    if (c == '\n')
+      ret += ' ';
+    else
+      ret += c;
+  }
+  return ret;
+}
+
+//the json array format, whose closing bracket may be left out,
+//so the file is readable however the process ends
+void WriteEvent(FILE* f, const Event& e, int pid, int tid) {
+  fprintf(f, "{\"ph\":\"X\",\"cat\":\"%s\",\"name\":\"%s\",\"pid\":%d,\"tid\":%d,"
+             "\"ts\":%.3f,\"dur\":%.3f,\"args\":{%s}},\n",
+          e.category, Escape(e.name).c_str(), pid, tid,
+          e.begin_ns/1000.0, (e.end_ns - e.begin_ns)/1000.0, e.args.c_str());
+}
+
+} //namespace
+
+int64_t Tracer::NowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Tracer::BeginRun() {
+  if (FLAGS_trace_file.empty())
+    return;
+  CHECK(FLAGS_trace_every_n_runs > 0) << FLAGS_trace_every_n_runs;
+  Timeline* t = GetTimeline();
+  lock_guard<mutex> lock(t->mu);
+  if (t->runs++ % FLAGS_trace_every_n_runs != 0)
+    return;
+  t->run_begin_ns = NowNs();
+  sampling_.store(true, std::memory_order_relaxed);
+}
+
+void Tracer::EndRun() {
+  if (!Sampling())
+    return;
+  sampling_.store(false, std::memory_order_relaxed);
+  const int64_t end_ns = NowNs();
+  Timeline* t = GetTimeline();
+  int64_t run, begin_ns;
+  {
+    lock_guard<mutex> lock(t->mu);
+    run = t->runs - 1;
+    begin_ns = t->run_begin_ns;
+  }
+  Record("session", "Run", begin_ns, end_ns, "\"run\":" + std::to_string(run));
+
+  lock_guard<mutex> lock(t->mu);
+  if (!t->file) {
+    CHECK(t->file = fopen(FLAGS_trace_file.c_str(), "w")) << FLAGS_trace_file;
+    fputs("[\n", t->file);
+    LOG(INFO) << "Tracing one run of every " << FLAGS_trace_every_n_runs
+              << " to " << FLAGS_trace_file;
+  }
+  const int pid = getpid();
+  for (ThreadEvents* te : t->threads) {
+    lock_guard<mutex> thread_lock(te->mu);
+    for (const Event& e : te->events)
+      WriteEvent(t->file, e, pid, te->tid);
+    te->events.clear();
+  }
+  fflush(t->file);
+  t->sampled++;
+}
+
+void Tracer::Record(const char* category, const string& name,
+    int64_t begin_ns, int64_t end_ns, const string& args) {
+  ThreadEvents* te = LocalEvents();
+  lock_guard<mutex> lock(te->mu);
+  te->events.push_back({category, name, begin_ns, end_ns, args});
+}
+
+int64_t Tracer::sampled_runs() {
+  Timeline* t = GetTimeline();
+  lock_guard<mutex> lock(t->mu);
+  return t->sampled;
+}
+
+void TraceScope::AddArg(const char* key, int64_t value) {
+  if (!args_.empty())
+    args_ += ',';
+  args_ += '"';
+  args_ += key;
+  args_ += "\":";
+  args_ += std::to_string(value);
+}
+
+void TraceScope::AddArg(const char* key, const string& value) {
+  if (!args_.empty())
+    args_ += ',';
+  args_ += '"';
+  args_ += key;
+  args_ += "\":\"";
+  args_ += Escape(value);
+  args_ += '"';
+}
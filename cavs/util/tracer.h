@@ -0,0 +1,66 @@
+#ifndef CAVS_UTIL_TRACER_H_
+#define CAVS_UTIL_TRACER_H_
+
+#include "cavs/util/macros.h"
+
+#include <string>
+#include <atomic>
+#include <stdint.h>
+
+//A host-clock timeline of the sampled session runs, written in the
+//chrome trace format(chrome://tracing or ui.perfetto.dev) to --trace_file.
+//One run of every --trace_every_n_runs is sampled. Out of the sampled runs,
+//a trace point costs one relaxed load and a branch, so it can stay enabled.
+//The events are buffered per thread and written once the run is done.
+//For the device ops, a statement spans the launch of its kernels only.
+class Tracer {
+ public:
+  //called by the session around each run, decides whether it is sampled
+  static void BeginRun();
+  static void EndRun();
+  FORCE_INLINE static bool Sampling() {
+    return sampling_.load(std::memory_order_relaxed);
+  }
+  static int64_t NowNs();
+  //a complete event of the calling thread,
+  //args is the body of a json object, such as "jobs":3
+  static void Record(const char* category, const std::string& name,
+                     int64_t begin_ns, int64_t end_ns, const std::string& args);
+  //the runs sampled so far
+  static int64_t sampled_runs();
+
+ private:
+  static std::atomic<bool> sampling_;
+};
+
+//traces its own lifetime if the run is sampled when it is constructed
+class TraceScope {
+ public:
+  TraceScope(const char* category, const char* name)
+    : category_(category), active_(Tracer::Sampling()) {
+    if (active_) {
+      name_ = name;
+      begin_ns_ = Tracer::NowNs();
+    }
+  }
+  ~TraceScope() {
+    if (active_)
+      Tracer::Record(category_, name_, begin_ns_, Tracer::NowNs(), args_);
+  }
+  //the names and the args are only built when it is active
+  FORCE_INLINE bool active() const { return active_; }
+  inline void SetName(const std::string& name) { name_ = name; }
+  void AddArg(const char* key, int64_t value);
+  void AddArg(const char* key, const std::string& value);
+
+ private:
+  const char* category_;
+  const bool active_;
+  std::string name_;
+  std::string args_;
+  int64_t begin_ns_;
+
+  DISALLOW_COPY_AND_ASSIGN(TraceScope);
+};
+
+#endif
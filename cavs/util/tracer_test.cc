@@ -0,0 +1,62 @@
+#include "cavs/util/tracer.h"
+#include "cavs/util/logging.h"
+
+#include <unistd.h>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+DECLARE_string(trace_file);
+DECLARE_int32(trace_every_n_runs);
+
+int Count(const std::string& text, const std::string& pattern) {
+  int n = 0;
+  for (size_t pos = text.find(pattern); pos != std::string::npos;
+       pos = text.find(pattern, pos+1))
+    n++;
+  return n;
+}
+
+void Run(int jobs) {
+  Tracer::BeginRun();
+  for (int round = 0; round < 3; round++) {
+    TraceScope trace("round", "ForwardRound");
+    if (trace.active())
+      trace.AddArg("jobs", jobs);
+    TraceScope op("op", "");
+    if (op.active()) {
+      op.SetName("MatMul");
+      op.AddArg("shapes", "[2,3],[3,4]->[2,4]");
+    }
+  }
+  //the events of another thread go to the same run
+  std::thread([]() { TraceScope trace("scheduler", "Prepare"); }).join();
+  Tracer::EndRun();
+}
+
+int main() {
+  FLAGS_trace_file = "/tmp/cavs_tracer_test_" + std::to_string(getpid()) + ".json";
+  FLAGS_trace_every_n_runs = 2;
+  CHECK(!Tracer::Sampling());
+  for (int i = 0; i < 5; i++)
+    Run(i);
+  CHECK(!Tracer::Sampling());
+  CHECK(Tracer::sampled_runs() == 3) << Tracer::sampled_runs();
+
+  std::ifstream in(FLAGS_trace_file);
+  std::stringstream buffer;
+  buffer << in.rdbuf();
+  const std::string text = buffer.str();
+  CHECK(text.substr(0, 2) == "[\n") << text;
+  CHECK(Count(text, "\"ph\":\"X\"") == 3*(3*2+2)) << text;
+  CHECK(Count(text, "\"name\":\"Run\"") == 3);
+  CHECK(Count(text, "\"name\":\"MatMul\"") == 9);
+  CHECK(Count(text, "\"shapes\":\"[2,3],[3,4]->[2,4]\"") == 9);
+  CHECK(Count(text, "\"name\":\"Prepare\"") == 3);
+  //only the sampled runs 0, 2 and 4
+  CHECK(Count(text, "\"jobs\":0") == 3 && Count(text, "\"jobs\":1") == 0 &&
+        Count(text, "\"jobs\":4") == 3) << text;
+  unlink(FLAGS_trace_file.c_str());
+  LOG(INFO) << "Tracer test passed";
+  return 0;
+}